@@ -0,0 +1,237 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * bench_runner.c - runs bench_syscalls with each benchmark, in each
+ * configuration of syscall_intercept, and prints the results as a table,
+ * and as JSON.
+ *
+ * Usage: bench_runner bench_syscalls libsyscall_intercept.so
+ *			bench_empty_hook.so [results.json [iterations]]
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+enum preload { PRELOAD_NONE, PRELOAD_LIB, PRELOAD_HOOK };
+
+static const struct variant {
+	const char *name;
+	const char *site;
+	enum preload preload;
+	const char *env;
+} variants[] = {
+	{ "native", "libc", PRELOAD_NONE, nullptr },
+	{ "no_hook", "libc", PRELOAD_LIB, nullptr },
+	{ "empty_hook", "libc", PRELOAD_HOOK, nullptr },
+	{ "no_trampoline", "libc", PRELOAD_HOOK, "INTERCEPT_NO_TRAMPOLINE=1" },
+	{ "xmm_save", "libc", PRELOAD_HOOK, "INTERCEPT_NO_YMM_SAVE=1" },
+	{ "native_site", "plain", PRELOAD_NONE, nullptr },
+	{ "relocating_site", "plain", PRELOAD_HOOK, "INTERCEPT_ALL_OBJS=1" },
+	{ "nop_site", "nop", PRELOAD_HOOK, "INTERCEPT_ALL_OBJS=1" }
+};
+
+static const char *const benchmarks[] = {
+	"getpid", "read0", "futex_wake", "write_devnull"
+};
+
+#define VARIANT_COUNT (sizeof(variants) / sizeof(variants[0]))
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static struct result {
+	unsigned long long median;
+	unsigned long long min;
+	bool valid;
+} results[BENCHMARK_COUNT][VARIANT_COUNT];
+
+static const char *bench_path;
+static const char *lib_path;
+static const char *hook_path;
+static const char *iterations = "100000";
+
+/* environment variables that would change the configuration measured */
+static const char *const cleared_env[] = {
+	"LD_PRELOAD", "INTERCEPT_LOG", "INTERCEPT_PROFILE", "INTERCEPT_TRACE",
+	"INTERCEPT_CAPTURE", "INTERCEPT_ALL_OBJS", "INTERCEPT_NO_TRAMPOLINE",
+	"INTERCEPT_NO_YMM_SAVE", "INTERCEPT_HOOK_CMDLINE_FILTER"
+};
+
+static void
+exec_benchmark(const struct variant *variant, const char *benchmark)
+{
+	for (size_t i = 0; i < sizeof(cleared_env) / sizeof(cleared_env[0]);
+	    ++i)
+		unsetenv(cleared_env[i]);
+
+	if (variant->preload == PRELOAD_LIB)
+		setenv("LD_PRELOAD", lib_path, 1);
+	else if (variant->preload == PRELOAD_HOOK)
+		setenv("LD_PRELOAD", hook_path, 1);
+
+	if (variant->env != nullptr)
+		putenv((char *)variant->env);
+
+	execl(bench_path, bench_path, benchmark, variant->site, iterations,
+	    (char *)nullptr);
+	err(EXIT_FAILURE, "%s", bench_path);
+}
+
+static bool
+run_benchmark(const struct variant *variant, const char *benchmark,
+		struct result *result)
+{
+	int fds[2];
+	char output[0x100];
+
+	if (pipe(fds) != 0)
+		err(EXIT_FAILURE, "pipe");
+
+	pid_t pid = fork();
+	if (pid < 0)
+		err(EXIT_FAILURE, "fork");
+
+	if (pid == 0) {
+		close(fds[0]);
+		if (dup2(fds[1], 1) < 0)
+			_exit(EXIT_FAILURE);
+		exec_benchmark(variant, benchmark);
+	}
+
+	close(fds[1]);
+
+	size_t len = 0;
+	ssize_t r;
+	while (len < sizeof(output) - 1 &&
+	    (r = read(fds[0], output + len, sizeof(output) - 1 - len)) > 0)
+		len += (size_t)r;
+	output[len] = '\0';
+	close(fds[0]);
+
+	int status;
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != 0)
+		return false;
+
+	char name[0x40];
+	return sscanf(output, "%63s %llu %llu", name,
+	    &result->median, &result->min) == 3;
+}
+
+static void
+print_table(void)
+{
+	printf("%-16s", "TSC cycles/call");
+	for (size_t b = 0; b < BENCHMARK_COUNT; ++b)
+		printf(" %14s", benchmarks[b]);
+	putchar('\n');
+
+	for (size_t v = 0; v < VARIANT_COUNT; ++v) {
+		printf("%-16s", variants[v].name);
+		for (size_t b = 0; b < BENCHMARK_COUNT; ++b) {
+			if (results[b][v].valid)
+				printf(" %14llu", results[b][v].median);
+			else
+				printf(" %14s", "failed");
+		}
+		putchar('\n');
+	}
+}
+
+static void
+write_json(FILE *f)
+{
+	bool first = true;
+
+	fprintf(f, "{\n  \"unit\": \"tsc_cycles_per_call\",\n");
+	fprintf(f, "  \"iterations\": %s,\n  \"results\": [", iterations);
+
+	for (size_t v = 0; v < VARIANT_COUNT; ++v) {
+		for (size_t b = 0; b < BENCHMARK_COUNT; ++b) {
+			const struct result *r = &results[b][v];
+
+			if (!r->valid)
+				continue;
+
+			fprintf(f, "%s\n    {\"variant\": \"%s\", "
+			    "\"site\": \"%s\", \"benchmark\": \"%s\", "
+			    "\"median\": %llu, \"min\": %llu}",
+			    first ? "" : ",", variants[v].name,
+			    variants[v].site, benchmarks[b],
+			    r->median, r->min);
+			first = false;
+		}
+	}
+
+	fprintf(f, "\n  ]\n}\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *json_path = "bench_results.json";
+
+	if (argc < 4)
+		errx(EXIT_FAILURE, "usage: %s bench_syscalls "
+		    "libsyscall_intercept.so bench_empty_hook.so "
+		    "[results.json [iterations]]", argv[0]);
+
+	bench_path = argv[1];
+	lib_path = argv[2];
+	hook_path = argv[3];
+	if (argc > 4)
+		json_path = argv[4];
+	if (argc > 5)
+		iterations = argv[5];
+
+	for (size_t v = 0; v < VARIANT_COUNT; ++v) {
+		for (size_t b = 0; b < BENCHMARK_COUNT; ++b) {
+			results[b][v].valid = run_benchmark(variants + v,
+			    benchmarks[b], &results[b][v]);
+		}
+	}
+
+	print_table();
+
+	FILE *f = fopen(json_path, "w");
+	if (f == nullptr)
+		err(EXIT_FAILURE, "%s", json_path);
+	write_json(f);
+	fclose(f);
+
+	printf("results written to %s\n", json_path);
+
+	return EXIT_SUCCESS;
+}
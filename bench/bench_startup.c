@@ -0,0 +1,286 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * bench_startup.c - measures the phases of patching an object at startup,
+ * using shared objects generated by gen_synthetic_lib.
+ *
+ * Usage: bench_startup results.json library.so...
+ *
+ * Each library is loaded, and patched the same way the intercept
+ * constructor patches an object with INTERCEPT_ALL_OBJS set. The phases
+ * are timed separately, each library is measured in a few fresh child
+ * processes, the median of those is reported.
+ */
+
+#include <dlfcn.h>
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "intercept.h"
+
+#define RUNS 5
+
+enum phase {
+	PHASE_FIND_SYSCALLS,
+	PHASE_ALLOCATE_TRAMPOLINE,
+	PHASE_CREATE_WRAPPERS,
+	PHASE_ACTIVATE,
+	PHASE_COUNT
+};
+
+static const char *const phase_names[PHASE_COUNT] = {
+	"find_syscalls",
+	"allocate_trampoline_tables",
+	"create_patch_wrappers",
+	"activate_patches"
+};
+
+struct measurement {
+	unsigned long long ns[PHASE_COUNT];
+	unsigned long long text_bytes;
+	unsigned long long sites;
+	unsigned long long nops;
+};
+
+static unsigned long long
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long)ts.tv_sec * 1000000000ULL +
+	    (unsigned long long)ts.tv_nsec;
+}
+
+static struct measurement
+measure(const char *path)
+{
+	struct measurement m = {0};
+	struct intercept_desc desc;
+	Dl_info info;
+
+	void *lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (lib == nullptr)
+		errx(EXIT_FAILURE, "%s", dlerror());
+
+	void *text = dlsym(lib, "synthetic_text_start");
+	if (text == nullptr || !dladdr(text, &info) ||
+	    info.dli_fname == nullptr)
+		errx(EXIT_FAILURE, "%s: not a synthetic library", path);
+
+	memset(&desc, 0, sizeof(desc));
+	desc.base_addr = info.dli_fbase;
+	desc.path = info.dli_fname;
+
+	unsigned long long start = now_ns();
+	find_syscalls(&desc);
+	m.ns[PHASE_FIND_SYSCALLS] = now_ns() - start;
+
+	start = now_ns();
+	allocate_trampoline_tables(&desc, 1);
+	m.ns[PHASE_ALLOCATE_TRAMPOLINE] = now_ns() - start;
+
+	size_t wrapper_space_size =
+	    (desc.count + 1) * (asm_wrapper_tmpl_size + 0x100);
+	unsigned char *wrapper_space = mmap(nullptr, wrapper_space_size,
+	    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (wrapper_space == MAP_FAILED)
+		err(EXIT_FAILURE, "mmap");
+
+	start = now_ns();
+	create_patch_wrappers(&desc, &wrapper_space);
+	m.ns[PHASE_CREATE_WRAPPERS] = now_ns() - start;
+
+	start = now_ns();
+	activate_patches(&desc);
+	m.ns[PHASE_ACTIVATE] = now_ns() - start;
+
+	m.text_bytes = (unsigned long long)(desc.text_end - desc.text_start);
+	m.sites = desc.count;
+	m.nops = desc.nop_count;
+
+	return m;
+}
+
+/* measure in a child process, as a library can only be patched once */
+static struct measurement
+measure_in_child(const char *path)
+{
+	struct measurement m;
+	int fds[2];
+
+	if (pipe(fds) != 0)
+		err(EXIT_FAILURE, "pipe");
+
+	pid_t pid = fork();
+	if (pid < 0)
+		err(EXIT_FAILURE, "fork");
+
+	if (pid == 0) {
+		close(fds[0]);
+		m = measure(path);
+		if (write(fds[1], &m, sizeof(m)) != (ssize_t)sizeof(m))
+			_exit(EXIT_FAILURE);
+		_exit(EXIT_SUCCESS);
+	}
+
+	close(fds[1]);
+	ssize_t r = read(fds[0], &m, sizeof(m));
+	close(fds[0]);
+
+	int status;
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != 0 || r != (ssize_t)sizeof(m))
+		errx(EXIT_FAILURE, "measuring %s failed", path);
+
+	return m;
+}
+
+static int
+compare_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return (x > y) - (x < y);
+}
+
+static struct measurement
+median_of_runs(const char *path)
+{
+	struct measurement runs[RUNS];
+	struct measurement result;
+	unsigned long long values[RUNS];
+
+	for (int r = 0; r < RUNS; ++r)
+		runs[r] = measure_in_child(path);
+
+	result = runs[0];
+	for (int p = 0; p < PHASE_COUNT; ++p) {
+		for (int r = 0; r < RUNS; ++r)
+			values[r] = runs[r].ns[p];
+		qsort(values, RUNS, sizeof(values[0]), compare_ull);
+		result.ns[p] = values[RUNS / 2];
+	}
+
+	return result;
+}
+
+static double
+per(unsigned long long ns, unsigned long long count)
+{
+	return count == 0 ? 0.0 : (double)ns / (double)count;
+}
+
+static const char *
+base_name(const char *path)
+{
+	const char *name = strrchr(path, '/');
+
+	return name == nullptr ? path : name + 1;
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc < 3)
+		errx(EXIT_FAILURE, "usage: %s results.json library.so...",
+		    argv[0]);
+
+	FILE *json = fopen(argv[1], "w");
+	if (json == nullptr)
+		err(EXIT_FAILURE, "%s", argv[1]);
+
+	init_patcher();
+
+	printf("%-28s %10s %8s %8s %12s %12s %12s %12s %10s %10s\n",
+	    "library", "text", "sites", "nops", "find_ns", "alloc_ns",
+	    "wrap_ns", "activate_ns", "find/byte", "wrap/site");
+
+	fprintf(json, "{\n  \"unit\": \"ns\",\n  \"results\": [");
+
+	for (int i = 2; i < argc; ++i) {
+		struct measurement m = median_of_runs(argv[i]);
+		unsigned long long patch_ns = m.ns[PHASE_CREATE_WRAPPERS] +
+		    m.ns[PHASE_ACTIVATE];
+
+		printf("%-28s %10llu %8llu %8llu %12llu %12llu %12llu %12llu "
+		    "%10.2f %10.1f\n", base_name(argv[i]), m.text_bytes,
+		    m.sites, m.nops,
+		    m.ns[PHASE_FIND_SYSCALLS],
+		    m.ns[PHASE_ALLOCATE_TRAMPOLINE],
+		    m.ns[PHASE_CREATE_WRAPPERS],
+		    m.ns[PHASE_ACTIVATE],
+		    per(m.ns[PHASE_FIND_SYSCALLS], m.text_bytes),
+		    per(m.ns[PHASE_CREATE_WRAPPERS], m.sites));
+
+		fprintf(json, "%s\n    {\"library\": \"%s\", "
+		    "\"text_bytes\": %llu, \"sites\": %llu, \"nops\": %llu,",
+		    i == 2 ? "" : ",", base_name(argv[i]),
+		    m.text_bytes, m.sites, m.nops);
+		for (int p = 0; p < PHASE_COUNT; ++p)
+			fprintf(json, " \"%s_ns\": %llu,", phase_names[p],
+			    m.ns[p]);
+		fprintf(json, " \"ns_per_text_byte\": %.3f,"
+		    " \"ns_per_site\": %.3f}",
+		    per(m.ns[PHASE_FIND_SYSCALLS], m.text_bytes),
+		    per(patch_ns, m.sites));
+	}
+
+	fprintf(json, "\n  ]\n}\n");
+	fclose(json);
+
+	printf("results written to %s\n", argv[1]);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * syscall_hook_in_process_allowed - this symbol must be provided to
+ * be able to link with syscall_intercept's objects (other then the one
+ * created from cmdline_filter.c), see test/asm_pattern.c.
+ * Returning zero keeps the library constructor from patching libc in
+ * this process.
+ */
+int
+syscall_hook_in_process_allowed(void)
+{
+	return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * bench_syscalls.c - a syscall in a loop, timed in TSC cycles per call.
+ *
+ * Usage: bench_syscalls benchmark site [iterations]
+ *
+ * benchmark: getpid, read0 (reading zero bytes from a pipe), futex_wake
+ * (without waiters), or write_devnull (one byte written to /dev/null)
+ *
+ * site: libc (the syscall issued by the libc function usually used for it),
+ * plain or nop (see bench_sites.S)
+ *
+ * Prints the median, and the minimum of the cycles per call measured in
+ * a few rounds, e.g.: "getpid 412 398"
+ */
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include <unistd.h>
+#include <linux/futex.h>
+
+#define ROUNDS 11
+
+long bench_syscall_plain_site(long nr, long arg0, long arg1, long arg2);
+long bench_syscall_nop_site(long nr, long arg0, long arg1, long arg2);
+
+static long (*site)(long nr, long arg0, long arg1, long arg2);
+
+static int pipe_fds[2];
+static int devnull;
+static int futex_word;
+static char byte;
+
+static unsigned long long
+rdtsc_ordered(void)
+{
+	unsigned hi, lo;
+
+	__asm__ volatile("lfence\n\trdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+
+	return ((unsigned long long)hi << 32) | lo;
+}
+
+static void
+run_getpid(void)
+{
+	if (site == nullptr)
+		getpid();
+	else
+		site(SYS_getpid, 0, 0, 0);
+}
+
+static void
+run_read0(void)
+{
+	if (site == nullptr)
+		(void) read(pipe_fds[0], &byte, 0);
+	else
+		site(SYS_read, pipe_fds[0], (long)&byte, 0);
+}
+
+static void
+run_futex_wake(void)
+{
+	if (site == nullptr)
+		syscall(SYS_futex, &futex_word, FUTEX_WAKE_PRIVATE, 1);
+	else
+		site(SYS_futex, (long)&futex_word, FUTEX_WAKE_PRIVATE, 1);
+}
+
+static void
+run_write_devnull(void)
+{
+	if (site == nullptr)
+		(void) write(devnull, &byte, 1);
+	else
+		site(SYS_write, devnull, (long)&byte, 1);
+}
+
+static const struct {
+	const char *name;
+	void (*func)(void);
+} benchmarks[] = {
+	{ "getpid", run_getpid },
+	{ "read0", run_read0 },
+	{ "futex_wake", run_futex_wake },
+	{ "write_devnull", run_write_devnull }
+};
+
+static int
+compare_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return (x > y) - (x < y);
+}
+
+int
+main(int argc, char **argv)
+{
+	void (*func)(void) = nullptr;
+	long iterations = 100000;
+	unsigned long long cycles[ROUNDS];
+
+	if (argc < 3)
+		errx(EXIT_FAILURE, "usage: %s benchmark site [iterations]",
+		    argv[0]);
+
+	for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); ++i)
+		if (strcmp(argv[1], benchmarks[i].name) == 0)
+			func = benchmarks[i].func;
+
+	if (func == nullptr)
+		errx(EXIT_FAILURE, "unknown benchmark: %s", argv[1]);
+
+	if (strcmp(argv[2], "plain") == 0)
+		site = bench_syscall_plain_site;
+	else if (strcmp(argv[2], "nop") == 0)
+		site = bench_syscall_nop_site;
+	else if (strcmp(argv[2], "libc") != 0)
+		errx(EXIT_FAILURE, "unknown site: %s", argv[2]);
+
+	if (argc > 3)
+		iterations = atol(argv[3]);
+
+	if (iterations <= 0)
+		errx(EXIT_FAILURE, "invalid iteration count");
+
+	if (pipe(pipe_fds) != 0)
+		err(EXIT_FAILURE, "pipe");
+
+	if ((devnull = open("/dev/null", O_WRONLY)) < 0)
+		err(EXIT_FAILURE, "/dev/null");
+
+	/* warm up caches, and the branch predictor */
+	for (long i = 0; i < iterations / 10; ++i)
+		func();
+
+	for (int r = 0; r < ROUNDS; ++r) {
+		unsigned long long start = rdtsc_ordered();
+
+		for (long i = 0; i < iterations; ++i)
+			func();
+
+		cycles[r] = (rdtsc_ordered() - start) /
+		    (unsigned long long)iterations;
+	}
+
+	qsort(cycles, ROUNDS, sizeof(cycles[0]), compare_ull);
+
+	printf("%s %llu %llu\n", argv[1], cycles[ROUNDS / 2], cycles[0]);
+
+	return EXIT_SUCCESS;
+}
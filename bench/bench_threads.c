@@ -0,0 +1,196 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * bench_threads.c - getpid called in a loop on several threads at once.
+ *
+ * Usage: bench_threads threads [iterations [write]]
+ *
+ * With "write", each call is a one byte write to /dev/null instead. The
+ * file is opened in non-blocking mode, as only syscalls on such files are
+ * executed by the worker thread of INTERCEPT_DELEGATE.
+ *
+ * Each thread times every call separately, in TSC cycles. Prints the
+ * number of threads, the throughput of all threads together in calls per
+ * second, and the median, and 99th percentile latency of a call, e.g.:
+ * "8 21450000 380 1210"
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_THREADS 64
+
+/* each thread's state on separate cache lines, to not measure false sharing */
+struct thread_state {
+	pthread_t thread;
+	unsigned long long *latencies;
+} __attribute__((aligned(64)));
+
+static struct thread_state threads[MAX_THREADS];
+
+static long iterations = 20000;
+static int null_fd = -1;
+static int thread_count;
+static int ready_count;
+static bool start_flag;
+
+static unsigned long long
+rdtsc_ordered(void)
+{
+	unsigned hi, lo;
+
+	__asm__ volatile("lfence\n\trdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+
+	return ((unsigned long long)hi << 32) | lo;
+}
+
+static unsigned long long
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long)ts.tv_sec * 1000000000ULL +
+	    (unsigned long long)ts.tv_nsec;
+}
+
+/* the syscall measured */
+static void
+call(void)
+{
+	if (null_fd < 0)
+		getpid();
+	else if (write(null_fd, "x", 1) != 1)
+		abort();
+}
+
+static void *
+run_thread(void *arg)
+{
+	struct thread_state *state = arg;
+	unsigned long long *latencies = state->latencies;
+
+	/* warm up, then wait for all the other threads */
+	for (long i = 0; i < iterations / 10; ++i)
+		call();
+
+	__atomic_add_fetch(&ready_count, 1, __ATOMIC_SEQ_CST);
+	while (!__atomic_load_n(&start_flag, __ATOMIC_ACQUIRE))
+		__builtin_ia32_pause();
+
+	for (long i = 0; i < iterations; ++i) {
+		unsigned long long start = rdtsc_ordered();
+		call();
+		latencies[i] = rdtsc_ordered() - start;
+	}
+
+	return nullptr;
+}
+
+static int
+compare_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return (x > y) - (x < y);
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc < 2)
+		errx(EXIT_FAILURE, "usage: %s threads [iterations [write]]",
+		    argv[0]);
+
+	thread_count = atoi(argv[1]);
+	if (thread_count <= 0 || thread_count > MAX_THREADS)
+		errx(EXIT_FAILURE, "invalid thread count");
+
+	if (argc > 2)
+		iterations = atol(argv[2]);
+
+	if (iterations <= 0)
+		errx(EXIT_FAILURE, "invalid iteration count");
+
+	if (argc > 3 && strcmp(argv[3], "write") == 0) {
+		null_fd = open("/dev/null", O_WRONLY | O_NONBLOCK);
+		if (null_fd < 0)
+			err(EXIT_FAILURE, "/dev/null");
+	}
+
+	size_t total = (size_t)thread_count * (size_t)iterations;
+	unsigned long long *latencies = calloc(total, sizeof(*latencies));
+	if (latencies == nullptr)
+		err(EXIT_FAILURE, "calloc");
+
+	for (int t = 0; t < thread_count; ++t) {
+		threads[t].latencies =
+		    latencies + (size_t)t * (size_t)iterations;
+		int e = pthread_create(&threads[t].thread, nullptr,
+		    run_thread, threads + t);
+		if (e != 0) {
+			errno = e;
+			err(EXIT_FAILURE, "pthread_create");
+		}
+	}
+
+	while (__atomic_load_n(&ready_count, __ATOMIC_SEQ_CST) < thread_count)
+		__builtin_ia32_pause();
+
+	unsigned long long start = now_ns();
+	__atomic_store_n(&start_flag, true, __ATOMIC_RELEASE);
+
+	for (int t = 0; t < thread_count; ++t)
+		pthread_join(threads[t].thread, nullptr);
+
+	unsigned long long elapsed = now_ns() - start;
+
+	qsort(latencies, total, sizeof(latencies[0]), compare_ull);
+
+	printf("%d %llu %llu %llu\n", thread_count,
+	    (unsigned long long)((double)total * 1e9 / (double)elapsed),
+	    latencies[total / 2], latencies[total - 1 - total / 100]);
+
+	free(latencies);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,253 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * bench_threads_runner.c - runs bench_threads with increasing numbers of
+ * threads, in each configuration, and prints the results as tables, and
+ * as JSON.
+ *
+ * Usage: bench_threads_runner bench_threads libsyscall_intercept.so
+ *			bench_empty_hook.so syscall_logger.so
+ *			[results.json [iterations]]
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+enum preload { PRELOAD_NONE, PRELOAD_HOOK, PRELOAD_LIB, PRELOAD_LOGGER };
+
+/*
+ * The variants calling write compare the direct path to delegating the
+ * syscalls to the worker thread of INTERCEPT_DELEGATE.
+ */
+static const struct variant {
+	const char *name;
+	enum preload preload;
+	const char *env;
+	const char *syscall;
+} variants[] = {
+	{ "native", PRELOAD_NONE, nullptr, "getpid" },
+	{ "empty_hook", PRELOAD_HOOK, nullptr, "getpid" },
+	{ "intercept_log", PRELOAD_LIB, "INTERCEPT_LOG=/dev/null", "getpid" },
+	{ "syscall_logger", PRELOAD_LOGGER, "SYSCALL_LOG_PATH=/dev/null",
+		"getpid" },
+	{ "write_native", PRELOAD_NONE, nullptr, "write" },
+	{ "write_direct", PRELOAD_HOOK, nullptr, "write" },
+	{ "write_delegate", PRELOAD_HOOK, "INTERCEPT_DELEGATE=write",
+		"write" }
+};
+
+static const int thread_counts[] = { 1, 2, 4, 8, 16, 32, 64 };
+
+#define VARIANT_COUNT (sizeof(variants) / sizeof(variants[0]))
+#define THREAD_COUNTS (sizeof(thread_counts) / sizeof(thread_counts[0]))
+
+static struct result {
+	unsigned long long calls_per_sec;
+	unsigned long long median;
+	unsigned long long p99;
+	bool valid;
+} results[VARIANT_COUNT][THREAD_COUNTS];
+
+static const char *bench_path;
+static const char *preload_paths[4];
+static const char *iterations = "20000";
+
+/* environment variables that would change the configuration measured */
+static const char *const cleared_env[] = {
+	"LD_PRELOAD", "INTERCEPT_LOG", "INTERCEPT_PROFILE", "INTERCEPT_TRACE",
+	"INTERCEPT_CAPTURE", "INTERCEPT_ALL_OBJS", "INTERCEPT_NO_TRAMPOLINE",
+	"INTERCEPT_NO_YMM_SAVE", "INTERCEPT_HOOK_CMDLINE_FILTER",
+	"INTERCEPT_LOG_MAX_BYTES", "INTERCEPT_DELEGATE", "SYSCALL_LOG_PATH"
+};
+
+static void
+exec_benchmark(const struct variant *variant, int threads)
+{
+	char thread_arg[16];
+
+	for (size_t i = 0; i < sizeof(cleared_env) / sizeof(cleared_env[0]);
+	    ++i)
+		unsetenv(cleared_env[i]);
+
+	if (variant->preload != PRELOAD_NONE)
+		setenv("LD_PRELOAD", preload_paths[variant->preload], 1);
+
+	if (variant->env != nullptr)
+		putenv((char *)variant->env);
+
+	snprintf(thread_arg, sizeof(thread_arg), "%d", threads);
+
+	execl(bench_path, bench_path, thread_arg, iterations, variant->syscall,
+	    (char *)nullptr);
+	err(EXIT_FAILURE, "%s", bench_path);
+}
+
+static bool
+run_benchmark(const struct variant *variant, int threads,
+		struct result *result)
+{
+	int fds[2];
+	char output[0x100];
+
+	if (pipe(fds) != 0)
+		err(EXIT_FAILURE, "pipe");
+
+	pid_t pid = fork();
+	if (pid < 0)
+		err(EXIT_FAILURE, "fork");
+
+	if (pid == 0) {
+		close(fds[0]);
+		if (dup2(fds[1], 1) < 0)
+			_exit(EXIT_FAILURE);
+		exec_benchmark(variant, threads);
+	}
+
+	close(fds[1]);
+
+	size_t len = 0;
+	ssize_t r;
+	while (len < sizeof(output) - 1 &&
+	    (r = read(fds[0], output + len, sizeof(output) - 1 - len)) > 0)
+		len += (size_t)r;
+	output[len] = '\0';
+	close(fds[0]);
+
+	int status;
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != 0)
+		return false;
+
+	int reported_threads;
+	return sscanf(output, "%d %llu %llu %llu", &reported_threads,
+	    &result->calls_per_sec, &result->median, &result->p99) == 4 &&
+	    reported_threads == threads;
+}
+
+static void
+print_table(const char *title, bool latency)
+{
+	printf("%-16s", title);
+	for (size_t t = 0; t < THREAD_COUNTS; ++t)
+		printf(" %11d", thread_counts[t]);
+	putchar('\n');
+
+	for (size_t v = 0; v < VARIANT_COUNT; ++v) {
+		printf("%-16s", variants[v].name);
+		for (size_t t = 0; t < THREAD_COUNTS; ++t) {
+			const struct result *r = &results[v][t];
+
+			if (r->valid)
+				printf(" %11llu",
+				    latency ? r->p99 : r->calls_per_sec);
+			else
+				printf(" %11s", "failed");
+		}
+		putchar('\n');
+	}
+}
+
+static void
+write_json(FILE *f)
+{
+	bool first = true;
+
+	fprintf(f, "{\n  \"latency_unit\": \"tsc_cycles_per_call\",\n");
+	fprintf(f, "  \"iterations_per_thread\": %s,\n  \"results\": [",
+	    iterations);
+
+	for (size_t v = 0; v < VARIANT_COUNT; ++v) {
+		for (size_t t = 0; t < THREAD_COUNTS; ++t) {
+			const struct result *r = &results[v][t];
+
+			if (!r->valid)
+				continue;
+
+			fprintf(f, "%s\n    {\"variant\": \"%s\", "
+			    "\"syscall\": \"%s\", "
+			    "\"threads\": %d, \"calls_per_sec\": %llu, "
+			    "\"median\": %llu, \"p99\": %llu}",
+			    first ? "" : ",", variants[v].name,
+			    variants[v].syscall,
+			    thread_counts[t], r->calls_per_sec,
+			    r->median, r->p99);
+			first = false;
+		}
+	}
+
+	fprintf(f, "\n  ]\n}\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *json_path = "bench_threads.json";
+
+	if (argc < 5)
+		errx(EXIT_FAILURE, "usage: %s bench_threads "
+		    "libsyscall_intercept.so bench_empty_hook.so "
+		    "syscall_logger.so [results.json [iterations]]", argv[0]);
+
+	bench_path = argv[1];
+	preload_paths[PRELOAD_LIB] = argv[2];
+	preload_paths[PRELOAD_HOOK] = argv[3];
+	preload_paths[PRELOAD_LOGGER] = argv[4];
+	if (argc > 5)
+		json_path = argv[5];
+	if (argc > 6)
+		iterations = argv[6];
+
+	for (size_t v = 0; v < VARIANT_COUNT; ++v) {
+		for (size_t t = 0; t < THREAD_COUNTS; ++t) {
+			results[v][t].valid = run_benchmark(variants + v,
+			    thread_counts[t], &results[v][t]);
+		}
+	}
+
+	print_table("calls/sec", false);
+	putchar('\n');
+	print_table("p99 TSC cycles", true);
+
+	FILE *f = fopen(json_path, "w");
+	if (f == nullptr)
+		err(EXIT_FAILURE, "%s", json_path);
+	write_json(f);
+	fclose(f);
+
+	printf("results written to %s\n", json_path);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * gen_synthetic_lib.c - generates the assembly source of a shared object,
+ * for measuring the startup cost of syscall_intercept on code of a given
+ * size, in the style of the test/pattern_*.in.S sources.
+ *
+ * Usage: gen_synthetic_lib output.S functions sites nop_percent
+ *		symbol_percent
+ *
+ * functions: the number of functions generated
+ * sites: the number of syscall instructions, spread evenly among the
+ *	functions
+ * nop_percent: the percentage of functions followed by a long nop, that can
+ *	be used as a trampoline by a syscall nearby
+ * symbol_percent: the percentage of functions with an entry in the symbol
+ *	table, the others only have a local label
+ *
+ * The syscalls are never executed, as the library is only patched, but the
+ * code looks like a syscall wrapper in libc: each syscall is surrounded by
+ * instructions that can be relocated, and the conditional jump before it
+ * lands on the ret instruction after it.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static unsigned long random_state = 1;
+
+/* a deterministic pseudo random number in [0, 100) */
+static unsigned
+percent_random(void)
+{
+	random_state = random_state * 6364136223846793005UL +
+	    1442695040888963407UL;
+
+	return (unsigned)((random_state >> 33) % 100);
+}
+
+static void
+print_site(FILE *f, unsigned long function, unsigned long site)
+{
+	fprintf(f,
+	    "\t\ttest    rdi, rdi\n"
+	    "\t\tjz      .Lskip_%lu_%lu\n"
+	    "\t\tmov     eax, %lu\n"
+	    "\t\tmov     rdi, rsi\n"
+	    "\t\tsyscall\n"
+	    "\t\tmov     rcx, rax\n"
+	    "\t\tadd     rcx, 1\n"
+	    ".Lskip_%lu_%lu:\n",
+	    function, site, (function + site) % 300,
+	    function, site);
+}
+
+static void
+print_filler(FILE *f)
+{
+	fputs("\t\tlea     rax, [rdi + rsi * 2]\n"
+	    "\t\timul    rax, rdx\n"
+	    "\t\txor     rax, rcx\n", f);
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc < 6)
+		errx(EXIT_FAILURE, "usage: %s output.S functions sites "
+		    "nop_percent symbol_percent", argv[0]);
+
+	unsigned long functions = strtoul(argv[2], nullptr, 0);
+	unsigned long sites = strtoul(argv[3], nullptr, 0);
+	unsigned nop_percent = (unsigned)strtoul(argv[4], nullptr, 0);
+	unsigned symbol_percent = (unsigned)strtoul(argv[5], nullptr, 0);
+
+	if (functions == 0)
+		errx(EXIT_FAILURE, "at least one function is needed");
+
+	FILE *f = fopen(argv[1], "w");
+	if (f == nullptr)
+		err(EXIT_FAILURE, "%s", argv[1]);
+
+	fprintf(f, "# generated by gen_synthetic_lib %s %s %s %s\n\n",
+	    argv[2], argv[3], argv[4], argv[5]);
+	fputs(".intel_syntax noprefix\n\n"
+	    ".global synthetic_text_start;\n"
+	    ".global synthetic_text_end;\n\n"
+	    ".text\n\n"
+	    "synthetic_text_start:\n", f);
+
+	for (unsigned long i = 0; i < functions; ++i) {
+		unsigned long first_site = i * sites / functions;
+		unsigned long last_site = (i + 1) * sites / functions;
+
+		if (percent_random() < symbol_percent) {
+			fprintf(f, ".global synthetic_func_%lu;\n", i);
+			fprintf(f, ".type synthetic_func_%lu, @function;\n", i);
+			fprintf(f, "synthetic_func_%lu:\n", i);
+		} else {
+			fprintf(f, ".Lsynthetic_func_%lu:\n", i);
+		}
+
+		print_filler(f);
+		for (unsigned long s = first_site; s < last_site; ++s)
+			print_site(f, i, s);
+		print_filler(f);
+		fputs("\t\tret\n", f);
+
+		if (percent_random() < nop_percent)
+			fputs("\t\t.byte   0x0f, 0x1f, 0x84, 0x00, "
+			    "0x00, 0x00, 0x00, 0x00\n", f);
+		else
+			fputs("\t\t.byte   0xcc\n", f);
+
+		fputc('\n', f);
+	}
+
+	fputs("synthetic_text_end:\n\n"
+	    ".section .note.GNU-stack,\"\",%progbits\n", f);
+
+	if (fclose(f) != 0)
+		err(EXIT_FAILURE, "%s", argv[1]);
+
+	return EXIT_SUCCESS;
+}
@@ -33,6 +33,8 @@
 #ifndef LIBSYSCALL_INTERCEPT_HOOK_POINT_H
 #define LIBSYSCALL_INTERCEPT_HOOK_POINT_H
 
+#include <stddef.h>
+
 /*
  * The inteface for using the intercepting library.
  * This callback function should be implemented by
@@ -45,8 +47,36 @@
  * means libsyscall_intercept should not execute the syscall, and
  * use the integer stored to *result as the result of the syscall
  * to be returned in RAX to libc.
+ *
+ * The syscalls issued by the callback function itself, e.g. by calling
+ * libc functions such as snprintf, malloc, or fopen, are not intercepted,
+ * they are executed without calling the callback function again. The same
+ * holds for intercept_hook_point_clone_child and
+ * intercept_hook_point_clone_parent.
+ *
+ * Interception stays off in the thread until the callback function
+ * returns, thus:
+ *  - A signal handler of the program running while the callback function
+ *    runs, e.g. one interrupting a blocking syscall of the callback, is
+ *    not intercepted either.
+ *  - Leaving the callback function without returning, by longjmp (or
+ *    siglongjmp from such a signal handler), or by the cancellation of the
+ *    thread, leaves interception off in the thread for good, including
+ *    the cancellation cleanup handlers and TLS destructors run while the
+ *    thread exits. The callback functions must return.
  */
 
+/*
+ * INTERCEPT_HOOK_NEVER_AGAIN - a non-zero return value of the hook, thus
+ * the syscall is executed, which also tells that the hook is not interested
+ * in any syscall issued from the same syscall instruction. After a number
+ * of such verdicts (see INTERCEPT_NEVER_AGAIN_AFTER), the hook is no longer
+ * called for syscalls from that instruction, and its original instructions
+ * are restored. Note that some syscall instructions issue more than one
+ * kind of syscall, e.g. the one in the syscall function of libc.
+ */
+#define INTERCEPT_HOOK_NEVER_AGAIN 0x4e455652
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -65,8 +95,8 @@ extern void (*intercept_hook_point_clone_parent)(long pid);
  *
  * Call syscall_no_intercept to make syscalls
  * from the interceptor library, once glibc is already patched.
- * Don't use the syscall function from glibc, that
- * would just result in an infinite recursion.
+ * Outside of the hook functions, the syscalls issued using glibc
+ * are intercepted.
  */
 long syscall_no_intercept(long syscall_number, ...);
 
@@ -95,6 +125,106 @@ syscall_error_code(long result)
  */
 int syscall_hook_in_process_allowed(void);
 
+/*
+ * syscall_intercept_site_symbol - while called from intercept_hook_point,
+ * returns the name of the function containing the syscall instruction that
+ * issued the syscall being hooked, followed by the offset of the
+ * instruction in said function, e.g.: "__libc_pread64+0x1f".
+ * Returns a null pointer when called outside of the hook, or when the
+ * function is unknown, i.e. not found in the symbol tables.
+ */
+const char *syscall_intercept_site_symbol(void);
+
+/*
+ * syscall_intercept_stats - describes the memory used by patching: for each
+ * patched object the number of text pages written (these pages are no
+ * longer shared with other processes), the usage of the trampoline table,
+ * and the size of the tables allocated while disassembling; and the space
+ * used for the generated wrapper code. The report is formatted into buf,
+ * as lines of names and values, see libsyscall_intercept(3).
+ * Like snprintf, returns the length of the whole report, which is
+ * truncated if it does not fit in size bytes.
+ */
+size_t syscall_intercept_stats(char *buf, size_t size);
+
+/*
+ * syscall_intercept_thread_set - turn interception off (enabled == 0), or
+ * back on in the calling thread. While it is off, the syscalls of the
+ * thread are executed right in the asm wrappers, without calling the hook,
+ * and without logging them. With inherit != 0, threads created by the
+ * calling thread start with the same settings, otherwise interception is
+ * on in new threads. Child processes forked by the thread keep its settings
+ * in any case. Returns the previous value of enabled, i.e. zero if
+ * interception was off in the thread.
+ */
+int syscall_intercept_thread_set(int enabled, int inherit);
+
+/*
+ * syscall_intercept_disable - restore the original instructions at each
+ * patched syscall, so syscalls are not intercepted, and cost nothing
+ * extra, until syscall_intercept_enable is called. Objects patched ahead
+ * of time, and objects mapped from INTERCEPT_SHARED_TEXT stay patched.
+ * Can be called while other threads are running.
+ * Returns zero on success, or an error number: EBUSY if another thread is
+ * disabling or enabling the patches at the same time, ENOSYS if the
+ * kernel does not support the membarrier syscalls needed.
+ */
+int syscall_intercept_disable(void);
+
+/*
+ * syscall_intercept_enable - patch the syscalls again, after a call to
+ * syscall_intercept_disable. Returns zero on success, or an error number,
+ * as syscall_intercept_disable does. EAGAIN is returned if some patches
+ * could not be completed, as not all threads could be interrupted in
+ * time; the original instructions are restored at those, and the syscalls
+ * there are not intercepted until syscall_intercept_enable is called again.
+ */
+int syscall_intercept_enable(void);
+
+/*
+ * struct syscall_intercept_event - a syscall recorded in observer mode.
+ * The start and end times are CLOCK_MONOTONIC nanoseconds, taken before
+ * calling the hook, and after the syscall returned. The site is the address
+ * of the syscall instruction, symbol is as returned by
+ * syscall_intercept_site_symbol.
+ */
+struct syscall_intercept_event {
+	long syscall_number;
+	long args[6];
+	long result;
+	const void *site;
+	const char *symbol;
+	unsigned long long start_ns;
+	unsigned long long end_ns;
+	int tid;
+};
+
+/*
+ * syscall_intercept_observe - turn observer mode on (enabled != 0) or off.
+ * In observer mode, each syscall intercepted is recorded as an event, in
+ * a ring buffer of the thread issuing it, holding 1024 events. The events
+ * are delivered by syscall_intercept_drain_events. Returns the previous
+ * setting.
+ */
+int syscall_intercept_observe(int enabled);
+
+/*
+ * syscall_intercept_drain_events - calls observer for each event recorded
+ * since the last call, in the order of the events of each thread, but not
+ * ordered across threads. Meant to be called periodically by a thread of
+ * the program dedicated to this. Returns the number of events delivered,
+ * zero if another thread is draining the events at the same time.
+ */
+size_t syscall_intercept_drain_events(
+	void (*observer)(const struct syscall_intercept_event *, void *arg),
+	void *arg);
+
+/*
+ * syscall_intercept_events_dropped - the number of events not recorded, as
+ * the ring of the thread was full.
+ */
+unsigned long syscall_intercept_events_dropped(void);
+
 #ifdef __cplusplus
 }
 #endif
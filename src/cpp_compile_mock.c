@@ -59,3 +59,60 @@ syscall_hook_in_process_allowed(void)
 {
 	return 0;
 }
+
+const char *
+syscall_intercept_site_symbol(void)
+{
+	return nullptr;
+}
+
+size_t
+syscall_intercept_stats(char *buf, size_t size)
+{
+	(void) buf;
+	(void) size;
+	return 0;
+}
+
+int
+syscall_intercept_disable(void)
+{
+	return 0;
+}
+
+int
+syscall_intercept_enable(void)
+{
+	return 0;
+}
+
+int
+syscall_intercept_thread_set(int enabled, int inherit)
+{
+	(void) enabled;
+	(void) inherit;
+	return 1;
+}
+
+int
+syscall_intercept_observe(int enabled)
+{
+	(void) enabled;
+	return 0;
+}
+
+size_t
+syscall_intercept_drain_events(
+	void (*observer)(const struct syscall_intercept_event *, void *arg),
+	void *arg)
+{
+	(void) observer;
+	(void) arg;
+	return 0;
+}
+
+unsigned long
+syscall_intercept_events_dropped(void)
+{
+	return 0;
+}
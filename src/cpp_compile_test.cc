@@ -39,4 +39,11 @@ int main()
 	intercept_hook_point = nullptr;
 	(void) syscall_no_intercept(0);
 	(void) syscall_hook_in_process_allowed();
+	(void) syscall_intercept_site_symbol();
+	(void) syscall_intercept_disable();
+	(void) syscall_intercept_enable();
+	(void) syscall_intercept_thread_set(1, 0);
+	(void) syscall_intercept_observe(0);
+	(void) syscall_intercept_drain_events(nullptr, nullptr);
+	(void) syscall_intercept_events_dropped();
 }
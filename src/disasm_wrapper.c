@@ -249,22 +249,24 @@ intercept_disasm_next_instruction(struct intercept_disasm_context *context,
 		case X86_INS_JA:
 		case X86_INS_JBE:
 		case X86_INS_JB:
-		case X86_INS_JCXZ:
-		case X86_INS_JECXZ:
 		case X86_INS_JE:
 		case X86_INS_JGE:
 		case X86_INS_JG:
 		case X86_INS_JLE:
 		case X86_INS_JL:
-		case X86_INS_JMP:
 		case X86_INS_JNE:
 		case X86_INS_JNO:
 		case X86_INS_JNP:
 		case X86_INS_JNS:
 		case X86_INS_JO:
 		case X86_INS_JP:
-		case X86_INS_JRCXZ:
 		case X86_INS_JS:
+			result.is_cond_jump = true;
+			[[fallthrough]];
+		case X86_INS_JCXZ:
+		case X86_INS_JECXZ:
+		case X86_INS_JMP:
+		case X86_INS_JRCXZ:
 		case X86_INS_LOOP:
 		case X86_INS_CALL:
 			result.is_jump = true;
@@ -90,6 +90,12 @@ struct intercept_disasm_result {
 	 */
 	bool is_rel_jump;
 
+	/*
+	 * Conditional jumps, that have a form with a 32 bit displacement,
+	 * i.e. all of them except loop, jcxz, jecxz, and jrcxz.
+	 */
+	bool is_cond_jump;
+
 	bool is_indirect_jump;
 
 	bool is_ret;
@@ -55,7 +55,19 @@
 #include <linux/sched.h>
 
 #include "intercept.h"
+#include "intercept_aot.h"
+#include "intercept_capture.h"
+#include "intercept_control.h"
+#include "intercept_delegate.h"
 #include "intercept_log.h"
+#include "intercept_maps.h"
+#include "intercept_observe.h"
+#include "intercept_profile.h"
+#include "intercept_shared_text.h"
+#include "intercept_stats.h"
+#include "intercept_sud.h"
+#include "intercept_toggle.h"
+#include "intercept_trace.h"
 #include "intercept_util.h"
 #include "libsyscall_intercept_hook_point.h"
 #include "disasm_wrapper.h"
@@ -73,6 +85,109 @@ void (*intercept_hook_point_clone_child)(void)
 void (*intercept_hook_point_clone_parent)(long)
 	__attribute__((visibility("default")));
 
+/*
+ * The patch describing the syscall instruction that issued the syscall
+ * currently being handled by intercept_hook_point in this thread.
+ */
+static __thread const struct patch_desc *current_patch
+	__attribute__((tls_model("initial-exec")));
+
+/*
+ * syscall_intercept_site_symbol - part of the public API, see the
+ * libsyscall_intercept_hook_point.h header file.
+ */
+__attribute__((visibility("default"))) const char *
+syscall_intercept_site_symbol(void)
+{
+	if (current_patch == nullptr)
+		return nullptr;
+
+	return current_patch->symbol;
+}
+
+__thread char intercept_thread_off
+	__attribute__((tls_model("initial-exec")));
+
+/* threads created by this thread copy its intercept_thread_off */
+static __thread char thread_inherit
+	__attribute__((tls_model("initial-exec")));
+
+/*
+ * syscall_intercept_thread_set - part of the public API, see the
+ * libsyscall_intercept_hook_point.h header file.
+ */
+__attribute__((visibility("default"))) int
+syscall_intercept_thread_set(int enabled, int inherit)
+{
+	int was_enabled = (intercept_thread_off & THREAD_OFF_BY_USER) == 0;
+
+	if (enabled)
+		intercept_thread_off &= ~THREAD_OFF_BY_USER;
+	else
+		intercept_thread_off |= THREAD_OFF_BY_USER;
+
+	thread_inherit = (inherit != 0);
+
+	return was_enabled;
+}
+
+/*
+ * is_glibc_tcb - does a thread pointer point to a thread descriptor laid
+ * out as glibc does, starting with a tcbhead_t, the third field of which
+ * is a pointer to itself. Only then is the static TLS block of the library
+ * found at the same offset from it as in the calling thread.
+ */
+static bool
+is_glibc_tcb(uintptr_t tp)
+{
+	return *(const uintptr_t *)(tp + 2 * sizeof(uintptr_t)) == tp;
+}
+
+/*
+ * set_up_new_thread - copy the settings of the thread to a new thread
+ * about to be created by a clone syscall, if they are inherited. Its
+ * thread local storage is already allocated and initialized by then, at
+ * the new thread pointer passed to the syscall. Nothing is written if the
+ * new thread pointer is not a glibc thread descriptor, e.g. one set up by
+ * a program creating threads with its own clone calls.
+ */
+static void
+set_up_new_thread(const struct syscall_desc *desc)
+{
+	unsigned long flags;
+	uintptr_t tls;
+
+	if (!thread_inherit)
+		return;
+
+	if (desc->nr == SYS_clone) {
+		flags = (unsigned long)desc->args[0];
+		tls = (uintptr_t)desc->args[4];
+#ifdef SYS_clone3
+	} else if (desc->nr == SYS_clone3) {
+		const struct clone_args *args =
+		    (const struct clone_args *)desc->args[0];
+
+		flags = args->flags;
+		tls = args->tls;
+#endif
+	} else {
+		return;
+	}
+
+	if ((flags & CLONE_SETTLS) == 0 || tls == 0)
+		return;
+
+	uintptr_t self = thread_pointer();
+
+	if (!is_glibc_tcb(self) || !is_glibc_tcb(tls))
+		return;
+
+	*(char *)(tls + ((uintptr_t)&intercept_thread_off - self)) =
+	    intercept_thread_off & THREAD_OFF_BY_USER;
+	*(char *)(tls + ((uintptr_t)&thread_inherit - self)) = thread_inherit;
+}
+
 bool debug_dumps_on;
 
 void
@@ -100,8 +215,6 @@ debug_dump(const char *fmt, ...)
 	syscall_no_intercept(SYS_write, 2, buf, len);
 }
 
-static void log_header(void);
-
 [[noreturn]] void xlongjmp(long rip, long rsp, long rax);
 
 /*
@@ -206,7 +319,7 @@ str_match(const char *name, size_t name_len,
  * Tries to find the path of an object file loaded at a specific
  * address.
  *
- * The paths found are stored in BSS, in the paths variable. The
+ * The paths found are copied to BSS, into the paths variable. The
  * returned pointer points into this variable. The next_path
  * pointer keeps track of the already "allocated" space inside
  * the paths array.
@@ -216,44 +329,24 @@ get_name_from_proc_maps(uintptr_t addr)
 {
 	static char paths[0x10000];
 	static char *next_path = paths;
-	const char *path = nullptr;
 
-	char line[0x2000];
-	FILE *maps;
+	const struct maps_entry *entry = intercept_maps_lookup(addr);
 
-	if ((next_path >= paths + sizeof(paths) - sizeof(line)))
-		return nullptr; /* No more space left */
-
-	if ((maps = fopen("/proc/self/maps", "r")) == nullptr)
+	if (entry == nullptr || entry->path == nullptr)
 		return nullptr;
 
-	while ((fgets(line, sizeof(line), maps)) != nullptr) {
-		unsigned char *start;
-		unsigned char *end;
+	size_t size = strlen(entry->path) + 1;
 
-		/* Read the path into next_path */
-		if (sscanf(line, "%p-%p %*s %*x %*x:%*x %*u %s",
-		    (void **)&start, (void **)&end, next_path) != 3)
-			continue;
-
-		if (addr < (uintptr_t)start)
-			break;
-
-		if ((uintptr_t)start <= addr && addr < (uintptr_t)end) {
-			/*
-			 * Object found, setting the return value.
-			 * Adjusting the next_path pointer to point past the
-			 * string found just now, to the unused space behind it.
-			 * The next string found (if this routine is called
-			 * again) will be stored there.
-			 */
-			path = next_path;
-			next_path += strlen(next_path) + 1;
-			break;
-		}
-	}
+	if (size > (size_t)(paths + sizeof(paths) - next_path))
+		return nullptr; /* No more space left */
 
-	fclose(maps);
+	/*
+	 * Object found, copying the path to the unused space in paths.
+	 * The next string found (if this routine is called again) will be
+	 * stored behind it.
+	 */
+	const char *path = memcpy(next_path, entry->path, size);
+	next_path += size;
 
 	return path;
 }
@@ -314,6 +407,50 @@ get_object_path(const struct dl_phdr_info *info)
 	}
 }
 
+/*
+ * find_build_id - copy the NT_GNU_BUILD_ID note of the object, if it
+ * has one, into desc->build_id.
+ */
+static void
+find_build_id(const struct dl_phdr_info *info, struct intercept_desc *desc)
+{
+	desc->build_id_size = 0;
+
+	for (Elf64_Word i = 0; i < info->dlpi_phnum; ++i) {
+		const Elf64_Phdr *phdr = info->dlpi_phdr + i;
+
+		if (phdr->p_type != PT_NOTE)
+			continue;
+
+		size_t align = phdr->p_align == 8 ? 8 : 4;
+		const unsigned char *note =
+		    (const unsigned char *)(info->dlpi_addr + phdr->p_vaddr);
+		const unsigned char *end = note + phdr->p_memsz;
+
+		while (note + sizeof(Elf64_Nhdr) <= end) {
+			const Elf64_Nhdr *nhdr = (const Elf64_Nhdr *)note;
+			const unsigned char *name = note + sizeof(*nhdr);
+			const unsigned char *data = name +
+			    ((nhdr->n_namesz + align - 1) & ~(align - 1));
+
+			if (data + nhdr->n_descsz > end)
+				break;
+
+			if (nhdr->n_type == NT_GNU_BUILD_ID &&
+			    nhdr->n_namesz == 4 &&
+			    memcmp(name, "GNU", 4) == 0 &&
+			    nhdr->n_descsz <= sizeof(desc->build_id)) {
+				memcpy(desc->build_id, data, nhdr->n_descsz);
+				desc->build_id_size = nhdr->n_descsz;
+				return;
+			}
+
+			note = data +
+			    ((nhdr->n_descsz + align - 1) & ~(align - 1));
+		}
+	}
+}
+
 static bool
 is_vdso(uintptr_t addr, const char *path)
 {
@@ -420,14 +557,25 @@ analyze_object(struct dl_phdr_info *info, size_t size, void *data)
 
 	debug_dump("analyze %s\n", path);
 
-	if (!should_patch_object(info->dlpi_addr, path))
+	/*
+	 * Objects patched ahead of time jump to the trampoline table in any
+	 * case, thus they are always handled.
+	 */
+	const struct aot_header *prepatched = intercept_aot_find(info);
+
+	if (!should_patch_object(info->dlpi_addr, path) &&
+	    prepatched == nullptr)
 		return 0;
 
 	struct intercept_desc *patches = allocate_next_obj_desc();
 
 	patches->base_addr = (unsigned char *)info->dlpi_addr;
 	patches->path = path;
-	find_syscalls(patches);
+	find_build_id(info, patches);
+	if (prepatched != nullptr)
+		intercept_aot_load(prepatched, patches);
+	else
+		find_syscalls(patches);
 
 	return 0;
 }
@@ -444,6 +592,33 @@ is_asm_wrapper_space_full(void)
 			asm_wrapper_space + sizeof(asm_wrapper_space);
 }
 
+/*
+ * syscall_intercept_stats - part of the public API, see the
+ * libsyscall_intercept_hook_point.h header file.
+ */
+__attribute__((visibility("default"))) size_t
+syscall_intercept_stats(char *buf, size_t size)
+{
+	return intercept_format_stats(buf, size, objs, objs_count,
+	    (size_t)(next_asm_wrapper_space - asm_wrapper_space - PAGE_SIZE),
+	    sizeof(asm_wrapper_space) - PAGE_SIZE);
+}
+
+/*
+ * intercept_log_stats - write the memory usage report to the log, once the
+ * patches are activated, or when asked to by the "stats" command.
+ */
+void
+intercept_log_stats(void)
+{
+	size_t len = syscall_intercept_stats(nullptr, 0);
+	char *buf = xmmap_anon(len + 1);
+
+	syscall_intercept_stats(buf, len + 1);
+	intercept_log(buf, len);
+	xmunmap(buf, len + 1);
+}
+
 /*
  * mprotect_asm_wrappers
  * The code generated into the data segment at the asm_wrapper_space
@@ -482,44 +657,54 @@ intercept(int argc, char **argv)
 		return;
 
 	vdso_addr = (void *)(uintptr_t)getauxval(AT_SYSINFO_EHDR);
+	setup_clock_no_intercept(vdso_addr);
 	debug_dumps_on = getenv("INTERCEPT_DEBUG_DUMP") != nullptr;
 	patch_all_objs = (getenv("INTERCEPT_ALL_OBJS") != nullptr);
 	intercept_setup_log(getenv("INTERCEPT_LOG"),
 			getenv("INTERCEPT_LOG_TRUNC"));
-	log_header();
+	intercept_setup_log_rotation(getenv("INTERCEPT_LOG_MAX_BYTES"),
+			getenv("INTERCEPT_LOG_KEEP"));
+	intercept_setup_profile(getenv("INTERCEPT_PROFILE"),
+			getenv("INTERCEPT_PROFILE_EVERY"),
+			getenv("INTERCEPT_PROFILE_PERIOD_US"),
+			getenv("INTERCEPT_PROFILE_WEIGHT"));
+	intercept_setup_trace(getenv("INTERCEPT_TRACE"));
+	intercept_setup_capture(getenv("INTERCEPT_CAPTURE"),
+			getenv("INTERCEPT_CAPTURE_MAX"),
+			getenv("INTERCEPT_CAPTURE_FDS"));
+	intercept_setup_shared_text(getenv("INTERCEPT_SHARED_TEXT"));
+	intercept_setup_never_again(getenv("INTERCEPT_NEVER_AGAIN_AFTER"));
+	intercept_setup_delegate(getenv("INTERCEPT_DELEGATE"),
+			getenv("INTERCEPT_DELEGATE_CPU"));
 	init_patcher();
 
 	dl_iterate_phdr(analyze_object, nullptr);
 	if (!libc_found)
 		xabort("libc not found");
 
+	allocate_trampoline_tables(objs, objs_count);
+	intercept_maps_invalidate();
 	for (unsigned i = 0; i < objs_count; ++i) {
 		if (objs[i].count > 0 && is_asm_wrapper_space_full())
 			xabort("not enough space in asm_wrapper_space");
-		allocate_trampoline_table(objs + i);
 		create_patch_wrappers(objs + i, &next_asm_wrapper_space);
 	}
 	mprotect_asm_wrappers();
-	for (unsigned i = 0; i < objs_count; ++i)
-		activate_patches(objs + i);
-}
-
-/*
- * log_header - part of logging
- * This routine outputs some potentially useful information into the log
- * file, which can be very useful during development.
- */
-static void
-log_header(void)
-{
-	static const char self_decoder[] =
-		"tempfile=$(mktemp) ; tempfile2=$(mktemp) ; "
-		"grep \"^/\" $0 | cut -d \" \" -f 1,2 | "
-		"sed \"s/^/addr2line -p -f -e /\" > $tempfile ; "
-		"{ echo ; . $tempfile ; echo ; } > $tempfile2 ; "
-		"paste $tempfile2 $0 ; exit 0\n";
+	for (unsigned i = 0; i < objs_count; ++i) {
+		if (objs[i].is_prepatched) {
+			intercept_aot_activate(objs + i);
+		} else {
+			intercept_toggle_save(objs + i);
+			intercept_activate_shared(objs + i);
+		}
+	}
+	intercept_setup_toggle(objs, objs_count);
+	intercept_setup_sud(objs, objs_count,
+	    asm_wrapper_space, sizeof(asm_wrapper_space),
+	    getenv("INTERCEPT_TRAP_ALL"));
 
-	intercept_log(self_decoder, sizeof(self_decoder) - 1);
+	intercept_log_stats();
+	intercept_setup_control(getenv("INTERCEPT_CONTROL"));
 }
 
 /*
@@ -602,6 +787,138 @@ get_syscall_in_context(struct context *context, struct syscall_desc *sys)
 	sys->args[5] = context->r9;
 }
 
+/*
+ * is_fork_syscall - does the syscall create a new process, as opposed to
+ * a new thread, or nothing? The returns_here flag is cleared if the child
+ * starts on a new stack, thus it does not return to intercept_routine.
+ */
+bool
+is_fork_syscall(const struct syscall_desc *desc, bool *returns_here)
+{
+	*returns_here = true;
+
+	switch (desc->nr) {
+#ifdef SYS_fork
+		case SYS_fork:
+			return true;
+#endif
+		case SYS_clone:
+			*returns_here = (desc->args[1] == 0);
+			return (desc->args[0] & CLONE_VM) == 0;
+#ifdef SYS_clone3
+		case SYS_clone3: {
+			const struct clone_args *args =
+			    (const struct clone_args *)desc->args[0];
+			*returns_here = (args->stack == 0);
+			return (args->flags & CLONE_VM) == 0;
+		}
+#endif
+		default:
+			return false;
+	}
+}
+
+/*
+ * prepare_exit - called right before an exit_group syscall is forwarded to
+ * the kernel, to write out anything buffered so far.
+ */
+static void
+prepare_exit(void)
+{
+	intercept_log_flush();
+
+	if (intercept_profile_on)
+		intercept_profile_dump();
+
+	if (intercept_trace_on)
+		intercept_trace_close();
+}
+
+/*
+ * timed_syscall - execute a syscall, and account the time spent in it
+ * to a profiler sample.
+ */
+static long
+timed_syscall(const struct syscall_desc *desc, struct profile_entry *sample)
+{
+	unsigned long long start = clock_ns_no_intercept();
+
+	long result = syscall_no_intercept(desc->nr,
+				desc->args[0],
+				desc->args[1],
+				desc->args[2],
+				desc->args[3],
+				desc->args[4],
+				desc->args[5]);
+
+	intercept_profile_add_time(sample, clock_ns_no_intercept() - start);
+
+	return result;
+}
+
+/*
+ * is_clone_syscall - the syscalls passed to intercept_routine by the asm
+ * wrappers in threads with interception turned off, see
+ * intercept_template.S
+ */
+static bool
+is_clone_syscall(long nr)
+{
+#ifdef SYS_clone3
+	if (nr == SYS_clone3)
+		return true;
+#endif
+
+	return nr == SYS_clone;
+}
+
+/*
+ * thread_off_routine - handle a syscall in a thread with interception
+ * turned off, or issued by a hook. Only clone syscalls get here from the
+ * asm wrappers in such a thread, besides syscalls trapped using syscall
+ * user dispatch. Nothing is logged, and the hook is not called, the
+ * syscall is executed as it is.
+ */
+static struct wrapper_ret
+thread_off_routine(struct context *context, const struct syscall_desc *desc)
+{
+	bool returns_here;
+
+	bool is_fork = is_fork_syscall(desc, &returns_here);
+
+	if (!is_clone_syscall(desc->nr)) {
+		/* execute the syscall in the asm wrapper */
+		return (struct wrapper_ret){.rax = context->rax, .rdx = 0 };
+	}
+
+	set_up_new_thread(desc);
+
+	/* a new stack, see the same case in intercept_routine */
+	if (!returns_here)
+		return (struct wrapper_ret){.rax = context->rax, .rdx = 2 };
+
+	long result = syscall_no_intercept(desc->nr,
+				desc->args[0],
+				desc->args[1],
+				desc->args[2],
+				desc->args[3],
+				desc->args[4],
+				desc->args[5]);
+
+	if (result == 0 && is_fork) {
+		if (intercept_sud_on)
+			intercept_sud_enable_thread();
+		intercept_log_after_fork();
+		if (intercept_capture_on)
+			intercept_capture_after_fork();
+		intercept_control_after_fork();
+		intercept_observe_after_fork();
+		intercept_delegate_after_fork();
+	}
+
+	return (struct wrapper_ret){.rax = result, .rdx = 1 };
+}
+
 /*
  * intercept_routine(...)
  * This is the function called from the asm wrappers,
@@ -640,15 +957,42 @@ intercept_routine(struct context *context)
 	int forward_to_kernel = true;
 	struct syscall_desc desc;
 	struct patch_desc *patch = context->patch_desc;
+	struct profile_entry *sample = nullptr;
+	unsigned long long trace_start = 0;
+	unsigned long long observe_start = 0;
+
+	if (intercept_sud_on)
+		intercept_sud_rearm();
 
 	get_syscall_in_context(context, &desc);
 
-	if (handle_magic_syscalls(&desc, &result) == 0)
-		return (struct wrapper_ret){.rax = result, .rdx = 1 };
+	if (intercept_thread_off)
+		return thread_off_routine(context, &desc);
+
+	if (intercept_control_requested(&desc)) {
+		intercept_control_apply();
+		if (handle_magic_syscalls(&desc, &result) == 0)
+			return (struct wrapper_ret){.rax = result, .rdx = 1 };
+	}
 
 	intercept_log_syscall(patch, &desc, UNKNOWN, 0);
 
-	if (intercept_hook_point != nullptr)
+	if (intercept_profile_on && intercept_profile_should_sample())
+		sample = intercept_profile_sample(patch,
+				context->rbp, context->rsp);
+
+	if (intercept_observe_on)
+		observe_start = clock_ns_no_intercept();
+
+	if (intercept_hook_point != nullptr &&
+	    !__atomic_load_n(&patch->is_retired, __ATOMIC_RELAXED) &&
+	    !__atomic_load_n(&intercept_control_hook_off, __ATOMIC_RELAXED)) {
+		/*
+		 * The syscalls issued by the hook are executed right in
+		 * the asm wrappers, without calling the hook again.
+		 */
+		intercept_thread_off |= THREAD_OFF_IN_HOOK;
+		current_patch = patch;
 		forward_to_kernel = intercept_hook_point(desc.nr,
 		    desc.args[0],
 		    desc.args[1],
@@ -657,12 +1001,33 @@ intercept_routine(struct context *context)
 		    desc.args[4],
 		    desc.args[5],
 		    &result);
+		current_patch = nullptr;
+		intercept_thread_off &= ~THREAD_OFF_IN_HOOK;
+
+		if (forward_to_kernel == INTERCEPT_HOOK_NEVER_AGAIN)
+			intercept_never_again(patch);
+	}
 
 	if (desc.nr == SYS_vfork || desc.nr == SYS_rt_sigreturn) {
 		/* can't handle these syscalls the normal way */
 		return (struct wrapper_ret){.rax = context->rax, .rdx = 0 };
 	}
 
+	if (intercept_trace_on)
+		trace_start = intercept_trace_begin(&desc);
+
+	if (desc.nr == SYS_exit_group) {
+		if (intercept_trace_on)
+			intercept_trace_end(patch, &desc, trace_start,
+			    UNKNOWN, 0);
+		prepare_exit();
+	}
+
+	if (desc.nr == SYS_exit) {
+		intercept_log_thread_exit();
+		intercept_observe_thread_exit();
+	}
+
 	if (forward_to_kernel) {
 		/*
 		 * The clone syscall's arg1 is a pointer to a memory region
@@ -676,6 +1041,8 @@ intercept_routine(struct context *context)
 		 * the clone_child_intercept_routine instead, executing
 		 * it on the new child threads stack, then returns to libc.
 		 */
+		set_up_new_thread(&desc);
+
 		if (desc.nr == SYS_clone && desc.args[1] != 0) {
 			return (struct wrapper_ret){
 				.rax = context->rax, .rdx = 2 };
@@ -687,6 +1054,16 @@ intercept_routine(struct context *context)
 				.rax = context->rax, .rdx = 2 };
 		}
 #endif
+		else if (intercept_toggle_is_sigaction(&desc))
+			result = intercept_toggle_rt_sigaction(&desc);
+		else if (intercept_sud_on &&
+		    intercept_sud_is_filtered(desc.nr))
+			result = intercept_sud_syscall(&desc);
+		else if (sample != nullptr)
+			result = timed_syscall(&desc, sample);
+		else if (intercept_delegate_on &&
+		    intercept_is_delegated(desc.nr))
+			result = intercept_delegate_syscall(&desc);
 		else
 			result = syscall_no_intercept(desc.nr,
 					desc.args[0],
@@ -697,11 +1074,67 @@ intercept_routine(struct context *context)
 					desc.args[5]);
 	}
 
+	bool fork_returns_here;
+	if (result == 0 && is_fork_syscall(&desc, &fork_returns_here)) {
+		if (intercept_sud_on)
+			intercept_sud_enable_thread();
+		intercept_log_after_fork();
+		if (intercept_capture_on)
+			intercept_capture_after_fork();
+		intercept_control_after_fork();
+		intercept_observe_after_fork();
+		intercept_delegate_after_fork();
+	}
+
+	if (intercept_capture_on)
+		intercept_capture_syscall(&desc, result);
+
+	if (intercept_delegate_on)
+		intercept_delegate_note(&desc, result);
+
 	intercept_log_syscall(patch, &desc, KNOWN, result);
 
+	if (intercept_trace_on)
+		intercept_trace_end(patch, &desc, trace_start, KNOWN, result);
+
+	if (observe_start != 0)
+		intercept_observe_event(patch, &desc, observe_start, result);
+
 	return (struct wrapper_ret){ .rax = result, .rdx = 1 };
 }
 
+/*
+ * intercept_trapped_syscall - handle a syscall trapped at a syscall
+ * instruction left unpatched, see intercept_sud.c. The registers not
+ * listed as arguments are not needed by intercept_routine. Returns false
+ * if the syscall must be executed by the kernel as it is, instead of
+ * returning the result.
+ */
+bool
+intercept_trapped_syscall(struct patch_desc *patch,
+			const struct syscall_desc *desc, long rsp, long rbp,
+			long *result)
+{
+	struct context context = {
+		.patch_desc = patch,
+		.rsp = rsp,
+		.rbp = rbp,
+		.rax = desc->nr,
+		.rdi = desc->args[0],
+		.rsi = desc->args[1],
+		.rdx = desc->args[2],
+		.r10 = desc->args[3],
+		.r8 = desc->args[4],
+		.r9 = desc->args[5]
+	};
+
+	struct wrapper_ret ret = intercept_routine(&context);
+
+	*result = ret.rax;
+
+	return ret.rdx == 1;
+}
+
 /*
  * intercept_routine_post_clone
  * The routine called by an assembly wrapper when a clone syscall returns zero,
@@ -711,11 +1144,21 @@ struct wrapper_ret
 intercept_routine_post_clone(struct context *context)
 {
 	if (context->rax == 0) {
-		if (intercept_hook_point_clone_child != nullptr)
+		if (intercept_sud_on)
+			intercept_sud_enable_thread();
+		if (intercept_hook_point_clone_child != nullptr &&
+		    !intercept_thread_off) {
+			intercept_thread_off = THREAD_OFF_IN_HOOK;
 			intercept_hook_point_clone_child();
+			intercept_thread_off = 0;
+		}
 	} else {
-		if (intercept_hook_point_clone_parent != nullptr)
+		if (intercept_hook_point_clone_parent != nullptr &&
+		    !intercept_thread_off) {
+			intercept_thread_off = THREAD_OFF_IN_HOOK;
 			intercept_hook_point_clone_parent(context->rax);
+			intercept_thread_off = 0;
+		}
 	}
 
 	return (struct wrapper_ret){.rax = context->rax, .rdx = 1 };
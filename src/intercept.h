@@ -61,6 +61,8 @@ struct syscall_desc {
 	long args[6];
 };
 
+bool is_fork_syscall(const struct syscall_desc *, bool *returns_here);
+
 struct range {
 	unsigned char *address;
 	size_t size;
@@ -86,9 +88,36 @@ struct patch_desc {
 	/* the offset of the original syscall instruction */
 	unsigned long syscall_offset;
 
+	/*
+	 * The function containing the syscall instruction, and the offset of
+	 * the instruction in it, e.g.: "__libc_pread64+0x1f". This is nullptr
+	 * if no function symbol covers the syscall instruction.
+	 */
+	const char *symbol;
+
+	/*
+	 * The best candidate for the symbol field found so far, while
+	 * looking through symbol tables. The name is read later from the
+	 * file offset in symbol_name_offset, only for the chosen symbol.
+	 */
+	unsigned char *symbol_address;
+	Elf64_Xword symbol_size;
+	unsigned char symbol_bind;
+	Elf64_Off symbol_name_offset;
+
 	/* the new asm wrapper created */
 	unsigned char *asm_wrapper;
 
+	/*
+	 * Where the copies of preceding_ins, of the syscall, and of
+	 * following_ins start in the asm wrapper. A thread found at one of
+	 * the instructions overwritten can continue from here, see
+	 * intercept_toggle.c
+	 */
+	unsigned char *wrapper_prev_ins;
+	unsigned char *wrapper_syscall;
+	unsigned char *wrapper_next_ins;
+
 	/* the first byte overwritten in the code */
 	unsigned char *dst_jmp_patch;
 
@@ -112,6 +141,24 @@ struct patch_desc {
 	bool uses_nop_trampoline;
 
 	struct range nop_trampoline;
+
+	/*
+	 * There is not enough space around the syscall for a jump, it is
+	 * intercepted using syscall user dispatch, see intercept_sud.c.
+	 * The number of times it was trapped is counted in trapped_count.
+	 */
+	bool is_unpatched;
+	unsigned long trapped_count;
+
+	/*
+	 * The number of INTERCEPT_HOOK_NEVER_AGAIN verdicts of the hook, once
+	 * there are enough of them the syscall is retired: it is not passed
+	 * to the hook anymore, and the original instructions are restored
+	 * (is_restored) when possible, see intercept_never_again.
+	 */
+	unsigned long never_again_count;
+	bool is_retired;
+	bool is_restored;
 };
 
 /*
@@ -147,6 +194,23 @@ struct intercept_desc {
 	/* where the object is in fs */
 	const char *path;
 
+	/*
+	 * The object was patched ahead of time by syscall_intercept_aot,
+	 * the patches are read from the object instead of disassembling it,
+	 * see intercept_aot.c
+	 */
+	bool is_prepatched;
+
+	/*
+	 * The text is mapped from a shared image of the patched text, it
+	 * can not be written anymore, see intercept_shared_text.c
+	 */
+	bool is_text_shared;
+
+	/* the NT_GNU_BUILD_ID note of the object, if it has one */
+	unsigned char build_id[32];
+	size_t build_id_size;
+
 	/*
 	 * Some sections of the library from which information
 	 * needs to be extracted.
@@ -162,6 +226,12 @@ struct intercept_desc {
 	struct section_list symbol_tables;
 	struct section_list rela_tables;
 
+	/*
+	 * The string tables linked to the symbol tables, with the same
+	 * index as the corresponding symbol table in symbol_tables.
+	 */
+	struct section_list symbol_string_tables;
+
 	/* Where the text starts inside the shared object */
 	unsigned long text_offset;
 
@@ -175,6 +245,10 @@ struct intercept_desc {
 
 	struct patch_desc *items;
 	unsigned count;
+
+	/* the syscalls left unpatched, set aside by create_patch_wrappers */
+	struct patch_desc *unpatched;
+	unsigned unpatched_count;
 	unsigned char *jump_table;
 
 	size_t nop_count;
@@ -185,25 +259,62 @@ struct intercept_desc {
 	size_t trampoline_table_size;
 
 	unsigned char *next_trampoline;
+
+	/*
+	 * The number of pages in the text written by activate_patches,
+	 * i.e. pages no longer shared with other processes.
+	 */
+	size_t dirty_text_pages;
+
+	/* mprotect calls made by activate_patches */
+	size_t mprotect_calls;
+
+	/*
+	 * The original and the patched bytes at each patch, for undoing
+	 * the patches at runtime, see intercept_toggle.c
+	 */
+	struct text_edit *edits;
+
+	/* the page map of the pages of the text the edits are in */
+	unsigned char *edit_page_map;
 };
 
 bool has_jump(const struct intercept_desc *desc, unsigned char *addr);
 void mark_jump(const struct intercept_desc *desc, const unsigned char *addr);
 
-void allocate_trampoline_table(struct intercept_desc *desc);
+void allocate_trampoline_tables(struct intercept_desc *descs, unsigned count);
 void find_syscalls(struct intercept_desc *desc);
 
 void init_patcher(void);
 void create_patch_wrappers(struct intercept_desc *desc, unsigned char **dst);
 void mprotect_asm_wrappers(void);
+void intercept_log_stats(void);
 
 /*
  * Actually overwrite instructions in glibc.
  */
 void activate_patches(struct intercept_desc *desc);
 
+void fill_trampoline_table(struct intercept_desc *desc);
+bool is_patched_text(const struct intercept_desc *desc,
+			const unsigned char *image, size_t size);
+
+/*
+ * Page maps of the text: one bit for each page, starting at the page
+ * containing text_start. The pages marked are made writable, instead of
+ * the whole text.
+ */
+size_t text_page_count(const struct intercept_desc *desc);
+void mark_written(unsigned char *page_map, const unsigned char *first_page,
+			const unsigned char *addr, size_t len);
+size_t mprotect_pages(const unsigned char *page_map, size_t page_count,
+			unsigned char *first_page, int prot, const char *msg);
+
 #define SYSCALL_INS_SIZE 2
 #define JUMP_INS_SIZE 5
+
+/* The size of a trampoline jump, jmp instruction + pointer */
+#define TRAMPOLINE_SIZE (6 + 8)
 #define CALL_OPCODE 0xe8
 #define JMP_OPCODE 0xe9
 #define SHORT_JMP_OPCODE 0xeb
@@ -213,10 +324,61 @@ void activate_patches(struct intercept_desc *desc);
 
 bool is_overwritable_nop(const struct intercept_disasm_result *ins);
 
+/*
+ * The layout of an instruction with a RIP relative memory operand, as
+ * needed for relocating it.
+ */
+struct rip_operand {
+	/* offset of the REX prefix, or of the opcode if there is no REX */
+	unsigned rex;
+	bool has_rex;
+
+	/* offset of the ModRM byte, followed by the 32 bit displacement */
+	unsigned modrm;
+};
+
+bool find_rip_operand(const struct intercept_disasm_result *ins,
+			struct rip_operand *op);
+int jcc_condition(const struct intercept_disasm_result *ins);
+
 void create_jump(unsigned char opcode, unsigned char *from, void *to);
 
+bool intercept_trapped_syscall(struct patch_desc *patch,
+			const struct syscall_desc *desc, long rsp, long rbp,
+			long *result);
+
 extern const char *cmdline;
 
+/*
+ * Interception is turned off in the thread while this is not zero. The asm
+ * wrappers read it relative to the thread pointer. Bits:
+ * THREAD_OFF_BY_USER -- see syscall_intercept_thread_set
+ * THREAD_OFF_IN_HOOK -- set while a hook is called, so the syscalls the
+ *  hook issues, e.g. using libc, are not passed to the hook again, neither
+ *  are those of signal handlers run meanwhile. It is cleared when the hook
+ *  returns, thus stays set if the hook is left by longjmp.
+ */
+extern __thread char intercept_thread_off
+	__attribute__((tls_model("initial-exec")));
+
+#define THREAD_OFF_BY_USER 1
+#define THREAD_OFF_IN_HOOK 2
+
+/*
+ * thread_pointer - the address thread local storage is relative to, stored
+ * at %fs:0 on x86_64. Initial-exec TLS variables are at the same offset
+ * from it in each thread.
+ */
+static inline uintptr_t
+thread_pointer(void)
+{
+	uintptr_t result;
+
+	__asm__("movq %%fs:0, %0" : "=r"(result));
+
+	return result;
+}
+
 #define PAGE_SIZE ((size_t)0x1000)
 
 static inline unsigned char *
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_aot.c - using objects patched ahead of time, see the
+ * intercept_aot.h header file, and tools/syscall_intercept_aot.c.
+ */
+
+#include "intercept_aot.h"
+#include "intercept.h"
+#include "intercept_util.h"
+
+#include <elf.h>
+#include <link.h>
+#include <string.h>
+#include <sys/mman.h>
+
+const struct aot_header *
+intercept_aot_find(const struct dl_phdr_info *info)
+{
+	const struct aot_header *found = nullptr;
+
+	for (Elf64_Half i = 0; i < info->dlpi_phnum; ++i) {
+		const Elf64_Phdr *phdr = info->dlpi_phdr + i;
+
+		if (phdr->p_type != PT_LOAD ||
+		    (phdr->p_flags & (PF_R | PF_X)) != (PF_R | PF_X) ||
+		    phdr->p_filesz < sizeof(struct aot_header))
+			continue;
+
+		const struct aot_header *header =
+		    (const void *)(info->dlpi_addr + phdr->p_vaddr);
+
+		if (memcmp(header->magic, AOT_MAGIC,
+		    sizeof(header->magic)) == 0)
+			found = header;
+	}
+
+	if (found != nullptr && found->version != AOT_VERSION)
+		xabort("unsupported version of prepatched object");
+
+	return found;
+}
+
+static void
+load_ins(struct intercept_disasm_result *ins, const struct aot_ins *src,
+		unsigned char *base_addr)
+{
+	memset(ins, 0, sizeof(*ins));
+
+	ins->address = src->bytes;
+	ins->length = src->length;
+	ins->is_set = src->length > 0;
+	ins->is_lea_rip = src->is_lea_rip;
+	ins->has_ip_relative_opr = src->has_ip_relative_opr;
+	ins->is_cond_jump = src->is_cond_jump;
+	ins->is_jump = src->is_cond_jump;
+	ins->is_rel_jump = src->is_cond_jump;
+	ins->arg_register_bits = src->arg_register_bits;
+	ins->rip_disp = src->rip_disp;
+	ins->rip_ref_addr = base_addr + src->rip_ref_vaddr;
+}
+
+void
+intercept_aot_load(const struct aot_header *header,
+			struct intercept_desc *desc)
+{
+	const unsigned char *segment = (const unsigned char *)header;
+	const struct aot_record *records =
+	    (const void *)(segment + header->records);
+	const char *strings = (const char *)(segment + header->strings);
+	unsigned char *base = desc->base_addr;
+
+	desc->is_prepatched = true;
+	desc->text_start = base + header->text_vaddr;
+	desc->text_end = desc->text_start + header->text_size - 1;
+	desc->uses_trampoline_table = true;
+	desc->trampoline_table = (unsigned char *)segment + header->trampolines;
+	desc->trampoline_table_size = header->trampolines_size;
+	desc->next_trampoline = desc->trampoline_table;
+	desc->count = header->count;
+
+	if (desc->count == 0)
+		return;
+
+	desc->items = xmmap_anon(desc->count * sizeof(desc->items[0]));
+
+	for (unsigned i = 0; i < desc->count; ++i) {
+		const struct aot_record *record = records + i;
+		struct patch_desc *patch = desc->items + i;
+
+		patch->containing_lib_path = desc->path;
+		patch->syscall_addr = base + record->syscall_vaddr;
+		patch->syscall_offset = record->syscall_offset;
+		patch->dst_jmp_patch = base + record->dst_jmp_vaddr;
+		patch->return_address = base + record->return_vaddr;
+		if (record->symbol != 0)
+			patch->symbol = strings + record->symbol;
+		patch->uses_prev_ins_2 = record->uses_prev_ins_2;
+		patch->uses_prev_ins = record->uses_prev_ins;
+		patch->uses_next_ins = record->uses_next_ins;
+		patch->uses_nop_trampoline = record->uses_nop_trampoline;
+		load_ins(&patch->preceding_ins_2, &record->preceding_ins_2,
+		    base);
+		load_ins(&patch->preceding_ins, &record->preceding_ins, base);
+		load_ins(&patch->following_ins, &record->following_ins, base);
+	}
+}
+
+void
+intercept_aot_activate(struct intercept_desc *desc)
+{
+	if (desc->count == 0)
+		return;
+
+	unsigned char *first_page = round_down_address(desc->trampoline_table);
+	size_t size = (size_t)(desc->trampoline_table +
+	    desc->trampoline_table_size - first_page);
+
+	mprotect_no_intercept(first_page, size, PROT_READ | PROT_WRITE,
+	    "mprotect trampoline table PROT_READ | PROT_WRITE");
+
+	fill_trampoline_table(desc);
+
+	mprotect_no_intercept(first_page, size, PROT_READ | PROT_EXEC,
+	    "mprotect trampoline table PROT_READ | PROT_EXEC");
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_aot.h - objects patched ahead of time by syscall_intercept_aot.
+ *
+ * The tool appends a new loadable segment (readable, and executable) to
+ * the object, starting with a struct aot_header. The segment contains:
+ *
+ * - the trampoline table, each entry initially a jump to a stub in the
+ *   same segment, which executes the instructions overwritten in the text
+ *   the same way they were executed originally, and jumps back to the text,
+ *   thus the object can also be used without syscall_intercept.
+ * - the stubs
+ * - a struct aot_record for each patch, describing what is needed to
+ *   create an asm wrapper at runtime
+ * - a string table, containing the names of functions containing the
+ *   syscalls
+ * - the program headers of the object, moved here to make room for the
+ *   new one
+ *
+ * The jumps in the text are already there, at runtime only the wrappers
+ * are generated, and the trampoline table entries are overwritten with
+ * jumps to them, the text is not written.
+ */
+
+#ifndef INTERCEPT_AOT_H
+#define INTERCEPT_AOT_H
+
+#include <stdint.h>
+
+#define AOT_MAGIC "SYSIAOT1"
+#define AOT_VERSION 2
+
+/*
+ * All offsets are relative to the header, all addresses are virtual
+ * addresses in the object, i.e. relative to its load address.
+ */
+struct aot_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t count;
+	uint64_t text_vaddr;
+	uint64_t text_size;
+	uint64_t trampolines;
+	uint64_t trampolines_size;
+	uint64_t records;
+	uint64_t strings;
+};
+
+/* an instruction overwritten in the text, relocated into the wrapper */
+struct aot_ins {
+	/* rip relative address referenced, or destination of a jump */
+	uint64_t rip_ref_vaddr;
+	int32_t rip_disp;
+	uint8_t length; /* zero if not used */
+	uint8_t is_lea_rip;
+	uint8_t arg_register_bits;
+	uint8_t has_ip_relative_opr;
+	uint8_t is_cond_jump;
+	uint8_t reserved[7];
+	uint8_t bytes[16];
+};
+
+struct aot_record {
+	uint64_t syscall_vaddr;
+	uint64_t syscall_offset; /* as printed in the log */
+	uint64_t dst_jmp_vaddr;
+	uint64_t return_vaddr;
+	uint32_t symbol; /* offset in the string table, zero if unknown */
+	uint8_t uses_prev_ins_2;
+	uint8_t uses_prev_ins;
+	uint8_t uses_next_ins;
+	uint8_t uses_nop_trampoline;
+	struct aot_ins preceding_ins_2;
+	struct aot_ins preceding_ins;
+	struct aot_ins following_ins;
+};
+
+struct dl_phdr_info;
+struct intercept_desc;
+
+/*
+ * intercept_aot_find - find the header in an object loaded into the
+ * process, returns nullptr if the object was not patched ahead of time.
+ */
+const struct aot_header *intercept_aot_find(const struct dl_phdr_info *);
+
+/*
+ * intercept_aot_load - fill desc with the patches described in a
+ * prepatched object, instead of calling find_syscalls.
+ */
+void intercept_aot_load(const struct aot_header *, struct intercept_desc *);
+
+/*
+ * intercept_aot_activate - point the trampoline table entries of a
+ * prepatched object to the wrappers, instead of calling activate_patches.
+ */
+void intercept_aot_activate(struct intercept_desc *);
+
+#endif
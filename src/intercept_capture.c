@@ -0,0 +1,466 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_capture.c - capturing the payload of I/O syscalls.
+ *
+ * The text log only shows the first few bytes of each buffer, escaped.
+ * In capture mode, the complete data (up to a size limit per syscall) is
+ * written to a separate file, in a framed binary format, described in
+ * intercept_capture.h.
+ *
+ * The record header and the buffers of the syscall are spliced into an
+ * internal pipe with vmsplice, and from there to the capture file with
+ * splice, so the data is not copied in user space, and the copying in
+ * the kernel is done straight into the page cache of the capture file.
+ * The pages spliced into the pipe are referenced, not copied, thus they
+ * must leave the pipe before the syscall returns to the program, which
+ * might reuse the buffer. This is guaranteed when the capture file is a
+ * regular file. Other kinds of files (e.g. a FIFO) are written using
+ * writev.
+ */
+
+#include "intercept_capture.h"
+#include "intercept.h"
+#include "intercept_util.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+/* The most iovecs of a syscall captured, the rest is ignored */
+#define CAPTURE_MAX_IOV 64
+
+/* The fds that can be selected, higher fds are captured if none is */
+#define CAPTURE_MAX_FD 1024
+
+bool intercept_capture_on;
+
+static char capture_path[PATH_MAX];
+static long capture_fd = -1;
+static bool capture_splice;
+static int capture_pipe[2] = { -1, -1 };
+
+static size_t capture_max = 0x10000;
+
+static bool capture_all_fds = true;
+static unsigned char capture_fds[CAPTURE_MAX_FD / 8];
+
+static long capture_pid;
+static int capture_lock;
+
+static __thread long capture_tid
+	__attribute__((tls_model("initial-exec")));
+static __thread bool in_capture
+	__attribute__((tls_model("initial-exec")));
+
+/*
+ * parse_fds - a list of fds, and ranges of fds, e.g.: "1,2,10-15"
+ */
+static void
+parse_fds(const char *fds)
+{
+	while (*fds != '\0') {
+		char *end;
+		unsigned long first = strtoul(fds, &end, 10);
+		unsigned long last = first;
+
+		if (end == fds)
+			xabort("invalid INTERCEPT_CAPTURE_FDS");
+
+		if (*end == '-')
+			last = strtoul(end + 1, &end, 10);
+
+		for (unsigned long fd = first;
+		    fd <= last && fd < CAPTURE_MAX_FD; ++fd)
+			capture_fds[fd / 8] |= (unsigned char)(1 << (fd % 8));
+
+		if (*end == ',')
+			++end;
+		else if (*end != '\0')
+			xabort("invalid INTERCEPT_CAPTURE_FDS");
+
+		fds = end;
+	}
+
+	capture_all_fds = false;
+}
+
+static bool
+is_fd_captured(long fd)
+{
+	if (capture_all_fds)
+		return true;
+
+	if (fd < 0 || fd >= CAPTURE_MAX_FD)
+		return false;
+
+	return (capture_fds[fd / 8] & (1 << (fd % 8))) != 0;
+}
+
+static void
+open_capture_pipe(void)
+{
+	if (!capture_splice)
+		return;
+
+	long r = syscall_no_intercept(SYS_pipe2, capture_pipe, O_CLOEXEC);
+	xabort_on_syserror(r, "capture pipe");
+
+	/* fewer rounds of vmsplice + splice for large buffers */
+	syscall_no_intercept(SYS_fcntl, capture_pipe[1], F_SETPIPE_SZ,
+				0x100000);
+}
+
+static void write_iov(struct iovec *iov, int count, size_t len);
+
+/*
+ * open_capture - create the capture file, appending the pid to the path
+ * if it ends with '-', and write the file header.
+ */
+static void
+open_capture(void)
+{
+	char full_path[sizeof(capture_path) + 0x20];
+	struct stat st;
+
+	capture_pid = syscall_no_intercept(SYS_getpid);
+
+	size_t len = strlen(capture_path);
+	strcpy(full_path, capture_path);
+	if (capture_path[len - 1] == '-') {
+		char *c = full_path + len;
+		char digits[0x20];
+		int n = 0;
+		unsigned long pid = (unsigned long)capture_pid;
+
+		do {
+			digits[n++] = (char)('0' + pid % 10);
+			pid /= 10;
+		} while (pid != 0);
+
+		while (n > 0)
+			*c++ = digits[--n];
+		*c = '\0';
+	}
+
+	capture_fd = syscall_no_intercept(SYS_open, full_path,
+			O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0600);
+	xabort_on_syserror(capture_fd, "opening capture file");
+
+	xabort_on_syserror(syscall_no_intercept(SYS_fstat, capture_fd, &st),
+				"fstat capture file");
+	capture_splice = S_ISREG(st.st_mode);
+	open_capture_pipe();
+
+	struct capture_file_header header = {
+		.version = 1,
+		.record_header_size = sizeof(struct capture_record)
+	};
+	memcpy(header.magic, CAPTURE_FILE_MAGIC, sizeof(header.magic));
+
+	struct iovec iov = { .iov_base = &header, .iov_len = sizeof(header) };
+	write_iov(&iov, 1, sizeof(header));
+}
+
+/*
+ * intercept_setup_capture
+ * Enable capturing if a path is specified for the output.
+ */
+void
+intercept_setup_capture(const char *path, const char *max_bytes,
+			const char *fds)
+{
+	if (path == nullptr || path[0] == '\0')
+		return;
+
+	if (strlen(path) >= sizeof(capture_path))
+		xabort("INTERCEPT_CAPTURE path too long");
+
+	strcpy(capture_path, path);
+
+	if (max_bytes != nullptr && max_bytes[0] != '\0')
+		capture_max = strtoul(max_bytes, nullptr, 0);
+
+	if (fds != nullptr && fds[0] != '\0')
+		parse_fds(fds);
+
+	open_capture();
+	intercept_capture_on = true;
+}
+
+/*
+ * advance_iov - skip len bytes in an array of iovecs, returns the number
+ * of iovecs skipped entirely.
+ */
+static int
+advance_iov(struct iovec *iov, int count, size_t len)
+{
+	int i = 0;
+
+	while (i < count && len >= iov[i].iov_len) {
+		len -= iov[i].iov_len;
+		++i;
+	}
+
+	if (i < count) {
+		iov[i].iov_base = (char *)iov[i].iov_base + len;
+		iov[i].iov_len -= len;
+	}
+
+	return i;
+}
+
+/*
+ * splice_iov - vmsplice the buffers into the pipe, and splice them out to
+ * the capture file, as many bytes at a time as the pipe can hold.
+ */
+static void
+splice_iov(struct iovec *iov, int count, size_t len)
+{
+	while (len > 0) {
+		long in = syscall_no_intercept(SYS_vmsplice, capture_pipe[1],
+				iov, count, 0);
+		if (in <= 0)
+			break;
+
+		for (long left = in; left > 0; ) {
+			long out = syscall_no_intercept(SYS_splice,
+					capture_pipe[0], nullptr,
+					capture_fd, nullptr, left, 0);
+			if (out <= 0) {
+				/* the pipe can't be left with pages in it */
+				intercept_capture_on = false;
+				return;
+			}
+			left -= out;
+		}
+
+		int skip = advance_iov(iov, count, (size_t)in);
+		iov += skip;
+		count -= skip;
+		len -= (size_t)in;
+	}
+}
+
+static void
+writev_iov(struct iovec *iov, int count, size_t len)
+{
+	while (len > 0) {
+		long written = syscall_no_intercept(SYS_writev, capture_fd,
+				iov, count);
+		if (written <= 0)
+			break;
+
+		int skip = advance_iov(iov, count, (size_t)written);
+		iov += skip;
+		count -= skip;
+		len -= (size_t)written;
+	}
+}
+
+static void
+write_iov(struct iovec *iov, int count, size_t len)
+{
+	if (capture_splice)
+		splice_iov(iov, count, len);
+	else
+		writev_iov(iov, count, len);
+}
+
+/*
+ * limit_iov - copy the iovecs describing the data transferred, limited to
+ * len bytes, and CAPTURE_MAX_IOV iovecs. Returns the number of iovecs, and
+ * the number of bytes in them in *len.
+ */
+static int
+limit_iov(struct iovec *dst, const struct iovec *src, size_t src_count,
+	size_t *len)
+{
+	size_t left = *len;
+	int count = 0;
+
+	for (size_t i = 0; i < src_count && count < CAPTURE_MAX_IOV &&
+	    left > 0; ++i) {
+		if (src[i].iov_len == 0)
+			continue;
+
+		dst[count] = src[i];
+		if (dst[count].iov_len > left)
+			dst[count].iov_len = left;
+
+		left -= dst[count].iov_len;
+		++count;
+	}
+
+	*len -= left;
+
+	return count;
+}
+
+/*
+ * get_buffers - the buffers used by a syscall, as an array of iovecs,
+ * pointed to by *iov, with *count elements. Returns false for syscalls
+ * not captured.
+ */
+static bool
+get_buffers(const struct syscall_desc *desc, struct iovec *single,
+		const struct iovec **iov, size_t *count,
+		enum capture_direction *direction)
+{
+	*iov = single;
+	*count = 1;
+	single->iov_base = (void *)desc->args[1];
+	single->iov_len = (size_t)desc->args[2];
+
+	switch (desc->nr) {
+		case SYS_read:
+		case SYS_pread64:
+		case SYS_recvfrom:
+			*direction = CAPTURE_IN;
+			return true;
+		case SYS_write:
+		case SYS_pwrite64:
+		case SYS_sendto:
+			*direction = CAPTURE_OUT;
+			return true;
+		case SYS_readv:
+		case SYS_preadv:
+		case SYS_preadv2:
+			*direction = CAPTURE_IN;
+			*iov = (const struct iovec *)desc->args[1];
+			*count = (size_t)desc->args[2];
+			return true;
+		case SYS_writev:
+		case SYS_pwritev:
+		case SYS_pwritev2:
+			*direction = CAPTURE_OUT;
+			*iov = (const struct iovec *)desc->args[1];
+			*count = (size_t)desc->args[2];
+			return true;
+		case SYS_recvmsg:
+		case SYS_sendmsg: {
+			const struct msghdr *msg =
+			    (const struct msghdr *)desc->args[1];
+			*direction = (desc->nr == SYS_recvmsg) ?
+			    CAPTURE_IN : CAPTURE_OUT;
+			*iov = msg->msg_iov;
+			*count = msg->msg_iovlen;
+			return true;
+		}
+		default:
+			return false;
+	}
+}
+
+void
+intercept_capture_syscall(const struct syscall_desc *desc, long result)
+{
+	struct iovec single;
+	const struct iovec *buffers;
+	size_t buffer_count;
+	enum capture_direction direction;
+
+	if (result <= 0 || !is_fd_captured(desc->args[0]))
+		return;
+
+	if (!get_buffers(desc, &single, &buffers, &buffer_count, &direction))
+		return;
+
+	if (capture_tid == 0)
+		capture_tid = syscall_no_intercept(SYS_gettid);
+
+	struct iovec iov[1 + CAPTURE_MAX_IOV];
+	size_t len = (size_t)result;
+	if (len > capture_max)
+		len = capture_max;
+
+	struct capture_record record = {
+		.timestamp_ns = clock_ns_no_intercept(),
+		.pid = (int32_t)capture_pid,
+		.tid = (int32_t)capture_tid,
+		.syscall_nr = desc->nr,
+		.fd = (int32_t)desc->args[0],
+		.result = result,
+		.direction = direction
+	};
+
+	int count = limit_iov(iov + 1, buffers, buffer_count, &len);
+	record.captured_len = (uint32_t)len;
+	iov[0].iov_base = &record;
+	iov[0].iov_len = sizeof(record);
+
+	/* a signal handler interrupting a capture in this thread is ignored */
+	if (in_capture)
+		return;
+
+	in_capture = true;
+	while (__atomic_exchange_n(&capture_lock, 1, __ATOMIC_ACQUIRE) != 0)
+		__builtin_ia32_pause();
+
+	if (intercept_capture_on)
+		write_iov(iov, count + 1, sizeof(record) + len);
+
+	__atomic_store_n(&capture_lock, 0, __ATOMIC_RELEASE);
+	in_capture = false;
+}
+
+/*
+ * In the child, only the thread that forked exists, and it did not hold
+ * the lock. A new capture file is created if its path contains the pid,
+ * otherwise the child keeps on appending records to the one inherited, but
+ * with its own pipe, so the data of the two processes is not mixed.
+ */
+void
+intercept_capture_after_fork(void)
+{
+	capture_lock = 0;
+	capture_tid = 0;
+	capture_pid = syscall_no_intercept(SYS_getpid);
+
+	if (capture_pipe[0] >= 0) {
+		syscall_no_intercept(SYS_close, capture_pipe[0]);
+		syscall_no_intercept(SYS_close, capture_pipe[1]);
+	}
+
+	if (capture_path[strlen(capture_path) - 1] == '-') {
+		syscall_no_intercept(SYS_close, capture_fd);
+		open_capture();
+	} else {
+		open_capture_pipe();
+	}
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_capture.h - capturing the data transferred by I/O syscalls
+ * into a framed binary stream.
+ */
+
+#ifndef INTERCEPT_CAPTURE_H
+#define INTERCEPT_CAPTURE_H
+
+#include <stdint.h>
+
+struct syscall_desc;
+
+/*
+ * The capture file starts with a file header, followed by records, each
+ * record being a record header followed by record.captured_len bytes of
+ * data. All fields are in native byte order.
+ */
+#define CAPTURE_FILE_MAGIC "SYSICAP1"
+
+struct capture_file_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_header_size; /* sizeof(struct capture_record) */
+};
+
+enum capture_direction {
+	CAPTURE_OUT = 0, /* data written by the process, e.g. write */
+	CAPTURE_IN = 1 /* data read by the process, e.g. read */
+};
+
+struct capture_record {
+	/* CLOCK_MONOTONIC, when the syscall returned */
+	uint64_t timestamp_ns;
+	int32_t pid;
+	int32_t tid;
+	int32_t syscall_nr;
+	int32_t fd;
+
+	/* the return value of the syscall */
+	int64_t result;
+
+	/* at most the size limit, and the result */
+	uint32_t captured_len;
+
+	/* enum capture_direction */
+	uint32_t direction;
+};
+
+/* Is capturing enabled? Checked before calling any other routine here. */
+extern bool intercept_capture_on;
+
+void intercept_setup_capture(const char *path, const char *max_bytes,
+				const char *fds);
+
+/*
+ * intercept_capture_syscall - record the data transferred by a syscall,
+ * if it is one of the syscalls capturing applies to, it succeeded, and
+ * its fd is selected.
+ */
+void intercept_capture_syscall(const struct syscall_desc *, long result);
+
+/*
+ * intercept_capture_after_fork - called in a new child process, to set
+ * up the capture state of the child.
+ */
+void intercept_capture_after_fork(void);
+
+#endif
@@ -0,0 +1,429 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_control.c - runtime control of the library.
+ *
+ * Commands are plain text, one per line, words separated by spaces:
+ *
+ * log PATH [TRUNC] -- start logging to PATH, as INTERCEPT_LOG would
+ * log off -- stop logging
+ * hook on|off -- call the hook, or forward each syscall to the kernel
+ * profile on|off -- resume, or pause sampling call stacks
+ * profile dump -- write the stacks collected so far to the profile file
+ * profile reset -- zero the counts of the stacks collected so far
+ * stats -- write the report of syscall_intercept_stats to the log
+ *
+ * Empty lines, and lines starting with '#' are ignored.
+ *
+ * The commands are either sent by the program using a magic write syscall
+ * (see magic_syscalls.h), or written to the control file named by the
+ * INTERCEPT_CONTROL environment variable. The latter is watched using
+ * inotify by a thread started with a raw clone syscall. That thread shares
+ * the TLS area of the thread that started it, thus it does not execute
+ * the commands itself, only copies the file to pending_commands, and sets
+ * intercept_control_pending. The next thread issuing a syscall executes
+ * them, in intercept_control_apply.
+ */
+
+#include "intercept_control.h"
+#include "intercept.h"
+#include "intercept_log.h"
+#include "intercept_profile.h"
+#include "intercept_util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <syscall.h>
+
+/* The size of the part of the control file read */
+#define CONTROL_MAX_SIZE 0x1000
+
+int intercept_control_pending;
+bool intercept_control_hook_off;
+
+static char control_dir[PATH_MAX];
+static char control_name[NAME_MAX + 1];
+static int control_dir_fd = -1;
+
+/*
+ * Protects pending_commands, held by the watcher thread while filling it,
+ * and by intercept_control_apply while copying it.
+ */
+static int pending_lock;
+static char pending_commands[CONTROL_MAX_SIZE];
+static size_t pending_len;
+
+static void
+lock_pending(void)
+{
+	while (__atomic_exchange_n(&pending_lock, 1, __ATOMIC_ACQUIRE) != 0)
+		__builtin_ia32_pause();
+}
+
+static bool
+trylock_pending(void)
+{
+	return __atomic_exchange_n(&pending_lock, 1, __ATOMIC_ACQUIRE) == 0;
+}
+
+static void
+unlock_pending(void)
+{
+	__atomic_store_n(&pending_lock, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * read_control_file - copy the contents of the control file to
+ * pending_commands. Called from the watcher thread. Commands not yet
+ * executed are replaced.
+ */
+static void
+read_control_file(void)
+{
+	long fd = syscall_no_intercept(SYS_openat, control_dir_fd,
+				control_name, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	lock_pending();
+
+	long len = syscall_no_intercept(SYS_read, fd,
+				pending_commands, sizeof(pending_commands));
+
+	if (len > 0) {
+		pending_len = (size_t)len;
+		__atomic_store_n(&intercept_control_pending, 1,
+		    __ATOMIC_RELEASE);
+	}
+
+	unlock_pending();
+
+	syscall_no_intercept(SYS_close, fd);
+}
+
+static void
+log_watcher_error(long error)
+{
+	static const char prefix[] = "intercept_control watcher stopped: ";
+	const char *msg = strerror_no_intercept(error);
+	size_t len = strlen(msg);
+	char buf[sizeof(prefix) + 0x100];
+
+	if (len > 0x100 - 1)
+		len = 0x100 - 1;
+
+	memcpy(buf, prefix, sizeof(prefix) - 1);
+	memcpy(buf + sizeof(prefix) - 1, msg, len);
+	buf[sizeof(prefix) - 1 + len] = '\n';
+
+	/* not through the ring of the thread sharing its TLS */
+	intercept_log_direct(buf, sizeof(prefix) + len);
+}
+
+/*
+ * control_watcher - the thread waiting for the control file to be
+ * written, or replaced by a rename. Stops on an error other than EINTR,
+ * the control file is not read anymore then.
+ */
+static void
+control_watcher(void *arg)
+{
+	long inotify_fd = (long)arg;
+	char events[0x1000]
+	    __attribute__((aligned(__alignof__(struct inotify_event))));
+
+	for (;;) {
+		long len = syscall_no_intercept(SYS_read, inotify_fd,
+					events, sizeof(events));
+
+		if (len == -EINTR)
+			continue;
+
+		if (len <= 0) {
+			log_watcher_error(len == 0 ? EIO : -len);
+			syscall_no_intercept(SYS_close, inotify_fd);
+			return;
+		}
+
+		bool changed = false;
+
+		for (long i = 0; i < len; ) {
+			const struct inotify_event *event =
+			    (const void *)(events + i);
+
+			if (event->len > 0 &&
+			    strcmp(event->name, control_name) == 0)
+				changed = true;
+
+			i += (long)sizeof(*event) + event->len;
+		}
+
+		if (changed)
+			read_control_file();
+	}
+}
+
+static void
+start_watcher(void)
+{
+	long fd = syscall_no_intercept(SYS_inotify_init1, IN_CLOEXEC);
+	xabort_on_syserror(fd, "inotify_init1");
+
+	long wd = syscall_no_intercept(SYS_inotify_add_watch, fd,
+				control_dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+	xabort_on_syserror(wd, "watching INTERCEPT_CONTROL");
+
+	start_thread_no_intercept(control_watcher, (void *)fd);
+}
+
+/*
+ * intercept_setup_control
+ * The directory containing the control file is watched, rather than the
+ * file itself, so the file does not need to exist yet, and can also be
+ * replaced by renaming another file to its name.
+ */
+void
+intercept_setup_control(const char *path)
+{
+	if (path == nullptr || path[0] == '\0')
+		return;
+
+	if (strlen(path) >= sizeof(control_dir))
+		xabort("INTERCEPT_CONTROL path too long");
+
+	const char *name = strrchr(path, '/');
+
+	if (name == nullptr) {
+		strcpy(control_dir, ".");
+		name = path;
+	} else {
+		size_t dir_len = (size_t)(name - path);
+
+		if (dir_len == 0)
+			dir_len = 1; /* the root directory */
+
+		memcpy(control_dir, path, dir_len);
+		control_dir[dir_len] = '\0';
+		++name;
+	}
+
+	if (name[0] == '\0' || strlen(name) >= sizeof(control_name))
+		xabort("invalid INTERCEPT_CONTROL path");
+
+	strcpy(control_name, name);
+
+	/* in case the program changes its working directory */
+	control_dir_fd = (int)syscall_no_intercept(SYS_open, control_dir,
+				O_PATH | O_DIRECTORY | O_CLOEXEC);
+	xabort_on_syserror(control_dir_fd, "opening INTERCEPT_CONTROL");
+
+	start_watcher();
+}
+
+/*
+ * intercept_control_after_fork
+ * The child process gets its own watcher, commands written to the control
+ * file are executed in both processes.
+ */
+void
+intercept_control_after_fork(void)
+{
+	if (control_dir_fd < 0)
+		return;
+
+	pending_lock = 0;
+	start_watcher();
+}
+
+static bool
+is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+/*
+ * split_words - split a line into words, in place, returns the number of
+ * words found, at most max_words.
+ */
+static int
+split_words(char *line, char **words, int max_words)
+{
+	int count = 0;
+
+	while (count < max_words) {
+		while (is_space(*line))
+			++line;
+
+		if (*line == '\0')
+			break;
+
+		words[count++] = line;
+
+		while (*line != '\0' && !is_space(*line))
+			++line;
+
+		if (*line != '\0')
+			*line++ = '\0';
+	}
+
+	return count;
+}
+
+/*
+ * run_command - execute a single command, returns false if it is not
+ * understood, or failed, e.g. the log file given can not be opened.
+ */
+static bool
+run_command(char **words, int count)
+{
+	if (strcmp(words[0], "log") == 0 && count >= 2) {
+		if (strcmp(words[1], "off") == 0)
+			return intercept_log_reopen(nullptr, nullptr) == 0;
+
+		return intercept_log_reopen(words[1],
+		    count >= 3 ? words[2] : nullptr) == 0;
+	}
+
+	if (strcmp(words[0], "hook") == 0 && count == 2) {
+		if (strcmp(words[1], "on") == 0)
+			__atomic_store_n(&intercept_control_hook_off, false,
+			    __ATOMIC_RELAXED);
+		else if (strcmp(words[1], "off") == 0)
+			__atomic_store_n(&intercept_control_hook_off, true,
+			    __ATOMIC_RELAXED);
+		else
+			return false;
+		return true;
+	}
+
+	if (strcmp(words[0], "profile") == 0 && count == 2) {
+		if (strcmp(words[1], "on") == 0)
+			intercept_profile_pause(false);
+		else if (strcmp(words[1], "off") == 0)
+			intercept_profile_pause(true);
+		else if (strcmp(words[1], "dump") == 0)
+			intercept_profile_dump();
+		else if (strcmp(words[1], "reset") == 0)
+			intercept_profile_reset();
+		else
+			return false;
+		return true;
+	}
+
+	if (strcmp(words[0], "stats") == 0 && count == 1) {
+		intercept_log_stats();
+		return true;
+	}
+
+	return false;
+}
+
+static void
+log_unknown_command(const char *line, size_t len)
+{
+	static const char prefix[] = "intercept_control failed command: ";
+	char buf[sizeof(prefix) + 0x100];
+
+	if (len > 0x100 - 1)
+		len = 0x100 - 1;
+
+	memcpy(buf, prefix, sizeof(prefix) - 1);
+	memcpy(buf + sizeof(prefix) - 1, line, len);
+	buf[sizeof(prefix) - 1 + len] = '\n';
+
+	intercept_log(buf, sizeof(prefix) + len);
+}
+
+int
+intercept_control_run(const char *commands, size_t len)
+{
+	int unknown = 0;
+
+	while (len > 0) {
+		char line[0x400];
+		char *words[4];
+		const char *end = memchr(commands, '\n', len);
+		size_t line_len = (end != nullptr) ?
+		    (size_t)(end - commands) : len;
+
+		if (line_len < sizeof(line)) {
+			memcpy(line, commands, line_len);
+			line[line_len] = '\0';
+
+			int count = split_words(line, words, 4);
+
+			if (count > 0 && words[0][0] != '#' &&
+			    !run_command(words, count)) {
+				log_unknown_command(commands, line_len);
+				++unknown;
+			}
+		} else {
+			log_unknown_command(commands, line_len);
+			++unknown;
+		}
+
+		if (end == nullptr)
+			break;
+
+		len -= line_len + 1;
+		commands += line_len + 1;
+	}
+
+	return unknown;
+}
+
+void
+intercept_control_apply(void)
+{
+	static char commands[CONTROL_MAX_SIZE];
+	size_t len;
+
+	if (!__atomic_load_n(&intercept_control_pending, __ATOMIC_ACQUIRE))
+		return;
+
+	/* another thread is executing them, or the watcher is busy */
+	if (!trylock_pending())
+		return;
+
+	len = pending_len;
+	memcpy(commands, pending_commands, len);
+	__atomic_store_n(&intercept_control_pending, 0, __ATOMIC_RELAXED);
+
+	/* commands is only used by the thread holding the lock */
+	intercept_control_run(commands, len);
+
+	unlock_pending();
+}
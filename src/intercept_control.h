@@ -0,0 +1,98 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_control.h - commands changing the behaviour of the library
+ * at runtime, read from a control file, or sent using a magic syscall.
+ */
+
+#ifndef INTERCEPT_CONTROL_H
+#define INTERCEPT_CONTROL_H
+
+#include <stddef.h>
+
+#include "intercept.h"
+#include "magic_syscalls.h"
+
+/*
+ * Set by the thread watching the control file, when commands are waiting
+ * to be executed by the next thread issuing a syscall.
+ */
+extern int intercept_control_pending;
+
+/* Set by the "hook off" command, the hook is not called while set. */
+extern bool intercept_control_hook_off;
+
+/*
+ * intercept_setup_control - start watching the control file at path for
+ * changes, if path is not null.
+ */
+void intercept_setup_control(const char *path);
+
+/*
+ * intercept_control_after_fork - called in a new child process, the thread
+ * watching the control file does not exist in the child.
+ */
+void intercept_control_after_fork(void);
+
+/*
+ * intercept_control_run - execute the commands in a buffer, one per line.
+ * Returns the number of lines not understood, or failed.
+ */
+int intercept_control_run(const char *commands, size_t len);
+
+/*
+ * intercept_control_apply - execute the commands waiting, if any.
+ */
+void intercept_control_apply(void);
+
+/*
+ * intercept_control_requested - checked for each syscall, is there
+ * something to do for intercept_control_apply or handle_magic_syscalls?
+ * This is a single branch, not taken by regular syscalls.
+ */
+static inline bool
+intercept_control_requested(const struct syscall_desc *desc)
+{
+	int requested =
+	    __atomic_load_n(&intercept_control_pending, __ATOMIC_RELAXED);
+
+#ifndef SYSCALL_INTERCEPT_WITHOUT_MAGIC_SYSCALLS
+	requested |= (desc->args[0] == SYSCALL_INT_MAGIC_WRITE_FD);
+#else
+	(void) desc;
+#endif
+
+	return __builtin_expect(requested, 0);
+}
+
+#endif
@@ -0,0 +1,591 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_delegate.c - exception-less syscalls, in the style of FlexSC.
+ *
+ * For programs issuing many tiny syscalls, e.g. small writes to pipes and
+ * sockets, a large part of the cost of each syscall is the switch to the
+ * kernel and back. In this experimental mode, the syscalls listed in
+ * INTERCEPT_DELEGATE are not executed by the thread issuing them. The
+ * thread posts the syscall to a slot in a submission ring, and a worker
+ * thread, pinned to a CPU of its own, executes the syscalls posted in
+ * batches, and posts back the results. The thread waiting for a result
+ * spins for a while, then sleeps on a futex, woken by the worker.
+ *
+ * Each thread submits to one of DELEGATE_RINGS rings, assigned round robin
+ * when it first delegates a syscall. A ring is shared by the threads
+ * assigned to it, these claim a free slot with an atomic compare and swap.
+ * The rings with posted slots are marked in pending_rings, which is all
+ * the worker looks at while idle.
+ *
+ * A syscall blocking in the worker would hold up the syscalls of every
+ * other thread. Syscalls that block regardless of their arguments, e.g.
+ * nanosleep or epoll_wait, are refused at setup. For syscalls taking a file
+ * descriptor as their first argument, e.g. read or write, the worker looks
+ * up the file status flags of the descriptor first, and hands the syscall
+ * back to the thread posting it, unless the file is in non-blocking mode.
+ * That thread then executes the syscall itself, and remembers the refusal
+ * in refused_fds, so later syscalls on the same descriptor are executed
+ * right away, without a round trip to the worker. The entry of a
+ * descriptor is cleared when it is closed, replaced by dup2 or dup3, or
+ * its flags are changed by fcntl or ioctl, see intercept_delegate_note.
+ * A syscall not seen by the library, e.g. one issued while interception
+ * is off in the thread, can leave a stale entry, which only means that
+ * the syscalls on that descriptor are not delegated.
+ *
+ * The worker blocks all signals, so a signal the kernel sends to the
+ * thread executing a syscall stays pending there, instead of reaching the
+ * thread that issued it: the SIGPIPE of a write to a broken pipe or
+ * socket, or the SIGXFSZ of a write beyond RLIMIT_FSIZE. The thread that
+ * posted the syscall sends these to itself when it gets back the error
+ * EPIPE (unless MSG_NOSIGNAL was passed), or EFBIG (if RLIMIT_FSIZE is
+ * set), see raise_lost_signal.
+ *
+ * The worker is started with a raw clone syscall, sharing the TLS area of
+ * the thread that started it, so it must not use thread local variables,
+ * nor libc functions that might.
+ */
+
+#include "intercept_delegate.h"
+#include "intercept.h"
+#include "intercept_util.h"
+#include "syscall_formats.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <syscall.h>
+
+/* The number of rings, one bit for each in pending_rings */
+#define DELEGATE_RINGS 64
+
+/* The number of slots in each ring */
+#define DELEGATE_SLOTS 16
+
+/* How many times a thread waiting for a result checks it, before sleeping */
+#define DELEGATE_SPIN 0x800
+
+/* How many times the idle worker looks for new syscalls, before sleeping */
+#define DELEGATE_WORKER_SPIN 0x4000
+
+enum slot_state {
+	SLOT_FREE,
+	SLOT_CLAIMED,
+	SLOT_POSTED,
+	SLOT_DONE,
+	SLOT_REFUSED /* to be executed by the thread that posted it */
+};
+
+struct delegate_slot {
+	int state; /* enum slot_state, also a futex */
+	int waiting; /* the thread that posted the syscall sleeps */
+	long nr;
+	long args[6];
+	long result;
+} __attribute__((aligned(64)));
+
+struct delegate_ring {
+	struct delegate_slot slots[DELEGATE_SLOTS];
+};
+
+bool intercept_delegate_on;
+unsigned char intercept_delegated[DELEGATE_MAX_NR / 8];
+
+/* The delegated syscalls with a file descriptor as the first argument */
+static unsigned char fd_syscalls[DELEGATE_MAX_NR / 8];
+
+/* The number of file descriptors tracked in refused_fds */
+#define DELEGATE_FD_CACHE 1024
+
+/* Non-zero for file descriptors the worker found in blocking mode */
+static unsigned char refused_fds[DELEGATE_FD_CACHE];
+
+static struct delegate_ring *rings;
+static unsigned long pending_rings __attribute__((aligned(64)));
+static int worker_sleeping __attribute__((aligned(64)));
+static unsigned next_ring;
+
+/* The number of syscalls executed by the worker, only written by it */
+static size_t delegated_count;
+
+/* The affinity mask of the worker, a single CPU */
+static unsigned long worker_cpu_mask[16];
+
+static __thread unsigned own_ring
+	__attribute__((tls_model("initial-exec")));
+
+/*
+ * These can not return in a different thread, or must not be moved, or
+ * might block the worker, whatever their arguments are.
+ */
+static const int never_delegated[] = {
+	SYS_clone, SYS_fork, SYS_vfork, SYS_execve, SYS_execveat,
+	SYS_exit, SYS_exit_group, SYS_rt_sigreturn, SYS_rt_sigprocmask,
+	SYS_rt_sigsuspend, SYS_gettid, SYS_set_tid_address, SYS_arch_prctl,
+	SYS_prctl, SYS_sigaltstack, SYS_futex, SYS_sched_setaffinity,
+	SYS_nanosleep, SYS_clock_nanosleep, SYS_pause, SYS_wait4, SYS_waitid,
+	SYS_poll, SYS_ppoll, SYS_select, SYS_pselect6, SYS_epoll_wait,
+	SYS_epoll_pwait, SYS_flock, SYS_rt_sigtimedwait, SYS_msgrcv,
+	SYS_msgsnd, SYS_semop, SYS_semtimedop,
+#ifdef SYS_clone3
+	SYS_clone3,
+#endif
+#ifdef SYS_epoll_pwait2
+	SYS_epoll_pwait2,
+#endif
+};
+
+static long
+parse_syscall(const char *name, size_t len)
+{
+	char *end;
+	long nr = strtol(name, &end, 10);
+
+	if (end == name + len)
+		return nr;
+
+	for (nr = 0; nr < DELEGATE_MAX_NR; ++nr) {
+		struct syscall_desc desc = { .nr = (int)nr };
+		const char *known = get_syscall_format(&desc)->name;
+
+		if (known != nullptr && strlen(known) == len &&
+		    strncmp(known, name, len) == 0)
+			return nr;
+	}
+
+	return -1;
+}
+
+/*
+ * parse_syscalls - a list of syscall names or numbers, e.g.:
+ * "write,writev,sendto,46"
+ */
+static void
+parse_syscalls(const char *syscalls)
+{
+	while (*syscalls != '\0') {
+		size_t len = strcspn(syscalls, ",");
+		long nr = parse_syscall(syscalls, len);
+
+		if (nr < 0 || nr >= DELEGATE_MAX_NR)
+			xabort("invalid INTERCEPT_DELEGATE");
+
+		for (size_t i = 0; i < ARRAY_SIZE(never_delegated); ++i) {
+			if (nr == never_delegated[i])
+				xabort("INTERCEPT_DELEGATE: syscall can not "
+				    "be delegated");
+		}
+
+		intercept_delegated[nr / 8] |= (unsigned char)(1 << (nr % 8));
+
+		struct syscall_desc desc = { .nr = (int)nr };
+		if (get_syscall_format(&desc)->args[0] == arg_fd)
+			fd_syscalls[nr / 8] |= (unsigned char)(1 << (nr % 8));
+
+		syscalls += len;
+		if (*syscalls == ',')
+			++syscalls;
+	}
+}
+
+/*
+ * choose_cpu - the CPU given, or the last one in the affinity mask of the
+ * process, leaving the first CPUs to the threads of the program. Returns
+ * false if the process can only run on a single CPU, the worker would
+ * just take turns with the threads waiting for it there.
+ */
+static bool
+choose_cpu(const char *cpu)
+{
+	unsigned long mask[ARRAY_SIZE(worker_cpu_mask)] = {0};
+	int cpu_count = 0;
+	long n = -1;
+
+	long r = syscall_no_intercept(SYS_sched_getaffinity, 0,
+			sizeof(mask), mask);
+	xabort_on_syserror(r, "sched_getaffinity");
+
+	for (size_t i = 0; i < ARRAY_SIZE(mask); ++i) {
+		cpu_count += __builtin_popcountl(mask[i]);
+		if (mask[i] != 0)
+			n = (long)i * 64 + 63 - __builtin_clzl(mask[i]);
+	}
+
+	if (cpu_count < 2)
+		return false;
+
+	if (cpu != nullptr && cpu[0] != '\0')
+		n = atol(cpu);
+
+	if (n < 0 || n >= (long)sizeof(worker_cpu_mask) * CHAR_BIT)
+		xabort("invalid INTERCEPT_DELEGATE_CPU");
+
+	worker_cpu_mask[n / 64] = 1UL << (n % 64);
+
+	return true;
+}
+
+static bool
+is_fd_syscall(long nr)
+{
+	return (fd_syscalls[nr / 8] & (1 << (nr % 8))) != 0;
+}
+
+/*
+ * might_block - is the syscall posted one on a file descriptor not in
+ * non-blocking mode. An invalid descriptor is left for the syscall itself
+ * to report.
+ */
+static bool
+might_block(const struct delegate_slot *slot)
+{
+	if (!is_fd_syscall(slot->nr))
+		return false;
+
+	long flags = syscall_no_intercept(SYS_fcntl, slot->args[0], F_GETFL);
+
+	return flags >= 0 && (flags & O_NONBLOCK) == 0;
+}
+
+static void
+complete(struct delegate_slot *slot)
+{
+	int state = SLOT_REFUSED;
+
+	if (!might_block(slot)) {
+		slot->result = syscall_no_intercept(slot->nr,
+				slot->args[0], slot->args[1], slot->args[2],
+				slot->args[3], slot->args[4], slot->args[5]);
+		state = SLOT_DONE;
+		__atomic_store_n(&delegated_count, delegated_count + 1,
+		    __ATOMIC_RELAXED);
+	}
+
+	__atomic_store_n(&slot->state, state, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&slot->waiting, __ATOMIC_SEQ_CST))
+		syscall_no_intercept(SYS_futex, &slot->state,
+				FUTEX_WAKE_PRIVATE, 1);
+}
+
+/*
+ * run_batch - execute the syscalls posted in the rings marked pending,
+ * returns the number of syscalls executed.
+ */
+static unsigned
+run_batch(void)
+{
+	unsigned count = 0;
+	unsigned long pending =
+	    __atomic_exchange_n(&pending_rings, 0, __ATOMIC_ACQUIRE);
+
+	while (pending != 0) {
+		struct delegate_ring *ring =
+		    rings + __builtin_ctzl(pending);
+
+		pending &= pending - 1;
+
+		for (unsigned i = 0; i < DELEGATE_SLOTS; ++i) {
+			struct delegate_slot *slot = ring->slots + i;
+
+			if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) ==
+			    SLOT_POSTED) {
+				complete(slot);
+				++count;
+			}
+		}
+	}
+
+	return count;
+}
+
+static void
+delegate_worker(void *arg)
+{
+	unsigned idle = 0;
+
+	(void) arg;
+
+	syscall_no_intercept(SYS_sched_setaffinity, 0,
+			sizeof(worker_cpu_mask), worker_cpu_mask);
+
+	for (;;) {
+		if (run_batch() != 0) {
+			idle = 0;
+			continue;
+		}
+
+		if (++idle < DELEGATE_WORKER_SPIN) {
+			__builtin_ia32_pause();
+			continue;
+		}
+
+		/*
+		 * Either the worker sees the ring marked pending after
+		 * announcing it sleeps, or the thread posting the syscall
+		 * sees worker_sleeping set, and wakes it.
+		 */
+		__atomic_store_n(&worker_sleeping, 1, __ATOMIC_SEQ_CST);
+
+		if (__atomic_load_n(&pending_rings, __ATOMIC_SEQ_CST) == 0)
+			syscall_no_intercept(SYS_futex, &worker_sleeping,
+					FUTEX_WAIT_PRIVATE, 1, nullptr);
+
+		__atomic_store_n(&worker_sleeping, 0, __ATOMIC_RELAXED);
+		idle = 0;
+	}
+}
+
+void
+intercept_setup_delegate(const char *syscalls, const char *cpu)
+{
+	if (syscalls == nullptr || syscalls[0] == '\0')
+		return;
+
+	parse_syscalls(syscalls);
+	if (!choose_cpu(cpu))
+		return;
+
+	rings = xmmap_anon(DELEGATE_RINGS * sizeof(rings[0]));
+	start_thread_no_intercept(delegate_worker, nullptr);
+
+	intercept_delegate_on = true;
+}
+
+size_t
+intercept_delegate_count(void)
+{
+	return __atomic_load_n(&delegated_count, __ATOMIC_RELAXED);
+}
+
+void
+intercept_delegate_after_fork(void)
+{
+	if (!intercept_delegate_on)
+		return;
+
+	memset(rings, 0, DELEGATE_RINGS * sizeof(rings[0]));
+	pending_rings = 0;
+	worker_sleeping = 0;
+	delegated_count = 0;
+
+	start_thread_no_intercept(delegate_worker, nullptr);
+}
+
+static struct delegate_slot *
+claim_slot(void)
+{
+	if (own_ring == 0) {
+		own_ring = __atomic_fetch_add(&next_ring, 1,
+		    __ATOMIC_RELAXED) % DELEGATE_RINGS + 1;
+	}
+
+	struct delegate_ring *ring = rings + own_ring - 1;
+
+	for (unsigned i = 0; i < DELEGATE_SLOTS; ++i) {
+		int state = SLOT_FREE;
+
+		if (__atomic_compare_exchange_n(&ring->slots[i].state, &state,
+		    SLOT_CLAIMED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return ring->slots + i;
+	}
+
+	return nullptr;
+}
+
+/*
+ * wait_for_result - wait for the worker to complete, or refuse the syscall
+ * posted, returns the new state of the slot.
+ */
+static int
+wait_for_result(struct delegate_slot *slot)
+{
+	int state;
+
+	for (unsigned i = 0; i < DELEGATE_SPIN; ++i) {
+		state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+		if (state != SLOT_POSTED)
+			return state;
+		__builtin_ia32_pause();
+	}
+
+	__atomic_store_n(&slot->waiting, 1, __ATOMIC_SEQ_CST);
+
+	while ((state = __atomic_load_n(&slot->state, __ATOMIC_SEQ_CST)) ==
+	    SLOT_POSTED)
+		syscall_no_intercept(SYS_futex, &slot->state,
+				FUTEX_WAIT_PRIVATE, SLOT_POSTED, nullptr);
+
+	slot->waiting = 0;
+
+	return state;
+}
+
+static long
+execute_directly(const struct syscall_desc *desc)
+{
+	return syscall_no_intercept(desc->nr,
+				desc->args[0], desc->args[1],
+				desc->args[2], desc->args[3],
+				desc->args[4], desc->args[5]);
+}
+
+/* the flags argument of the syscalls sending to a socket */
+static long
+send_flags(const struct syscall_desc *desc)
+{
+	switch (desc->nr) {
+	case SYS_sendto:
+	case SYS_sendmmsg:
+		return desc->args[3];
+	case SYS_sendmsg:
+		return desc->args[2];
+	default:
+		return 0;
+	}
+}
+
+/*
+ * raise_lost_signal - send the signal the kernel sent to the worker along
+ * with the error of a syscall delegated, to the calling thread instead.
+ * The kernel only sends SIGXFSZ with EFBIG when RLIMIT_FSIZE is exceeded,
+ * the limit being set is taken as a sign of that.
+ */
+static void
+raise_lost_signal(const struct syscall_desc *desc, long result)
+{
+	int sig;
+
+	if (result == -EPIPE && (send_flags(desc) & MSG_NOSIGNAL) == 0) {
+		sig = SIGPIPE;
+	} else if (result == -EFBIG) {
+		struct rlimit limit;
+
+		if (syscall_no_intercept(SYS_prlimit64, 0, RLIMIT_FSIZE,
+		    nullptr, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY)
+			return;
+
+		sig = SIGXFSZ;
+	} else {
+		return;
+	}
+
+	syscall_no_intercept(SYS_tgkill, syscall_no_intercept(SYS_getpid),
+	    syscall_no_intercept(SYS_gettid), sig);
+}
+
+long
+intercept_delegate_syscall(const struct syscall_desc *desc)
+{
+	long fd = desc->args[0];
+	bool cached = is_fd_syscall(desc->nr) &&
+	    fd >= 0 && fd < DELEGATE_FD_CACHE;
+
+	if (cached && __atomic_load_n(refused_fds + fd, __ATOMIC_RELAXED))
+		return execute_directly(desc);
+
+	struct delegate_slot *slot = claim_slot();
+
+	if (slot == nullptr)
+		return execute_directly(desc);
+
+	slot->nr = desc->nr;
+	for (int i = 0; i < 6; ++i)
+		slot->args[i] = desc->args[i];
+
+	__atomic_store_n(&slot->state, SLOT_POSTED, __ATOMIC_RELEASE);
+	__atomic_fetch_or(&pending_rings, 1UL << (own_ring - 1),
+	    __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&worker_sleeping, __ATOMIC_SEQ_CST) &&
+	    __atomic_exchange_n(&worker_sleeping, 0, __ATOMIC_SEQ_CST))
+		syscall_no_intercept(SYS_futex, &worker_sleeping,
+				FUTEX_WAKE_PRIVATE, 1);
+
+	int state = wait_for_result(slot);
+	long result = slot->result;
+
+	__atomic_store_n(&slot->state, SLOT_FREE, __ATOMIC_RELEASE);
+
+	if (state == SLOT_REFUSED) {
+		if (cached)
+			__atomic_store_n(refused_fds + fd, 1, __ATOMIC_RELAXED);
+		result = execute_directly(desc);
+	} else {
+		raise_lost_signal(desc, result);
+	}
+
+	return result;
+}
+
+static void
+forget_fd(long fd)
+{
+	if (fd >= 0 && fd < DELEGATE_FD_CACHE)
+		__atomic_store_n(refused_fds + fd, 0, __ATOMIC_RELAXED);
+}
+
+void
+intercept_delegate_note(const struct syscall_desc *desc, long result)
+{
+	if (result < 0)
+		return;
+
+	switch (desc->nr) {
+	case SYS_close:
+	case SYS_ioctl:
+		forget_fd(desc->args[0]);
+		break;
+	case SYS_fcntl:
+		if (desc->args[1] == F_SETFL)
+			forget_fd(desc->args[0]);
+		break;
+	case SYS_dup2:
+	case SYS_dup3:
+		forget_fd(desc->args[1]);
+		break;
+#ifdef SYS_close_range
+	case SYS_close_range:
+		for (long fd = desc->args[0];
+		    fd <= desc->args[1] && fd < DELEGATE_FD_CACHE; ++fd)
+			forget_fd(fd);
+		break;
+#endif
+	}
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_delegate.h - experimental mode, executing some syscalls on
+ * a dedicated thread, instead of the thread issuing them.
+ */
+
+#ifndef INTERCEPT_DELEGATE_H
+#define INTERCEPT_DELEGATE_H
+
+#include "intercept.h"
+
+/* The syscall numbers that can be delegated are below this */
+#define DELEGATE_MAX_NR 512
+
+/* Is delegation enabled? Checked before calling any other routine here. */
+extern bool intercept_delegate_on;
+
+/* A bit for each syscall number delegated */
+extern unsigned char intercept_delegated[DELEGATE_MAX_NR / 8];
+
+/*
+ * intercept_setup_delegate - start the worker thread, if a list of syscall
+ * names or numbers is given, the worker is pinned to the CPU given, or to
+ * the last one the process can run on. Nothing is delegated if the process
+ * can only run on a single CPU.
+ */
+void intercept_setup_delegate(const char *syscalls, const char *cpu);
+
+static inline bool
+intercept_is_delegated(long nr)
+{
+	return nr >= 0 && nr < DELEGATE_MAX_NR &&
+	    (intercept_delegated[nr / 8] & (1 << (nr % 8))) != 0;
+}
+
+/*
+ * intercept_delegate_syscall - execute a syscall on the worker thread, and
+ * wait for its result. If no submission slot is free, or the worker hands
+ * the syscall back as it might block, the syscall is executed by the
+ * calling thread. A SIGPIPE or SIGXFSZ that went to the worker with the
+ * result is sent to the calling thread.
+ */
+long
+intercept_delegate_syscall(const struct syscall_desc *desc);
+
+/*
+ * intercept_delegate_note - called after each syscall executed, while
+ * delegation is enabled, to forget what is known about the file
+ * descriptors the syscall closed, replaced, or changed the flags of.
+ */
+void intercept_delegate_note(const struct syscall_desc *desc, long result);
+
+/*
+ * intercept_delegate_count - the number of syscalls executed by the worker
+ * thread so far.
+ */
+size_t intercept_delegate_count(void);
+
+/*
+ * intercept_delegate_after_fork - called in a new child process, starts a
+ * new worker thread, the requests of other threads of the parent are
+ * discarded.
+ */
+void intercept_delegate_after_fork(void);
+
+#endif
@@ -32,6 +32,7 @@
  */
 
 #include <assert.h>
+#include <errno.h>
 #include <syscall.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -44,6 +45,7 @@
 
 #include "intercept.h"
 #include "intercept_util.h"
+#include "intercept_maps.h"
 #include "disasm_wrapper.h"
 
 /*
@@ -108,6 +110,7 @@ find_sections(struct intercept_desc *desc, int fd)
 	Elf64_Ehdr elf_header;
 
 	desc->symbol_tables.count = 0;
+	desc->symbol_string_tables.count = 0;
 	desc->rela_tables.count = 0;
 
 	xread(fd, &elf_header, sizeof(elf_header));
@@ -138,6 +141,8 @@ find_sections(struct intercept_desc *desc, int fd)
 		    section->sh_type == SHT_DYNSYM) {
 			debug_dump("found symbol table: %s\n", name);
 			add_table_info(&desc->symbol_tables, section);
+			add_table_info(&desc->symbol_string_tables,
+			    &sec_headers[section->sh_link]);
 		} else if (section->sh_type == SHT_RELA) {
 			debug_dump("found relocation table: %s\n", name);
 			add_table_info(&desc->rela_tables, section);
@@ -264,6 +269,79 @@ mark_jump(const struct intercept_desc *desc, const unsigned char *addr)
 		set_bit(desc->jump_table, (uint64_t)(addr - desc->text_start));
 }
 
+/*
+ * first_patch_at - binary search for the first patch with a syscall
+ * instruction at or after addr. The patches are found by crawl_text in
+ * the order of their addresses.
+ */
+static struct patch_desc *
+first_patch_at(struct intercept_desc *desc, const unsigned char *addr)
+{
+	unsigned low = 0;
+	unsigned high = desc->count;
+
+	while (low < high) {
+		unsigned mid = low + (high - low) / 2;
+
+		if (desc->items[mid].syscall_addr < addr)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return desc->items + low;
+}
+
+/*
+ * symbol_bind_rank - which symbol to prefer among aliases of the same
+ * function: global symbols first, weak symbols next.
+ */
+static unsigned char
+symbol_bind_rank(unsigned char bind)
+{
+	switch (bind) {
+		case STB_GLOBAL:
+			return 3;
+		case STB_WEAK:
+			return 2;
+		case STB_LOCAL:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+/*
+ * annotate_patches - remember the symbol as the one containing the
+ * syscalls in the range covered by the symbol, unless a smaller function,
+ * or a more preferred alias of the same function is already known.
+ */
+static void
+annotate_patches(struct intercept_desc *desc, const Elf64_Sym *sym,
+		unsigned char *address, Elf64_Off name_offset)
+{
+	unsigned char rank = symbol_bind_rank(ELF64_ST_BIND(sym->st_info));
+
+	for (struct patch_desc *patch = first_patch_at(desc, address);
+	    patch < desc->items + desc->count &&
+	    patch->syscall_addr < address + sym->st_size;
+	    ++patch) {
+		if (patch->symbol_size != 0) {
+			if (patch->symbol_size < sym->st_size)
+				continue;
+
+			if (patch->symbol_size == sym->st_size &&
+			    symbol_bind_rank(patch->symbol_bind) >= rank)
+				continue;
+		}
+
+		patch->symbol_address = address;
+		patch->symbol_size = sym->st_size;
+		patch->symbol_bind = ELF64_ST_BIND(sym->st_info);
+		patch->symbol_name_offset = name_offset;
+	}
+}
+
 /*
  * find_jumps_in_section_syms
  *
@@ -287,10 +365,14 @@ mark_jump(const struct intercept_desc *desc, const unsigned char *addr)
  * } Elf64_Sym;
  *
  * The field st_value is offset of the symbol in the object file.
+ *
+ * The same symbols are used to find the function containing each syscall,
+ * see annotate_patches. The string table holding the names is described
+ * by strtab.
  */
 static void
 find_jumps_in_section_syms(struct intercept_desc *desc, Elf64_Shdr *section,
-				int fd)
+				const Elf64_Shdr *strtab, int fd)
 {
 	assert(section->sh_type == SHT_SYMTAB ||
 		section->sh_type == SHT_DYNSYM);
@@ -318,8 +400,72 @@ find_jumps_in_section_syms(struct intercept_desc *desc, Elf64_Shdr *section,
 		mark_jump(desc, address);
 
 		/* a function's end in .text, mark it */
-		if (syms[i].st_size != 0)
+		if (syms[i].st_size != 0) {
 			mark_jump(desc, address + syms[i].st_size);
+
+			if (syms[i].st_name < strtab->sh_size)
+				annotate_patches(desc, &syms[i], address,
+				    strtab->sh_offset + syms[i].st_name);
+		}
+	}
+}
+
+/*
+ * save_symbol_name - store a string formatted as "name+0xoffset" in memory
+ * allocated for such names. This memory is never released, the strings
+ * are used while logging syscalls.
+ */
+static const char *
+save_symbol_name(const char *name, unsigned long offset)
+{
+	static char *names;
+	static size_t names_left;
+	size_t len = strlen(name) + sizeof("+0x") + 16;
+
+	if (len > names_left) {
+		names_left = 0x10000;
+		names = xmmap_anon(names_left);
+	}
+
+	int l = snprintf(names, names_left, "%s+0x%lx", name, offset);
+	if (l < 0)
+		return nullptr;
+
+	const char *result = names;
+	names += l + 1;
+	names_left -= (size_t)l + 1;
+
+	return result;
+}
+
+/*
+ * name_patches - read the names of symbols chosen by annotate_patches.
+ * This is done after looking through all symbol tables, so a name is read
+ * from the file only once for each patch.
+ */
+static void
+name_patches(struct intercept_desc *desc, int fd)
+{
+	for (unsigned i = 0; i < desc->count; ++i) {
+		struct patch_desc *patch = desc->items + i;
+		char name[0x200];
+
+		if (patch->symbol_size == 0)
+			continue;
+
+		long r = syscall_no_intercept(SYS_pread64, fd, name,
+				sizeof(name) - 1, patch->symbol_name_offset);
+		if (r <= 0)
+			continue;
+
+		name[r] = '\0';
+
+		if (name[0] == '\0')
+			continue;
+
+		patch->symbol = save_symbol_name(name,
+		    (unsigned long)(patch->syscall_addr -
+		    patch->symbol_address));
 	}
 }
 
@@ -428,6 +574,8 @@ add_new_patch(struct intercept_desc *desc)
  *                                |     |     |     |
  * address of next instruction -> -------     -------
  *
+ * A NOP of at least 12 bytes hosts more than one such 5 byte jump, placed
+ * one after the other, following the short jump.
  */
 bool
 is_overwritable_nop(const struct intercept_disasm_result *ins)
@@ -581,34 +729,21 @@ get_min_address(void)
 }
 
 /*
- * allocate_trampoline_table
- * Allocates memory close to a text section (close enough
- * to be reachable with 32 bit displacements in jmp instructions).
- * Using mmap syscall with MAP_FIXED flag.
+ * trampoline_window - the addresses where a trampoline table can be placed
+ * for an object: anywhere reachable from its text using 32 bit
+ * displacements in jmp instructions. The table must start at or above
+ * *low, and end at or below *high.
  */
-void
-allocate_trampoline_table(struct intercept_desc *desc)
+static void
+trampoline_window(const struct intercept_desc *desc,
+		uintptr_t *low, uintptr_t *high)
 {
-	char *e = getenv("INTERCEPT_NO_TRAMPOLINE");
-
-	/* Use the extra trampoline table by default */
-	desc->uses_trampoline_table = (e == nullptr) || (e[0] == '0');
-
-	if (!desc->uses_trampoline_table) {
-		desc->trampoline_table = nullptr;
-		desc->trampoline_table_size = 0;
-		desc->trampoline_table = nullptr;
-		return;
-	}
-
-	FILE *maps;
-	char line[0x2000];
-	unsigned char *guess; /* Where we would like to allocate the table */
-	size_t size;
+	uintptr_t text_start = (uintptr_t)desc->text_start;
+	uintptr_t text_end = (uintptr_t)desc->text_end;
 
-	if ((uintptr_t)desc->text_end < INT32_MAX) {
+	if (text_end < INT32_MAX) {
 		/* start from the bottom of memory */
-		guess = (void *)0;
+		*low = 0;
 	} else {
 		/*
 		 * start from the lowest possible address, that can be reached
@@ -616,63 +751,176 @@ allocate_trampoline_table(struct intercept_desc *desc)
 		 * Round up to a memory page boundary, as this address must be
 		 * mappable.
 		 */
-		guess = desc->text_end - INT32_MAX;
-		guess = (unsigned char *)(((uintptr_t)guess)
-				& ~((uintptr_t)(0xfff))) + 0x1000;
+		*low = ((text_end - INT32_MAX) & ~((uintptr_t)(0xfff))) +
+		    0x1000;
 	}
 
-	if ((uintptr_t)guess < get_min_address())
-		guess = (void *)get_min_address();
+	if (*low < get_min_address())
+		*low = get_min_address();
+
+	*high = text_start + INT32_MAX;
+}
 
-	size = 64 * 0x1000; /* XXX: don't just guess */
+static bool
+needs_trampoline_table(const struct intercept_desc *desc)
+{
+	/* Objects patched ahead of time carry their own table */
+	return desc->uses_trampoline_table && !desc->is_prepatched &&
+	    desc->count > 0;
+}
 
-	if ((maps = fopen("/proc/self/maps", "r")) == nullptr)
-		xabort("fopen /proc/self/maps");
+static unsigned char *
+try_map_trampoline_region(uintptr_t addr, size_t size, long *error)
+{
+	long r = syscall_no_intercept(SYS_mmap, addr, size,
+			PROT_READ | PROT_WRITE | PROT_EXEC,
+			MAP_FIXED_NOREPLACE | MAP_PRIVATE | MAP_ANON, -1, 0);
 
-	while ((fgets(line, sizeof(line), maps)) != nullptr) {
-		unsigned char *start;
-		unsigned char *end;
+	if (r == (long)addr) {
+		intercept_maps_invalidate();
+		return (unsigned char *)r;
+	}
 
-		if (sscanf(line, "%p-%p", (void **)&start, (void **)&end) != 2)
-			xabort("sscanf from /proc/self/maps");
+	/*
+	 * Kernels older than 4.17 ignore MAP_FIXED_NOREPLACE, and
+	 * treat the address as a hint only.
+	 */
+	if (r >= 0) {
+		xmunmap((void *)r, size);
+		*error = -EEXIST;
+	} else {
+		*error = r;
+	}
 
-		/*
-		 * Let's see if an existing mapping overlaps
-		 * with the guess!
-		 */
-		if (end < guess)
-			continue; /* No overlap, let's see the next mapping */
+	return nullptr;
+}
 
-		if (start >= guess + size) {
-			/* The rest of the mappings can't possibly overlap */
+/*
+ * map_trampoline_region
+ * Maps size bytes somewhere in [low, high). The first attempt is at the
+ * first hole large enough according to the cached /proc/self/maps. If
+ * the cache turns out to be stale, the next attempts probe upwards from
+ * the bottom of the range, in steps of at least 64 pages. Mapping with
+ * MAP_FIXED_NOREPLACE never replaces an existing mapping.
+ */
+static unsigned char *
+map_trampoline_region(uintptr_t low, uintptr_t high, size_t size)
+{
+	unsigned char *region;
+	long error;
+	uintptr_t hole = intercept_maps_find_hole(low, high, size);
+
+	if (hole != 0) {
+		region = try_map_trampoline_region(hole, size, &error);
+		if (region != nullptr)
+			return region;
+	}
+
+	size_t step = size;
+
+	if (step < 64 * 0x1000)
+		step = 64 * 0x1000;
+
+	for (uintptr_t addr = low; addr < high && high - addr >= size;
+	    addr += step) {
+		region = try_map_trampoline_region(addr, size, &error);
+		if (region != nullptr)
+			return region;
+
+		if (error != -EEXIST)
 			break;
-		}
+	}
 
-		/*
-		 * The next guess is the page following the mapping seen
-		 * just now.
-		 */
-		guess = end;
+	xabort("unable to find place for trampoline table");
+}
 
-		if (guess + size >= desc->text_start + INT32_MAX) {
-			/* Too far away */
-			xabort("unable to find place for trampoline table");
-		}
+/*
+ * allocate_trampoline_tables
+ * Allocates memory close to the text sections (close enough
+ * to be reachable with 32 bit displacements in jmp instructions).
+ * Objects that can reach the same addresses share a single memory
+ * region, each object getting count * TRAMPOLINE_SIZE bytes of it.
+ * The objects are grouped greedily, in the order they are found in
+ * the array: an object joins the first group, whose region can still
+ * be placed somewhere reachable from all of its members.
+ */
+void
+allocate_trampoline_tables(struct intercept_desc *descs, unsigned count)
+{
+	char *e = getenv("INTERCEPT_NO_TRAMPOLINE");
+
+	if (count == 0)
+		return;
+
+	for (unsigned i = 0; i < count; ++i) {
+		struct intercept_desc *desc = descs + i;
+
+		if (desc->is_prepatched)
+			continue;
+
+		/* Use the extra trampoline table by default */
+		desc->uses_trampoline_table = (e == nullptr) || (e[0] == '0');
+		desc->trampoline_table = nullptr;
+		desc->trampoline_table_size = 0;
+		desc->next_trampoline = nullptr;
 	}
 
-	fclose(maps);
+	/* the group each object belongs to, zero when not decided yet */
+	size_t group_map_size = count * sizeof(unsigned);
+	unsigned *group = xmmap_anon(group_map_size);
+	unsigned group_count = 0;
+
+	for (unsigned i = 0; i < count; ++i) {
+		if (!needs_trampoline_table(descs + i) || group[i] != 0)
+			continue;
+
+		uintptr_t low;
+		uintptr_t high;
+		size_t size = descs[i].count * TRAMPOLINE_SIZE;
+
+		trampoline_window(descs + i, &low, &high);
+		group[i] = ++group_count;
 
-	desc->trampoline_table = mmap(guess, size,
-					PROT_READ | PROT_WRITE | PROT_EXEC,
-					MAP_FIXED | MAP_PRIVATE | MAP_ANON,
-					-1, 0);
+		for (unsigned j = i + 1; j < count; ++j) {
+			if (!needs_trampoline_table(descs + j) || group[j] != 0)
+				continue;
 
-	if (desc->trampoline_table == MAP_FAILED)
-		xabort("unable to allocate space for trampoline table");
+			uintptr_t j_low;
+			uintptr_t j_high;
+			size_t j_size = descs[j].count * TRAMPOLINE_SIZE;
 
-	desc->trampoline_table_size = size;
+			trampoline_window(descs + j, &j_low, &j_high);
+			if (j_low < low)
+				j_low = low;
+			if (j_high > high)
+				j_high = high;
 
-	desc->next_trampoline = desc->trampoline_table;
+			if (j_low >= j_high || j_high - j_low < size + j_size)
+				continue;
+
+			low = j_low;
+			high = j_high;
+			size += j_size;
+			group[j] = group[i];
+		}
+
+		size = (size + 0xfff) & ~((size_t)0xfff);
+
+		unsigned char *region = map_trampoline_region(low, high, size);
+
+		for (unsigned j = i; j < count; ++j) {
+			if (group[j] != group[i])
+				continue;
+
+			descs[j].trampoline_table = region;
+			descs[j].trampoline_table_size =
+			    descs[j].count * TRAMPOLINE_SIZE;
+			descs[j].next_trampoline = region;
+			region += descs[j].trampoline_table_size;
+		}
+	}
+
+	xmunmap(group, group_map_size);
 }
 
 /*
@@ -705,15 +953,23 @@ find_syscalls(struct intercept_desc *desc)
 	allocate_jump_table(desc);
 	allocate_nop_table(desc);
 
+	/*
+	 * Crawling the text does not depend on the jump destinations found
+	 * in the symbol tables, and the patches found by it can be
+	 * annotated with symbol names while going through the symbol tables.
+	 */
+	crawl_text(desc);
+
 	for (Elf64_Half i = 0; i < desc->symbol_tables.count; ++i)
 		find_jumps_in_section_syms(desc,
-		    desc->symbol_tables.headers + i, fd);
+		    desc->symbol_tables.headers + i,
+		    desc->symbol_string_tables.headers + i, fd);
+
+	name_patches(desc, fd);
 
 	for (Elf64_Half i = 0; i < desc->rela_tables.count; ++i)
 		find_jumps_in_section_rela(desc,
 		    desc->rela_tables.headers + i, fd);
 
 	syscall_no_intercept(SYS_close, fd);
-
-	crawl_text(desc);
 }
@@ -38,10 +38,15 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
 #include <sched.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <linux/futex.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/syscall.h>
@@ -795,21 +800,326 @@ static const return_value_printer_func return_value_printer_table[] = {
 
 static int log_fd = -1;
 
+/* the descriptor of the log, while logging is turned off at runtime */
+static int log_idle_fd = -1;
+
 /*
- * intercept_setup_log
- * Open (create) a log file. If requested, the current processes pid
- * number is attached to the path.
+ * With size based rotation enabled, log lines are not written by the threads
+ * issuing the syscalls. Each thread appends its lines to its own ring buffer
+ * instead, and a writer thread, started with a raw clone syscall, moves them
+ * to the log file. The writer also rotates the log file once it grows
+ * beyond log_max_bytes: log -> log.1 -> log.2 ... -> log.KEEP, the last one
+ * being overwritten.
+ *
+ * A ring has a single producer (the thread owning it) and a single consumer
+ * (whoever holds log_drain_lock), and is used without locking otherwise.
+ * Rings are kept in a list that only grows, the ring of an exited thread
+ * is reused by a new thread.
  */
-void
-intercept_setup_log(const char *path, const char *trunc)
+#define LOG_RING_SIZE 0x10000
+
+struct log_ring {
+	struct log_ring *next;
+	int in_use;
+	unsigned long dropped;
+
+	/* advanced by the owner thread */
+	unsigned long head;
+
+	/* advanced by the consumer */
+	unsigned long tail __attribute__((aligned(64)));
+
+	char data[LOG_RING_SIZE] __attribute__((aligned(64)));
+};
+
+static bool log_async;
+static bool log_rotate;
+static unsigned long log_max_bytes;
+static unsigned long log_keep = 1;
+static unsigned long log_size;
+static char log_path[PATH_MAX + 0x20];
+
+static struct log_ring *log_rings;
+static int log_drain_lock;
+static int log_wakeup;
+
+static __thread struct log_ring *own_ring
+	__attribute__((tls_model("initial-exec")));
+static __thread bool in_log_push
+	__attribute__((tls_model("initial-exec")));
+
+/*
+ * The writer thread shares the TLS area of the thread that started it, so
+ * the routines called from the writer must not use thread local variables.
+ */
+static void
+lock_drain(void)
 {
-	char full_path[PATH_MAX];
+	while (__atomic_exchange_n(&log_drain_lock, 1, __ATOMIC_ACQUIRE) != 0)
+		__builtin_ia32_pause();
+}
 
-	if (path == nullptr || path[0] == '\0')
+static void
+unlock_drain(void)
+{
+	__atomic_store_n(&log_drain_lock, 0, __ATOMIC_RELEASE);
+}
+
+static void
+write_log_file(const char *buffer, size_t len)
+{
+	if (log_fd < 0)
+		return;
+
+	write_all_no_intercept(log_fd, buffer, len);
+	log_size += len;
+}
+
+/*
+ * print_rotated_path - the path of the n-th old log file, n == 0 being
+ * the current one.
+ */
+static void
+print_rotated_path(char *dst, unsigned long n)
+{
+	dst = print_cstr(dst, log_path);
+	if (n != 0) {
+		dst = print_cstr(dst, ".");
+		*print_number(dst, n, 10, 0) = '\0';
+	}
+}
+
+/*
+ * follow_rotation - the log file can be shared with other processes, e.g.
+ * forked children, each of them rotating it once it grows too large. If
+ * the path no longer refers to the file written, it was rotated by another
+ * process, and the new file is opened. The size of the file is the one
+ * seen by all writers, not just the bytes written by this process.
+ * If the new file is not created yet, the old one is written until the
+ * next call.
+ */
+static void
+follow_rotation(void)
+{
+	struct stat path_stat;
+	struct stat fd_stat;
+
+	if (syscall_no_intercept(SYS_fstat, log_fd, &fd_stat) != 0)
+		return;
+
+	if (syscall_no_intercept(SYS_stat, log_path, &path_stat) == 0 &&
+	    (path_stat.st_dev != fd_stat.st_dev ||
+	    path_stat.st_ino != fd_stat.st_ino)) {
+		long fd = syscall_no_intercept(SYS_open, log_path,
+				O_RDWR | O_APPEND);
+		if (fd < 0)
+			return;
+
+		syscall_no_intercept(SYS_dup2, fd, log_fd);
+		syscall_no_intercept(SYS_close, fd);
+		fd_stat.st_size = path_stat.st_size;
+	}
+
+	log_size = (unsigned long)fd_stat.st_size;
+}
+
+/*
+ * rotate_log - shift the old log files, using rename, so each one of
+ * them is always present under some name, then start a new empty one.
+ */
+static void
+rotate_log(void)
+{
+	char from[sizeof(log_path) + 0x20];
+	char to[sizeof(log_path) + 0x20];
+
+	/* another process might have just rotated it */
+	follow_rotation();
+	if (log_size < log_max_bytes)
+		return;
+
+	for (unsigned long i = log_keep; i > 0; --i) {
+		print_rotated_path(from, i - 1);
+		print_rotated_path(to, i);
+		syscall_no_intercept(SYS_rename, from, to);
+	}
+
+	long fd = syscall_no_intercept(SYS_open, log_path,
+			O_CREAT | O_RDWR | O_APPEND | O_TRUNC, 0700);
+	if (fd < 0)
+		return; /* keep on writing the old one */
+
+	syscall_no_intercept(SYS_dup2, fd, log_fd);
+	syscall_no_intercept(SYS_close, fd);
+	log_size = 0;
+}
+
+static void
+drain_ring(struct log_ring *ring)
+{
+	unsigned long dropped =
+	    __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+	unsigned long tail = ring->tail;
+	unsigned long head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	if (head == tail && dropped == 0)
 		return;
 
-	char *c = full_path;
+	/* rotate only at line boundaries, i.e. between two rings */
+	if (log_rotate && log_size >= log_max_bytes)
+		rotate_log();
+
+	while (tail != head) {
+		size_t offset = tail % LOG_RING_SIZE;
+		size_t len = head - tail;
+
+		if (len > LOG_RING_SIZE - offset)
+			len = LOG_RING_SIZE - offset;
+
+		write_log_file(ring->data + offset, len);
+		tail += len;
+	}
+
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+	if (dropped != 0) {
+		char msg[0x80];
+		char *c = print_cstr(msg, "syscall_intercept: ");
+		c = print_number(c, dropped, 10, 0);
+		c = print_cstr(c, " log lines dropped\n");
+		write_log_file(msg, (size_t)(c - msg));
+	}
+}
+
+/* drain_rings - move all lines to the log, with log_drain_lock held */
+static void
+drain_rings(void)
+{
+	if (log_rotate && log_fd >= 0)
+		follow_rotation();
+
+	for (struct log_ring *ring =
+	    __atomic_load_n(&log_rings, __ATOMIC_ACQUIRE);
+	    ring != nullptr; ring = ring->next)
+		drain_ring(ring);
+}
+
+static void
+drain_log(void)
+{
+	lock_drain();
+	drain_rings();
+	unlock_drain();
+}
+
+static void
+log_writer(void *arg)
+{
+	(void) arg;
+
+	for (;;) {
+		struct timespec timeout = { .tv_nsec = 20000000 };
+
+		__atomic_store_n(&log_wakeup, 0, __ATOMIC_RELAXED);
+		drain_log();
+		syscall_no_intercept(SYS_futex, &log_wakeup,
+				FUTEX_WAIT_PRIVATE, 0, &timeout);
+	}
+}
+
+static void
+wake_writer(void)
+{
+	if (__atomic_exchange_n(&log_wakeup, 1, __ATOMIC_RELEASE) == 0)
+		syscall_no_intercept(SYS_futex, &log_wakeup,
+				FUTEX_WAKE_PRIVATE, 1);
+}
+
+static struct log_ring *
+get_own_ring(void)
+{
+	if (own_ring != nullptr)
+		return own_ring;
+
+	struct log_ring *ring = __atomic_load_n(&log_rings, __ATOMIC_ACQUIRE);
+
+	for (; ring != nullptr; ring = ring->next) {
+		int unused = 0;
+
+		if (__atomic_compare_exchange_n(&ring->in_use, &unused, 1,
+		    false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return own_ring = ring;
+	}
+
+	ring = xmmap_anon(sizeof(*ring));
+	ring->in_use = 1;
+	ring->next = __atomic_load_n(&log_rings, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&log_rings, &ring->next, ring,
+	    false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+
+	return own_ring = ring;
+}
+
+/*
+ * log_push - append a line to the ring of the current thread. If it does
+ * not fit, or the thread was interrupted by a signal handler while pushing
+ * a line already, the line is dropped, and only counted.
+ */
+static void
+log_push(const char *buffer, size_t len)
+{
+	struct log_ring *ring = get_own_ring();
+
+	unsigned long head = ring->head;
+	unsigned long used =
+	    head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	if (in_log_push || len > LOG_RING_SIZE - used) {
+		__atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+		wake_writer();
+		return;
+	}
+
+	in_log_push = true;
+
+	size_t offset = head % LOG_RING_SIZE;
+	size_t first = len;
+	if (first > LOG_RING_SIZE - offset)
+		first = LOG_RING_SIZE - offset;
+
+	memcpy(ring->data + offset, buffer, first);
+	memcpy(ring->data, buffer + first, len - first);
+	__atomic_store_n(&ring->head, head + len, __ATOMIC_RELEASE);
+
+	in_log_push = false;
+
+	/* the writer wakes up periodically anyways, unless it is urgent */
+	if (used + len >= LOG_RING_SIZE / 2)
+		wake_writer();
+}
+
+static void
+log_write(const char *buffer, size_t len)
+{
+	if (log_async)
+		log_push(buffer, len);
+	else
+		syscall_no_intercept(SYS_write, log_fd, buffer, len);
+}
+
+/*
+ * print_log_path - copy the path of the log to dst, a buffer of PATH_MAX
+ * bytes. If requested, the current processes pid number is attached to
+ * the path. Returns false if the path is too long, or the pid is not known.
+ */
+static bool
+print_log_path(char *dst, const char *path)
+{
+	char *c = dst;
 	while ((*c = *path) != '\0') {
+		if (c - dst >= PATH_MAX - 0x20)
+			return false;
 		c++;
 		path++;
 	}
@@ -819,20 +1129,192 @@ intercept_setup_log(const char *path, const char *trunc)
 		/* if the last char was '-', append the pid to the path */
 		long pid = syscall_no_intercept(SYS_getpid);
 		if (pid < 0)
-			return;
+			return false;
 
-		print_number(c, pid, 10, 0);
+		*print_number(c, pid, 10, 0) = '\0';
 	}
 
+	return true;
+}
+
+static int
+log_open_flags(const char *trunc)
+{
 	int flags = O_CREAT | O_RDWR | O_APPEND | O_TRUNC;
 	if (trunc && trunc[0] == '0')
 		flags &= ~O_TRUNC;
 
+	return flags;
+}
+
+/*
+ * intercept_setup_log
+ * Open (create) a log file. If requested, the current processes pid
+ * number is attached to the path.
+ */
+void
+intercept_setup_log(const char *path, const char *trunc)
+{
+	char full_path[PATH_MAX];
+
+	if (path == nullptr || path[0] == '\0')
+		return;
+
+	if (!print_log_path(full_path, path))
+		return;
+
 	intercept_log_close(); /* in case a log was already open */
 
-	log_fd = (int)syscall_no_intercept(SYS_open, full_path, flags, 0700);
+	if (log_async)
+		lock_drain();
+
+	log_fd = (int)syscall_no_intercept(SYS_open, full_path,
+			log_open_flags(trunc), 0700);
 
 	xabort_on_syserror(log_fd, "opening log");
+
+	print_cstr(log_path, full_path);
+	if (log_async) {
+		log_size = (unsigned long)xlseek(log_fd, 0, SEEK_END);
+		log_rotate = true;
+		unlock_drain();
+	}
+}
+
+/*
+ * intercept_log_reopen
+ * Start logging to another file while the program is running, or stop
+ * logging if path is nullptr. Other threads might be about to write to
+ * log_fd meanwhile, thus the descriptor is not closed, the new file is
+ * dup2'd over it instead, or /dev/null when logging stops, and its number
+ * is kept in log_idle_fd while logging is off. Returns zero, or an error
+ * number if the file can not be opened, leaving the log as it was.
+ */
+int
+intercept_log_reopen(const char *path, const char *trunc)
+{
+	char full_path[PATH_MAX];
+	long fd;
+
+	if (path == nullptr) {
+		if (log_fd < 0)
+			return 0;
+		fd = syscall_no_intercept(SYS_open, "/dev/null", O_WRONLY);
+	} else {
+		if (path[0] == '\0' || !print_log_path(full_path, path))
+			return EINVAL;
+		fd = syscall_no_intercept(SYS_open, full_path,
+				log_open_flags(trunc), 0700);
+	}
+
+	if (fd < 0)
+		return (int)-fd;
+
+	if (log_async) {
+		lock_drain();
+		drain_rings();
+	}
+
+	int target = (log_fd >= 0) ? log_fd : log_idle_fd;
+
+	if (target >= 0) {
+		syscall_no_intercept(SYS_dup2, fd, target);
+		syscall_no_intercept(SYS_close, fd);
+	} else {
+		target = (int)fd;
+	}
+
+	if (path == nullptr) {
+		log_idle_fd = target;
+		__atomic_store_n(&log_fd, -1, __ATOMIC_RELEASE);
+	} else {
+		long size = syscall_no_intercept(SYS_lseek, target, 0,
+				SEEK_END);
+
+		print_cstr(log_path, full_path);
+		log_size = (size > 0) ? (unsigned long)size : 0;
+		log_idle_fd = -1;
+		__atomic_store_n(&log_fd, target, __ATOMIC_RELEASE);
+	}
+
+	if (log_async)
+		unlock_drain();
+
+	return 0;
+}
+
+/*
+ * intercept_setup_log_rotation
+ * Enable rotating the log file once it reaches a size, and with that, the
+ * writer thread.
+ */
+void
+intercept_setup_log_rotation(const char *max_bytes, const char *keep)
+{
+	if (log_fd < 0 || max_bytes == nullptr)
+		return;
+
+	log_max_bytes = strtoul(max_bytes, nullptr, 0);
+	if (log_max_bytes == 0)
+		return;
+
+	if (keep != nullptr && keep[0] != '\0')
+		log_keep = strtoul(keep, nullptr, 0);
+
+	log_size = (unsigned long)xlseek(log_fd, 0, SEEK_END);
+	log_rotate = true;
+	log_async = true;
+
+	start_thread_no_intercept(log_writer, nullptr);
+}
+
+/*
+ * intercept_log_after_fork
+ * Called in a new child process. The writer thread does not exist in the
+ * child, and the lines in the rings are written by the parent. The child
+ * appends to the log inherited, and takes part in rotating it, following
+ * the path of the log, see follow_rotation.
+ */
+void
+intercept_log_after_fork(void)
+{
+	if (!log_async)
+		return;
+
+	log_drain_lock = 0;
+
+	for (struct log_ring *ring = log_rings; ring != nullptr;
+	    ring = ring->next) {
+		ring->tail = ring->head;
+		ring->dropped = 0;
+		ring->in_use = (ring == own_ring);
+	}
+
+	start_thread_no_intercept(log_writer, nullptr);
+}
+
+/*
+ * intercept_log_thread_exit
+ * Called before a thread exits, its ring can be reused by another thread.
+ */
+void
+intercept_log_thread_exit(void)
+{
+	if (own_ring != nullptr) {
+		__atomic_store_n(&own_ring->in_use, 0, __ATOMIC_RELEASE);
+		own_ring = nullptr;
+	}
+}
+
+/*
+ * intercept_log_flush
+ * Write out the lines buffered, before the process exits.
+ */
+void
+intercept_log_flush(void)
+{
+	if (log_async)
+		drain_log();
 }
 
 static char *
@@ -847,6 +1329,34 @@ print_return_value(char *c, enum return_type type, long value)
 	return return_value_printer_table[type](c, value);
 }
 
+/*
+ * intercept_print_syscall_arg
+ * Print a single argument of a syscall, the same way it is printed in the
+ * log. Used by other output formats, that need the arguments one by one.
+ */
+char *
+intercept_print_syscall_arg(char *c, const struct syscall_desc *desc, int i,
+			enum intercept_log_result result_known, long result)
+{
+	const struct syscall_format *format = get_syscall_format(desc);
+	arg_printer_func func = arg_printer_func_table[format->args[i]];
+
+	return func(c, desc, i, result_known, result);
+}
+
+/*
+ * intercept_print_syscall_result
+ * Print the return value of a syscall, the same way it is printed in the log.
+ */
+char *
+intercept_print_syscall_result(char *c, const struct syscall_desc *desc,
+			long result)
+{
+	const struct syscall_format *format = get_syscall_format(desc);
+
+	return print_return_value(c, format->return_type, result);
+}
+
 static char *
 print_syscall(char *c, const struct syscall_desc *desc,
 			enum intercept_log_result result_known, long result)
@@ -888,20 +1398,23 @@ print_syscall(char *c, const struct syscall_desc *desc,
  * Log syscalls after intercepting, in a human readable ( as much as possible )
  * format. The format is either:
  *
- * offset -- name(arguments...) = result
+ * path(symbol) offset -- name(arguments...) = result
  *
  * where the name is known, or
  *
- * offset -- syscall(syscall_number, arguments...) = result
+ * path(symbol) offset -- syscall(syscall_number, arguments...) = result
  *
  * where the name is not known.
  *
- * Each line starts with the offset of the syscall instruction in libc's ELF.
- * This should be easy to pass to addr2line, to see in what symbol in libc
- * the syscall was initiated.
+ * Each line starts with the path of the object containing the syscall
+ * instruction, the function containing it with the offset of the
+ * instruction in the function, and the offset of the syscall instruction
+ * in the object's ELF file. The function is resolved from the symbol
+ * tables while the object is analyzed, and is omitted (along with the
+ * parentheses) if no symbol covers the syscall instruction.
  *
  * E.g.:
- * 0xdaea2 -- fstat(1, 0x7ffd115206f0) = 0
+ * /lib/libc.so.6(__fstat64+0x12) 0xdaea2 -- fstat(1, 0x7ffd115206f0) = 0
  *
  * Each syscall should be logged after being executed, so the result can be
  * logged as well.
@@ -917,8 +1430,13 @@ intercept_log_syscall(const struct patch_desc *patch,
 	char buffer[0x1000];
 	char *c = buffer;
 
-	/* prefix: "/lib/libc.so 0x1234 -- " */
+	/* prefix: "/lib/libc.so(read+0x10) 0x1234 -- " */
 	c = print_cstr(c, patch->containing_lib_path);
+	if (patch->symbol != nullptr) {
+		c = print_cstr(c, "(");
+		c = print_cstr(c, patch->symbol);
+		c = print_cstr(c, ")");
+	}
 	c = print_cstr(c, " ");
 	c = print_hex(c, patch->syscall_offset);
 	c = print_cstr(c, " -- ");
@@ -927,7 +1445,7 @@ intercept_log_syscall(const struct patch_desc *patch,
 
 	*c++ = '\n';
 
-	syscall_no_intercept(SYS_write, log_fd, buffer, c - buffer);
+	log_write(buffer, (size_t)(c - buffer));
 }
 
 /*
@@ -939,7 +1457,25 @@ void
 intercept_log(const char *buffer, size_t len)
 {
 	if (log_fd >= 0)
-		syscall_no_intercept(SYS_write, log_fd, buffer, len);
+		log_write(buffer, len);
+}
+
+/*
+ * intercept_log_direct
+ * Write a buffer straight to the log file, bypassing the ring of the
+ * calling thread. Does not use thread local variables, thus can be called
+ * from the threads started by start_thread_no_intercept.
+ */
+void
+intercept_log_direct(const char *buffer, size_t len)
+{
+	if (log_async) {
+		lock_drain();
+		write_log_file(buffer, len);
+		unlock_drain();
+	} else if (log_fd >= 0) {
+		write_all_no_intercept(log_fd, buffer, len);
+	}
 }
 
 /*
@@ -949,8 +1485,21 @@ intercept_log(const char *buffer, size_t len)
 void
 intercept_log_close(void)
 {
+	if (log_async) {
+		lock_drain();
+		drain_rings();
+	}
+
 	if (log_fd >= 0) {
 		syscall_no_intercept(SYS_close, log_fd);
 		log_fd = -1;
 	}
+
+	if (log_idle_fd >= 0) {
+		syscall_no_intercept(SYS_close, log_idle_fd);
+		log_idle_fd = -1;
+	}
+
+	if (log_async)
+		unlock_drain();
 }
@@ -39,7 +39,13 @@ struct patch_desc;
 struct syscall_desc;
 
 void intercept_setup_log(const char *path_base, const char *trunc);
+int intercept_log_reopen(const char *path, const char *trunc);
+void intercept_setup_log_rotation(const char *max_bytes, const char *keep);
+void intercept_log_after_fork(void);
+void intercept_log_thread_exit(void);
+void intercept_log_flush(void);
 void intercept_log(const char *buffer, size_t len);
+void intercept_log_direct(const char *buffer, size_t len);
 
 enum intercept_log_result { KNOWN, UNKNOWN };
 
@@ -48,6 +54,15 @@ void intercept_log_syscall(const struct patch_desc *,
 				enum intercept_log_result result_known,
 				long result);
 
+char *intercept_print_syscall_arg(char *buffer, const struct syscall_desc *,
+				int arg_index,
+				enum intercept_log_result result_known,
+				long result);
+
+char *intercept_print_syscall_result(char *buffer,
+				const struct syscall_desc *,
+				long result);
+
 void intercept_log_close(void);
 
 #endif
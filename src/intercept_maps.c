@@ -0,0 +1,335 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_maps.c - a cached copy of /proc/self/maps.
+ *
+ * The file is read once using raw syscalls into a buffer, and parsed into
+ * an array of intervals. The kernel lists the mappings in address order,
+ * so the array is sorted, and lookups are binary searches. The paths in
+ * the entries point into the buffer holding the file.
+ *
+ * The cache is only invalidated after mapping memory in a place chosen
+ * based on it. Other changes in the memory map, e.g. buffers allocated
+ * with xmmap_anon, are not tracked: anything found using the cache is
+ * verified anyways, e.g. by mapping with MAP_FIXED_NOREPLACE.
+ */
+
+#include "intercept_maps.h"
+#include "intercept.h"
+#include "intercept_util.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <syscall.h>
+
+static char *text;
+static size_t text_size;
+
+static struct maps_entry *entries;
+static size_t entries_size;
+static size_t entry_count;
+
+static bool loaded;
+
+/*
+ * read_maps - read the whole maps file into the text buffer, null
+ * terminated.
+ */
+static bool
+read_maps(void)
+{
+	long fd = syscall_no_intercept(SYS_open, "/proc/self/maps", O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	size_t len = 0;
+
+	text_size = 0x10000;
+	text = xmmap_anon(text_size);
+
+	for (;;) {
+		if (len == text_size - 1) {
+			text = xmremap(text, text_size, text_size * 2);
+			text_size *= 2;
+		}
+
+		long r = syscall_no_intercept(SYS_read, fd,
+				text + len, text_size - 1 - len);
+
+		if (r == 0)
+			break;
+
+		if (r < 0) {
+			syscall_no_intercept(SYS_close, fd);
+			xmunmap(text, text_size);
+			text = nullptr;
+			return false;
+		}
+
+		len += (size_t)r;
+	}
+
+	syscall_no_intercept(SYS_close, fd);
+	text[len] = '\0';
+
+	return true;
+}
+
+static char *
+parse_hex(char *c, uintptr_t *value)
+{
+	*value = 0;
+
+	for (;;) {
+		if (*c >= '0' && *c <= '9')
+			*value = *value * 16 + (uintptr_t)(*c - '0');
+		else if (*c >= 'a' && *c <= 'f')
+			*value = *value * 16 + (uintptr_t)(*c - 'a' + 10);
+		else
+			return c;
+		++c;
+	}
+}
+
+static char *
+skip_field(char *c)
+{
+	while (*c != ' ' && *c != '\n' && *c != '\0')
+		++c;
+	while (*c == ' ')
+		++c;
+
+	return c;
+}
+
+/*
+ * parse_maps - fill the entries array, each line of the maps file looks
+ * like:
+ * 7f1c2a000000-7f1c2a022000 r--p 00000000 08:01 1234   /lib/libc.so.6
+ *
+ * The newline character at the end of each line is replaced with a null
+ * character, to terminate the path.
+ */
+static void
+parse_maps(void)
+{
+	size_t lines = 0;
+
+	for (const char *c = text; *c != '\0'; ++c) {
+		if (*c == '\n')
+			++lines;
+	}
+
+	entries_size = (lines + 1) * sizeof(entries[0]);
+	entries = xmmap_anon(entries_size);
+	entry_count = 0;
+
+	char *c = text;
+	while (*c != '\0') {
+		struct maps_entry *entry = entries + entry_count;
+
+		c = parse_hex(c, &entry->start);
+		if (*c != '-')
+			break;
+		c = parse_hex(c + 1, &entry->end);
+
+		/* skip the permissions, offset, device, and inode fields */
+		while (*c == ' ')
+			++c;
+		for (int i = 0; i < 4; ++i)
+			c = skip_field(c);
+
+		entry->path = (*c != '\n' && *c != '\0') ? c : nullptr;
+
+		while (*c != '\n' && *c != '\0')
+			++c;
+		if (*c == '\n')
+			*c++ = '\0';
+
+		++entry_count;
+	}
+}
+
+static bool
+load(void)
+{
+	if (loaded)
+		return true;
+
+	if (!read_maps())
+		return false;
+
+	parse_maps();
+	loaded = true;
+
+	return true;
+}
+
+/*
+ * first_entry_ending_after - index of the first entry with an end above
+ * addr, entry_count if there is no such entry.
+ */
+static size_t
+first_entry_ending_after(uintptr_t addr)
+{
+	size_t low = 0;
+	size_t high = entry_count;
+
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+
+		if (entries[middle].end <= addr)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return low;
+}
+
+const struct maps_entry *
+intercept_maps_lookup(uintptr_t addr)
+{
+	if (!load())
+		return nullptr;
+
+	size_t i = first_entry_ending_after(addr);
+
+	if (i == entry_count || entries[i].start > addr)
+		return nullptr;
+
+	return entries + i;
+}
+
+uintptr_t
+intercept_maps_find_hole(uintptr_t low, uintptr_t high, size_t size)
+{
+	if (!load())
+		return 0;
+
+	uintptr_t candidate = low;
+
+	for (size_t i = first_entry_ending_after(low); i < entry_count; ++i) {
+		if (candidate >= high || high - candidate < size)
+			return 0;
+
+		if (entries[i].start >= candidate &&
+		    entries[i].start - candidate >= size)
+			return candidate;
+
+		if (entries[i].end > candidate)
+			candidate = entries[i].end;
+	}
+
+	if (candidate >= high || high - candidate < size)
+		return 0;
+
+	return candidate;
+}
+
+void
+intercept_maps_invalidate(void)
+{
+	if (!loaded)
+		return;
+
+	xmunmap(entries, entries_size);
+	xmunmap(text, text_size);
+	entries = nullptr;
+	text = nullptr;
+	entry_count = 0;
+	loaded = false;
+}
+
+/*
+ * intercept_maps_find_range - unlike the lookups above, this reads the maps
+ * file on every call, parsing it while reading, into a buffer on the stack.
+ */
+bool
+intercept_maps_find_range(uintptr_t addr, uintptr_t *start, uintptr_t *end)
+{
+	long fd = syscall_no_intercept(SYS_open, "/proc/self/maps", O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	char buffer[0x400];
+	uintptr_t values[2] = {0, 0};
+	int field = 0; /* 0: start, 1: end, 2: the rest of the line */
+	bool found = false;
+	bool done = false;
+
+	while (!done) {
+		long r = syscall_no_intercept(SYS_read, fd,
+				buffer, sizeof(buffer));
+
+		if (r <= 0)
+			break;
+
+		for (long i = 0; i < r && !done; ++i) {
+			char c = buffer[i];
+			uintptr_t digit;
+
+			if (c >= '0' && c <= '9')
+				digit = (uintptr_t)(c - '0');
+			else if (c >= 'a' && c <= 'f')
+				digit = (uintptr_t)(c - 'a' + 10);
+			else
+				digit = 16;
+
+			if (field < 2 && digit < 16) {
+				values[field] = values[field] * 16 + digit;
+			} else if (field == 0) {
+				field = (c == '-') ? 1 : 2;
+			} else if (field == 1) {
+				field = 2;
+				if (values[0] > addr) {
+					/* the lines are in address order */
+					done = true;
+				} else if (addr < values[1]) {
+					*start = values[0];
+					*end = values[1];
+					found = true;
+					done = true;
+				}
+			} else if (c == '\n') {
+				field = 0;
+				values[0] = 0;
+				values[1] = 0;
+			}
+		}
+	}
+
+	syscall_no_intercept(SYS_close, fd);
+
+	return found;
+}
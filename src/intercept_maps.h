@@ -0,0 +1,85 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_maps.h - a cached copy of /proc/self/maps, used while looking
+ * for the objects to patch, and for place for the trampoline tables.
+ */
+
+#ifndef INTERCEPT_MAPS_H
+#define INTERCEPT_MAPS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct maps_entry {
+	uintptr_t start;
+	uintptr_t end;
+
+	/* the path of the file mapped, nullptr for anonymous mappings */
+	const char *path;
+};
+
+/*
+ * intercept_maps_lookup - find the mapping containing addr. The maps file
+ * is read on the first lookup after the cache is invalidated, the rest
+ * of the lookups are binary searches. The entry returned is only valid
+ * until the cache is invalidated. Returns nullptr if no mapping contains
+ * addr, or the maps file could not be read.
+ * Not thread safe, meant to be used while patching.
+ */
+const struct maps_entry *intercept_maps_lookup(uintptr_t addr);
+
+/*
+ * intercept_maps_find_hole - find the lowest address in [low, high) where
+ * size bytes are not mapped, according to the cache. Returns zero if no
+ * such address is found.
+ */
+uintptr_t intercept_maps_find_hole(uintptr_t low, uintptr_t high,
+				size_t size);
+
+/*
+ * intercept_maps_invalidate - drop the cache, to be called after changing
+ * the memory map of the process.
+ */
+void intercept_maps_invalidate(void);
+
+/*
+ * intercept_maps_find_range - find the bounds of the mapping containing
+ * addr, without using the cache, thus it can be called from any thread,
+ * at any time. Returns false if no mapping contains addr.
+ */
+bool intercept_maps_find_range(uintptr_t addr, uintptr_t *start,
+				uintptr_t *end);
+
+#endif
@@ -0,0 +1,249 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_observe.c - observer mode.
+ *
+ * A hook that only observes syscalls adds its own running time to each
+ * syscall. In observer mode, intercept_routine instead copies the syscall
+ * into a fixed size event, appended to a ring buffer of the thread issuing
+ * it, and the events are handed to an observer callback later, by a thread
+ * of the program calling syscall_intercept_drain_events.
+ *
+ * Like the rings of the log writer (see intercept_log.c), a ring has a
+ * single producer, the thread owning it, and a single consumer, whoever
+ * holds drain_lock, and is used without locking otherwise. Rings are kept
+ * in a list that only grows, the ring of an exited thread is reused by a
+ * new thread.
+ */
+
+#include "intercept_observe.h"
+#include "intercept.h"
+#include "intercept_util.h"
+#include "libsyscall_intercept_hook_point.h"
+
+#include <stddef.h>
+#include <syscall.h>
+
+/* The number of events a ring can hold, a power of two */
+#define OBSERVE_RING_EVENTS 0x400
+
+struct event_ring {
+	struct event_ring *next;
+	int in_use;
+	unsigned long dropped;
+
+	/* advanced by the owner thread */
+	unsigned long head;
+
+	/* advanced by the consumer */
+	unsigned long tail __attribute__((aligned(64)));
+
+	struct syscall_intercept_event events[OBSERVE_RING_EVENTS]
+	    __attribute__((aligned(64)));
+};
+
+bool intercept_observe_on;
+
+static struct event_ring *event_rings;
+static int drain_lock;
+
+static __thread struct event_ring *own_ring
+	__attribute__((tls_model("initial-exec")));
+static __thread int own_tid
+	__attribute__((tls_model("initial-exec")));
+static __thread bool in_push
+	__attribute__((tls_model("initial-exec")));
+
+static struct event_ring *
+get_own_ring(void)
+{
+	if (own_ring != nullptr)
+		return own_ring;
+
+	own_tid = (int)syscall_no_intercept(SYS_gettid);
+
+	struct event_ring *ring =
+	    __atomic_load_n(&event_rings, __ATOMIC_ACQUIRE);
+
+	for (; ring != nullptr; ring = ring->next) {
+		int unused = 0;
+
+		if (__atomic_compare_exchange_n(&ring->in_use, &unused, 1,
+		    false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return own_ring = ring;
+	}
+
+	ring = xmmap_anon(sizeof(*ring));
+	ring->in_use = 1;
+	ring->next = __atomic_load_n(&event_rings, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&event_rings, &ring->next, ring,
+	    false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+
+	return own_ring = ring;
+}
+
+/*
+ * intercept_observe_event
+ * A signal handler interrupting the thread while it is pushing an event
+ * could push to the same ring, thus its events are dropped instead.
+ */
+void
+intercept_observe_event(const struct patch_desc *patch,
+			const struct syscall_desc *desc,
+			unsigned long long start_ns, long result)
+{
+	struct event_ring *ring = get_own_ring();
+	unsigned long head = ring->head;
+
+	if (in_push || head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)
+	    == OBSERVE_RING_EVENTS) {
+		__atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	in_push = true;
+
+	struct syscall_intercept_event *event =
+	    ring->events + (head % OBSERVE_RING_EVENTS);
+
+	event->syscall_number = desc->nr;
+	for (int i = 0; i < 6; ++i)
+		event->args[i] = desc->args[i];
+	event->result = result;
+	event->site = patch->syscall_addr;
+	event->symbol = patch->symbol;
+	event->start_ns = start_ns;
+	event->end_ns = clock_ns_no_intercept();
+	event->tid = own_tid;
+
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+	in_push = false;
+}
+
+void
+intercept_observe_thread_exit(void)
+{
+	if (own_ring != nullptr) {
+		__atomic_store_n(&own_ring->in_use, 0, __ATOMIC_RELEASE);
+		own_ring = nullptr;
+	}
+}
+
+void
+intercept_observe_after_fork(void)
+{
+	drain_lock = 0;
+
+	for (struct event_ring *ring = event_rings; ring != nullptr;
+	    ring = ring->next) {
+		if (ring == own_ring)
+			continue;
+
+		ring->tail = ring->head;
+		ring->dropped = 0;
+		ring->in_use = 0;
+	}
+
+	if (own_ring != nullptr)
+		own_tid = (int)syscall_no_intercept(SYS_gettid);
+}
+
+/*
+ * syscall_intercept_observe - part of the public API, see the
+ * libsyscall_intercept_hook_point.h header file.
+ */
+__attribute__((visibility("default"))) int
+syscall_intercept_observe(int enabled)
+{
+	bool was_enabled = __atomic_exchange_n(&intercept_observe_on,
+				enabled != 0, __ATOMIC_RELAXED);
+
+	return was_enabled;
+}
+
+/*
+ * syscall_intercept_drain_events - part of the public API, see the
+ * libsyscall_intercept_hook_point.h header file.
+ */
+__attribute__((visibility("default"))) size_t
+syscall_intercept_drain_events(
+	void (*observer)(const struct syscall_intercept_event *, void *arg),
+	void *arg)
+{
+	size_t count = 0;
+
+	if (__atomic_exchange_n(&drain_lock, 1, __ATOMIC_ACQUIRE) != 0)
+		return 0;
+
+	for (struct event_ring *ring =
+	    __atomic_load_n(&event_rings, __ATOMIC_ACQUIRE);
+	    ring != nullptr; ring = ring->next) {
+		unsigned long tail = ring->tail;
+		unsigned long head =
+		    __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+		/*
+		 * The tail is advanced after each event, the observer
+		 * issuing syscalls might need space in its own ring.
+		 */
+		for (; tail != head; ++tail, ++count) {
+			observer(ring->events + (tail % OBSERVE_RING_EVENTS),
+			    arg);
+			__atomic_store_n(&ring->tail, tail + 1,
+			    __ATOMIC_RELEASE);
+		}
+	}
+
+	__atomic_store_n(&drain_lock, 0, __ATOMIC_RELEASE);
+
+	return count;
+}
+
+/*
+ * syscall_intercept_events_dropped - part of the public API, see the
+ * libsyscall_intercept_hook_point.h header file.
+ */
+__attribute__((visibility("default"))) unsigned long
+syscall_intercept_events_dropped(void)
+{
+	unsigned long dropped = 0;
+
+	for (struct event_ring *ring =
+	    __atomic_load_n(&event_rings, __ATOMIC_ACQUIRE);
+	    ring != nullptr; ring = ring->next)
+		dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+
+	return dropped;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_observe.h - observer mode, syscalls recorded as events in
+ * per-thread rings, delivered later by syscall_intercept_drain_events.
+ */
+
+#ifndef INTERCEPT_OBSERVE_H
+#define INTERCEPT_OBSERVE_H
+
+struct patch_desc;
+struct syscall_desc;
+
+/* Is observer mode on? Checked before calling any other routine here. */
+extern bool intercept_observe_on;
+
+/*
+ * intercept_observe_event - append an event to the ring of the current
+ * thread, for a syscall started at start_ns, and finished now. The event
+ * is dropped if the ring is full.
+ */
+void intercept_observe_event(const struct patch_desc *,
+			const struct syscall_desc *,
+			unsigned long long start_ns, long result);
+
+/*
+ * intercept_observe_thread_exit - called before a thread exits, its ring
+ * can be reused by another thread, once the events in it are drained.
+ */
+void intercept_observe_thread_exit(void);
+
+/*
+ * intercept_observe_after_fork - called in a new child process, the events
+ * of the other threads of the parent are not delivered in the child.
+ */
+void intercept_observe_after_fork(void);
+
+#endif
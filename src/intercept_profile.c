@@ -0,0 +1,422 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_profile.c - a sampling profiler for syscall sites.
+ *
+ * The asm wrapper saves the registers seen at the syscall instruction, which
+ * is enough to walk the frame pointer chain of the code issuing the syscall.
+ * A sampled stack is identified by a hash of its return addresses, and is
+ * counted in a fixed size open addressing hash table, that is updated only
+ * using atomic operations, thus it can be used from any thread without locks.
+ *
+ * The output is written when the process exits, in the folded stack format
+ * understood by flame graph tools (e.g. flamegraph.pl, speedscope):
+ *
+ * main;do_work;fwrite;__GI___libc_write;write 42
+ */
+
+#include "intercept_profile.h"
+#include "intercept.h"
+#include "intercept_maps.h"
+#include "intercept_util.h"
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+/* The number of return addresses stored per stack */
+#define PROFILE_MAX_DEPTH 32
+
+/* The number of different stacks that can be counted, a power of two */
+#define PROFILE_TABLE_SIZE 0x2000
+
+/* How many slots to look at in the table before giving up */
+#define PROFILE_MAX_PROBES 0x40
+
+struct profile_entry {
+	/* hash of the frames, zero means an unused entry */
+	unsigned long id;
+
+	/* set after the frames are stored */
+	bool ready;
+
+	unsigned depth;
+	const void *frames[PROFILE_MAX_DEPTH];
+
+	unsigned long count;
+	unsigned long long ns;
+};
+
+bool intercept_profile_on;
+
+static struct profile_entry *table;
+static unsigned long dropped_samples;
+
+/* set by the "profile off" command, see intercept_control.c */
+static bool paused;
+
+static unsigned long sample_every = 1;
+static unsigned long long sample_period_ns;
+static bool weight_is_time;
+static char profile_path[PATH_MAX];
+
+static __thread unsigned long countdown
+	__attribute__((tls_model("initial-exec")));
+static __thread unsigned long long last_sample_ns
+	__attribute__((tls_model("initial-exec")));
+
+/*
+ * The bounds of the mapping holding the stack of the thread, found in the
+ * maps file on the first sample taken, and again whenever the stack pointer
+ * is outside of it, e.g. on a signal stack, or in a coroutine. A frame
+ * pointer is only followed within these bounds, thus the stack walker never
+ * reads unmapped memory, when a register used as frame pointer holds
+ * something else.
+ */
+static __thread uintptr_t stack_low
+	__attribute__((tls_model("initial-exec")));
+static __thread uintptr_t stack_high
+	__attribute__((tls_model("initial-exec")));
+
+/*
+ * intercept_setup_profile
+ * Enable the profiler if a path is specified for the output. The sampling
+ * period is either a syscall count, or a time in microseconds.
+ */
+void
+intercept_setup_profile(const char *path, const char *every,
+			const char *period_us, const char *weight)
+{
+	if (path == nullptr || path[0] == '\0')
+		return;
+
+	if (strlen(path) >= sizeof(profile_path))
+		xabort("INTERCEPT_PROFILE path too long");
+
+	strcpy(profile_path, path);
+
+	if (every != nullptr && atol(every) > 0)
+		sample_every = (unsigned long)atol(every);
+
+	if (period_us != nullptr && atol(period_us) > 0)
+		sample_period_ns = (unsigned long long)atol(period_us) * 1000;
+
+	weight_is_time = (weight != nullptr && strcmp(weight, "time") == 0);
+
+	table = xmmap_anon(PROFILE_TABLE_SIZE * sizeof(table[0]));
+	intercept_profile_on = true;
+}
+
+bool
+intercept_profile_should_sample(void)
+{
+	if (__atomic_load_n(&paused, __ATOMIC_RELAXED))
+		return false;
+
+	if (sample_period_ns != 0) {
+		unsigned long long now = clock_ns_no_intercept();
+
+		if (now - last_sample_ns < sample_period_ns)
+			return false;
+
+		last_sample_ns = now;
+		return true;
+	}
+
+	if (countdown > 1) {
+		--countdown;
+		return false;
+	}
+
+	countdown = sample_every;
+	return true;
+}
+
+/*
+ * is_frame_pointer - validate a frame pointer before reading through it.
+ * The frame must be above the previous one (or above the stack pointer),
+ * below the end of the stack mapping, and 16 byte aligned as the ABI
+ * requires at the push of rbp in a prologue.
+ */
+static bool
+is_frame_pointer(uintptr_t fp, uintptr_t low, uintptr_t high)
+{
+	return fp >= low && fp <= high - 2 * sizeof(uintptr_t) &&
+		(fp % 16) == 0;
+}
+
+/*
+ * capture_stack - the syscall site, followed by return addresses found
+ * by walking the frame pointer chain starting at rbp. If rbp does not look
+ * like a frame pointer (e.g. libc code built without frame pointers), the
+ * only other frame recorded is the return address at the top of the stack,
+ * which is the caller of the syscall wrapper function in most of libc.
+ */
+static unsigned
+capture_stack(const void **frames, const struct patch_desc *patch,
+		uintptr_t fp, uintptr_t sp)
+{
+	unsigned depth = 0;
+	uintptr_t low = sp;
+
+	frames[depth++] = patch->syscall_addr;
+
+	if (sp < stack_low || sp >= stack_high) {
+		if (!intercept_maps_find_range(sp, &stack_low, &stack_high)) {
+			stack_low = 0;
+			stack_high = 0;
+			fp = 0;
+		}
+	}
+
+	uintptr_t high = stack_high;
+
+	while (depth < PROFILE_MAX_DEPTH && is_frame_pointer(fp, low, high)) {
+		const uintptr_t *frame = (const uintptr_t *)fp;
+
+		if (frame[1] == 0)
+			break;
+
+		frames[depth++] = (const void *)frame[1];
+		low = fp + 2 * sizeof(uintptr_t);
+		fp = frame[0];
+	}
+
+	if (depth == 1)
+		frames[depth++] = *(const void *const *)sp;
+
+	return depth;
+}
+
+/*
+ * hash_frames - FNV-1a over the addresses, never returning zero, as that
+ * marks an unused entry in the table.
+ */
+static unsigned long
+hash_frames(const void **frames, unsigned depth)
+{
+	unsigned long hash = 0xcbf29ce484222325UL;
+
+	for (unsigned i = 0; i < depth; ++i) {
+		hash ^= (uintptr_t)frames[i];
+		hash *= 0x100000001b3UL;
+	}
+
+	return hash | 1;
+}
+
+static struct profile_entry *
+find_entry(unsigned long id, const void **frames, unsigned depth)
+{
+	for (unsigned i = 0; i < PROFILE_MAX_PROBES; ++i) {
+		struct profile_entry *entry =
+		    table + ((id + i) & (PROFILE_TABLE_SIZE - 1));
+		unsigned long current =
+		    __atomic_load_n(&entry->id, __ATOMIC_ACQUIRE);
+
+		if (current == 0) {
+			if (__atomic_compare_exchange_n(&entry->id, &current,
+			    id, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				entry->depth = depth;
+				memcpy(entry->frames, frames,
+				    depth * sizeof(frames[0]));
+				__atomic_store_n(&entry->ready, true,
+				    __ATOMIC_RELEASE);
+				return entry;
+			}
+			/* lost the race, current contains the new id */
+		}
+
+		if (current == id)
+			return entry;
+	}
+
+	return nullptr;
+}
+
+struct profile_entry *
+intercept_profile_sample(const struct patch_desc *patch,
+			unsigned long rbp, unsigned long rsp)
+{
+	const void *frames[PROFILE_MAX_DEPTH];
+	unsigned depth = capture_stack(frames, patch, rbp, rsp);
+	unsigned long id = hash_frames(frames, depth);
+	struct profile_entry *entry = find_entry(id, frames, depth);
+
+	if (entry == nullptr) {
+		__atomic_fetch_add(&dropped_samples, 1, __ATOMIC_RELAXED);
+		return nullptr;
+	}
+
+	__atomic_fetch_add(&entry->count, 1, __ATOMIC_RELAXED);
+
+	return entry;
+}
+
+void
+intercept_profile_add_time(struct profile_entry *entry, unsigned long long ns)
+{
+	if (entry != nullptr)
+		__atomic_fetch_add(&entry->ns, ns, __ATOMIC_RELAXED);
+}
+
+/*
+ * print_frame - symbolize an address for the folded output. Return
+ * addresses are looked up one byte before the address, as a call can be
+ * the last instruction of a function. Frames without a symbol are printed
+ * as an offset in the object containing them.
+ */
+static int
+print_frame(char *dst, size_t size, const void *addr, bool is_return_addr)
+{
+	Dl_info info;
+	const char *lookup = (const char *)addr - (is_return_addr ? 1 : 0);
+
+	if (dladdr(lookup, &info) == 0 || info.dli_fname == nullptr)
+		return snprintf(dst, size, "[unknown]");
+
+	if (info.dli_sname != nullptr)
+		return snprintf(dst, size, "%s", info.dli_sname);
+
+	const char *name = strrchr(info.dli_fname, '/');
+	name = (name == nullptr) ? info.dli_fname : name + 1;
+
+	return snprintf(dst, size, "%s+0x%lx", name,
+	    (unsigned long)((const char *)addr - (const char *)info.dli_fbase));
+}
+
+/*
+ * print_stack - one line of folded output, the root of the stack first,
+ * the syscall site last.
+ */
+static size_t
+print_stack(char *line, size_t size, const struct profile_entry *entry)
+{
+	size_t len = 0;
+
+	for (unsigned i = entry->depth; i > 0 && len < size; --i) {
+		if (i != entry->depth)
+			line[len++] = ';';
+
+		int n = print_frame(line + len, size - len,
+			entry->frames[i - 1], i > 1);
+		if (n > 0)
+			len += (size_t)n;
+	}
+
+	if (len >= size)
+		len = size - 1;
+
+	return len;
+}
+
+void
+intercept_profile_pause(bool pause)
+{
+	__atomic_store_n(&paused, pause, __ATOMIC_RELAXED);
+}
+
+/*
+ * intercept_profile_reset
+ * The stacks already in the table stay there, other threads might be
+ * adding to their counts at the same time.
+ */
+void
+intercept_profile_reset(void)
+{
+	if (!intercept_profile_on)
+		return;
+
+	for (size_t i = 0; i < PROFILE_TABLE_SIZE; ++i) {
+		__atomic_store_n(&table[i].count, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&table[i].ns, 0, __ATOMIC_RELAXED);
+	}
+
+	__atomic_store_n(&dropped_samples, 0, __ATOMIC_RELAXED);
+}
+
+void
+intercept_profile_dump(void)
+{
+	char path[sizeof(profile_path) + 0x20];
+	size_t path_len = strlen(profile_path);
+
+	if (!intercept_profile_on)
+		return;
+
+	/* if the last char is '-', append the pid of the exiting process */
+	if (profile_path[path_len - 1] == '-')
+		snprintf(path, sizeof(path), "%s%ld", profile_path,
+		    syscall_no_intercept(SYS_getpid));
+	else
+		strcpy(path, profile_path);
+
+	long fd = syscall_no_intercept(SYS_open, path,
+				O_CREAT | O_WRONLY | O_TRUNC, 0600);
+	if (fd < 0)
+		return;
+
+	char line[0x2000];
+
+	for (size_t i = 0; i < PROFILE_TABLE_SIZE; ++i) {
+		const struct profile_entry *entry = table + i;
+
+		if (!__atomic_load_n(&entry->ready, __ATOMIC_ACQUIRE))
+			continue;
+
+		size_t len = print_stack(line, sizeof(line) - 0x20, entry);
+
+		unsigned long long value = weight_is_time ?
+		    __atomic_load_n(&entry->ns, __ATOMIC_RELAXED) :
+		    __atomic_load_n(&entry->count, __ATOMIC_RELAXED);
+
+		len += (size_t)snprintf(line + len, sizeof(line) - len,
+		    " %llu\n", value);
+		write_all_no_intercept(fd, line, len);
+	}
+
+	unsigned long dropped =
+	    __atomic_load_n(&dropped_samples, __ATOMIC_RELAXED);
+	if (dropped != 0 && !weight_is_time) {
+		int len = snprintf(line, sizeof(line), "[dropped] %lu\n",
+		    dropped);
+		write_all_no_intercept(fd, line, (size_t)len);
+	}
+
+	syscall_no_intercept(SYS_close, fd);
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_profile.h - sampling profiler, collecting the call stacks leading
+ * to syscalls, written out in the "folded" format used by flame graph tools.
+ */
+
+#ifndef INTERCEPT_PROFILE_H
+#define INTERCEPT_PROFILE_H
+
+struct patch_desc;
+struct profile_entry;
+
+/* Is the profiler enabled? Checked before calling any other routine here. */
+extern bool intercept_profile_on;
+
+void intercept_setup_profile(const char *path, const char *every,
+				const char *period_us, const char *weight);
+
+/*
+ * intercept_profile_should_sample - decides if the current syscall is to be
+ * sampled, either every Nth syscall in the thread, or the first syscall
+ * after a given time elapsed since the last sample taken in the thread.
+ */
+bool intercept_profile_should_sample(void);
+
+/*
+ * intercept_profile_sample - capture the call stack of a syscall,
+ * given the rbp and rsp registers seen at the syscall instruction.
+ * Returns the entry counting this stack, nullptr if the table is full.
+ */
+struct profile_entry *intercept_profile_sample(const struct patch_desc *patch,
+				unsigned long rbp, unsigned long rsp);
+
+/*
+ * intercept_profile_add_time - account time spent in the kernel to
+ * a stack returned by intercept_profile_sample.
+ */
+void intercept_profile_add_time(struct profile_entry *entry,
+				unsigned long long ns);
+
+/*
+ * intercept_profile_pause - stop, or resume taking samples.
+ */
+void intercept_profile_pause(bool pause);
+
+/*
+ * intercept_profile_reset - zero the counts, and times of the stacks
+ * collected so far.
+ */
+void intercept_profile_reset(void);
+
+/*
+ * intercept_profile_dump - write the collected stacks to the output file,
+ * in the folded stack format, one stack per line:
+ * "root_function;...;leaf_function;syscall_site count"
+ */
+void intercept_profile_dump(void);
+
+#endif
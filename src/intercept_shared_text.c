@@ -0,0 +1,277 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_shared_text.c - sharing the patched text of objects between
+ * processes.
+ *
+ * Overwriting the syscall instructions makes private copies of the text
+ * pages written, in every process. With INTERCEPT_SHARED_TEXT set to a
+ * directory, the first process patching an object writes the patched
+ * pages of its text into a file in that directory, and maps that file
+ * over the text. Later processes only need to fill their own trampoline
+ * table, and map the same file, so the patched pages are shared through
+ * the page cache.
+ *
+ * The patched text is only the same in two processes if the object is the
+ * same, the same patches are made, and the trampoline table is at the
+ * same distance from the text, thus the file name is formed from the
+ * build-id of the object, the offset of the text in the object, the
+ * distance of the trampoline table, and a hash of the patch locations.
+ * Objects without a build-id, or patched without a trampoline table are
+ * patched as usual.
+ */
+
+#include "intercept_shared_text.h"
+#include "intercept.h"
+#include "intercept_util.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static char cache_dir[PATH_MAX - 0x100];
+
+void
+intercept_setup_shared_text(const char *dir)
+{
+	if (dir == nullptr || dir[0] == '\0')
+		return;
+
+	if (strlen(dir) >= sizeof(cache_dir))
+		xabort("INTERCEPT_SHARED_TEXT path too long");
+
+	strcpy(cache_dir, dir);
+
+	/* EEXIST is expected, any other error is noticed when opening */
+	syscall_no_intercept(SYS_mkdir, cache_dir, 0755);
+}
+
+/*
+ * patch_hash - FNV-1a hash of the locations of patches, and of what is
+ * written there.
+ */
+static uint64_t
+patch_hash(const struct intercept_desc *desc)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	for (unsigned i = 0; i < desc->count; ++i) {
+		const struct patch_desc *patch = desc->items + i;
+		uint64_t values[] = {
+			(uint64_t)(patch->syscall_addr - desc->text_start),
+			(uint64_t)(patch->dst_jmp_patch - desc->text_start),
+			(uint64_t)(patch->return_address - desc->text_start),
+			patch->uses_nop_trampoline
+		};
+		const unsigned char *bytes = (const unsigned char *)values;
+
+		for (size_t b = 0; b < sizeof(values); ++b) {
+			hash ^= bytes[b];
+			hash *= 0x100000001b3ULL;
+		}
+	}
+
+	return hash;
+}
+
+static void
+image_path(const struct intercept_desc *desc, char path[static PATH_MAX])
+{
+	unsigned char *first_page = round_down_address(desc->text_start);
+	char build_id[2 * sizeof(desc->build_id) + 1];
+
+	for (size_t i = 0; i < desc->build_id_size; ++i)
+		sprintf(build_id + 2 * i, "%02x", desc->build_id[i]);
+	build_id[2 * desc->build_id_size] = '\0';
+
+	snprintf(path, PATH_MAX, "%s/%s-%lx-%lx-%016lx.text", cache_dir,
+	    build_id,
+	    (unsigned long)(first_page - desc->base_addr),
+	    (unsigned long)(desc->trampoline_table - first_page),
+	    (unsigned long)patch_hash(desc));
+}
+
+static size_t
+image_size(const struct intercept_desc *desc)
+{
+	unsigned char *first_page = round_down_address(desc->text_start);
+
+	return ((size_t)(desc->text_end - first_page) + PAGE_SIZE - 1) &
+	    ~(PAGE_SIZE - 1);
+}
+
+/*
+ * open_image - opens a cached image, if there is one to trust: written by
+ * the same user, or root, and not writable by others.
+ */
+static long
+open_image(const char *path, size_t size)
+{
+	struct stat st;
+	long fd = syscall_no_intercept(SYS_open, path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return -1;
+
+	if (syscall_no_intercept(SYS_fstat, fd, &st) != 0 ||
+	    !S_ISREG(st.st_mode) || (size_t)st.st_size != size ||
+	    (st.st_uid != 0 &&
+	    st.st_uid != (uid_t)syscall_no_intercept(SYS_geteuid)) ||
+	    (st.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+		syscall_no_intercept(SYS_close, fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*
+ * map_image - map the image over the text, after checking that it really
+ * is the patched text expected. Returns false, leaving the text untouched
+ * if the image can not be used.
+ */
+static bool
+map_image(const struct intercept_desc *desc, long fd)
+{
+	unsigned char *first_page = round_down_address(desc->text_start);
+	size_t size = image_size(desc);
+
+	/*
+	 * Mapping it somewhere else first also checks if the file can be
+	 * mapped as executable at all, e.g. it is not on a noexec mount.
+	 */
+	long image = syscall_no_intercept(SYS_mmap, nullptr, size,
+	    PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+
+	if (image < 0 && image > -4096)
+		return false;
+
+	bool usable = is_patched_text(desc, (const unsigned char *)image,
+	    size);
+
+	syscall_no_intercept(SYS_munmap, image, size);
+
+	if (!usable)
+		return false;
+
+	long result = syscall_no_intercept(SYS_mmap, first_page, size,
+	    PROT_READ | PROT_EXEC, MAP_SHARED | MAP_FIXED, fd, 0);
+
+	return result == (long)first_page;
+}
+
+/*
+ * write_image - write the text patched by activate_patches to the cache.
+ * The file is written under a temporary name first, and renamed, so other
+ * processes only ever see complete images.
+ */
+static long
+write_image(const struct intercept_desc *desc, const char *path)
+{
+	char tmp_path[PATH_MAX + 32];
+	long pid = syscall_no_intercept(SYS_getpid);
+
+	snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, pid);
+
+	long fd = syscall_no_intercept(SYS_open, tmp_path,
+	    O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return -1;
+
+	write_all_no_intercept(fd,
+	    (const char *)round_down_address(desc->text_start),
+	    image_size(desc));
+	syscall_no_intercept(SYS_close, fd);
+
+	/* checks the size, the write might have failed */
+	fd = open_image(tmp_path, image_size(desc));
+
+	if (fd < 0 ||
+	    syscall_no_intercept(SYS_rename, tmp_path, path) != 0) {
+		if (fd >= 0)
+			syscall_no_intercept(SYS_close, fd);
+		syscall_no_intercept(SYS_unlink, tmp_path);
+		return -1;
+	}
+
+	return fd;
+}
+
+void
+intercept_activate_shared(struct intercept_desc *desc)
+{
+	char path[PATH_MAX];
+
+	if (cache_dir[0] == '\0' || desc->count == 0 ||
+	    desc->build_id_size == 0 || !desc->uses_trampoline_table) {
+		activate_patches(desc);
+		return;
+	}
+
+	image_path(desc, path);
+
+	long fd = open_image(path, image_size(desc));
+	if (fd >= 0) {
+		fill_trampoline_table(desc);
+
+		bool mapped = map_image(desc, fd);
+		syscall_no_intercept(SYS_close, fd);
+
+		if (mapped) {
+			desc->dirty_text_pages = 0;
+			desc->is_text_shared = true;
+			return;
+		}
+
+		/* patch the text as usual, creating the same trampolines */
+		desc->next_trampoline = desc->trampoline_table;
+	}
+
+	activate_patches(desc);
+
+	fd = write_image(desc, path);
+	if (fd >= 0) {
+		/* the private copies of the patched pages are released */
+		if (map_image(desc, fd)) {
+			desc->dirty_text_pages = 0;
+			desc->is_text_shared = true;
+		}
+		syscall_no_intercept(SYS_close, fd);
+	}
+}
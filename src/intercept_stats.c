@@ -0,0 +1,242 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_stats.c - report of the memory used by patching.
+ *
+ * Each line of the report starts with "intercept_stats", followed by
+ * pairs of names and values, e.g.:
+ *
+ * intercept_stats object /lib/libc.so.6 patches 412 nop_patches 173
+ *	unpatched 1 retired 2 text_pages 383 dirty_text_pages 61
+ *	mprotect_calls 44 trampoline_used 5768 trampoline_size 262144
+ *	jump_table_bytes 195073 nop_table_bytes 48752 patch_table_bytes 98304
+ *
+ * The nop_patches value is the number of syscalls replaced by a two byte
+ * jump to a nop nearby, without overwriting any other instruction.
+ * Syscalls left unpatched are listed after the line of their object, with
+ * the number of times each one was trapped so far, e.g.:
+ *
+ * intercept_stats unpatched /lib/libc.so.6 offset 0x2a4f1 trapped 12
+ *
+ * Syscall instructions retired, as the hook returned
+ * INTERCEPT_HOOK_NEVER_AGAIN for them, are listed as well, with the
+ * function containing them:
+ *
+ * intercept_stats retired /lib/libc.so.6(sched_yield+0x7) offset 0xed2c7
+ *	restored 1
+ *
+ * The stray_syscalls value in the line of the totals is the number of
+ * syscalls trapped outside of these, i.e. syscalls that went around the
+ * patches, see intercept_sud.c. The delegated value is the number of
+ * syscalls executed by the worker thread of INTERCEPT_DELEGATE, see
+ * intercept_delegate.c
+ *
+ * Pages of the text written while patching become private copies in each
+ * process, the rest of the memory listed is allocated for each process.
+ */
+
+#include "intercept_stats.h"
+#include "intercept.h"
+#include "intercept_delegate.h"
+#include "intercept_sud.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+struct report {
+	char *buf;
+	size_t size;
+	size_t len;
+};
+
+static void
+append(struct report *report, const char *fmt, ...)
+{
+	va_list ap;
+	char *dst = nullptr;
+	size_t left = 0;
+
+	if (report->len < report->size) {
+		dst = report->buf + report->len;
+		left = report->size - report->len;
+	}
+
+	va_start(ap, fmt);
+	int len = vsnprintf(dst, left, fmt, ap);
+	va_end(ap);
+
+	if (len > 0)
+		report->len += (size_t)len;
+}
+
+/*
+ * pow2_ceil - the size of the items array, which is doubled each time
+ * the count of patches reaches a power of two, see add_new_patch
+ */
+static size_t
+pow2_ceil(size_t count)
+{
+	size_t result = 1;
+
+	while (result < count)
+		result *= 2;
+
+	return result;
+}
+
+static size_t
+jump_table_bytes(const struct intercept_desc *desc)
+{
+	if (desc->jump_table == nullptr)
+		return 0;
+
+	return (size_t)(desc->text_end - desc->text_start + 1) / 8 + 1;
+}
+
+static bool
+is_retired(const struct patch_desc *patch)
+{
+	return __atomic_load_n(&patch->is_retired, __ATOMIC_RELAXED);
+}
+
+/*
+ * append_retired - list a syscall instruction retired after the verdicts
+ * of the hook, restored tells if its original instructions were restored.
+ */
+static void
+append_retired(struct report *report, const struct intercept_desc *desc,
+		const struct patch_desc *patch)
+{
+	if (!is_retired(patch))
+		return;
+
+	append(report, "intercept_stats retired %s(%s) offset 0x%lx "
+	    "restored %d\n",
+	    desc->path, patch->symbol ? patch->symbol : "",
+	    patch->syscall_offset,
+	    __atomic_load_n(&patch->is_restored, __ATOMIC_RELAXED) ? 1 : 0);
+}
+
+size_t
+intercept_format_stats(char *buf, size_t size,
+			const struct intercept_desc *objs, unsigned objs_count,
+			size_t wrapper_space_used, size_t wrapper_space_size)
+{
+	struct report report = {.buf = buf, .size = size, .len = 0};
+	size_t dirty_text_pages = 0;
+	size_t mprotect_calls = 0;
+	size_t trampoline_used = 0;
+	size_t table_bytes = 0;
+
+	if (size > 0)
+		buf[0] = '\0';
+
+	for (unsigned i = 0; i < objs_count; ++i) {
+		const struct intercept_desc *desc = objs + i;
+		size_t text_pages = 0;
+		size_t used = 0;
+		size_t nop_bytes = desc->max_nop_count *
+		    sizeof(desc->nop_table[0]);
+		size_t patch_bytes = 0;
+		unsigned nop_patches = 0;
+		unsigned retired = 0;
+
+		if (desc->text_end > desc->text_start)
+			text_pages = (size_t)(desc->text_end -
+			    round_down_address(desc->text_start) +
+			    PAGE_SIZE - 1) / PAGE_SIZE;
+
+		if (desc->trampoline_table != nullptr)
+			used = (size_t)(desc->next_trampoline -
+			    desc->trampoline_table);
+
+		for (unsigned p = 0; p < desc->count; ++p) {
+			if (desc->items[p].uses_nop_trampoline)
+				++nop_patches;
+			if (is_retired(desc->items + p))
+				++retired;
+		}
+		for (unsigned p = 0; p < desc->unpatched_count; ++p) {
+			if (is_retired(desc->unpatched + p))
+				++retired;
+		}
+
+		if (desc->count > 0)
+			patch_bytes = pow2_ceil(desc->count) *
+			    sizeof(desc->items[0]);
+
+		append(&report, "intercept_stats object %s patches %u "
+		    "nop_patches %u unpatched %u retired %u "
+		    "text_pages %zu dirty_text_pages %zu mprotect_calls %zu "
+		    "trampoline_used %zu trampoline_size %zu "
+		    "jump_table_bytes %zu nop_table_bytes %zu "
+		    "patch_table_bytes %zu\n",
+		    desc->path, desc->count, nop_patches,
+		    desc->unpatched_count, retired, text_pages,
+		    desc->dirty_text_pages, desc->mprotect_calls,
+		    used, desc->trampoline_table_size,
+		    jump_table_bytes(desc), nop_bytes, patch_bytes);
+
+		for (unsigned p = 0; p < desc->unpatched_count; ++p) {
+			const struct patch_desc *patch = desc->unpatched + p;
+
+			append(&report, "intercept_stats unpatched %s "
+			    "offset 0x%lx trapped %lu\n",
+			    desc->path, patch->syscall_offset,
+			    __atomic_load_n(&patch->trapped_count,
+			    __ATOMIC_RELAXED));
+		}
+
+		for (unsigned p = 0; p < desc->count; ++p)
+			append_retired(&report, desc, desc->items + p);
+		for (unsigned p = 0; p < desc->unpatched_count; ++p)
+			append_retired(&report, desc, desc->unpatched + p);
+
+		dirty_text_pages += desc->dirty_text_pages;
+		mprotect_calls += desc->mprotect_calls;
+		trampoline_used += used;
+		table_bytes += jump_table_bytes(desc) + nop_bytes + patch_bytes;
+	}
+
+	append(&report, "intercept_stats total objects %u "
+	    "dirty_text_pages %zu mprotect_calls %zu "
+	    "asm_wrapper_used %zu asm_wrapper_size %zu "
+	    "trampoline_used %zu table_bytes %zu stray_syscalls %zu "
+	    "delegated %zu\n",
+	    objs_count, dirty_text_pages, mprotect_calls,
+	    wrapper_space_used, wrapper_space_size,
+	    trampoline_used, table_bytes, intercept_sud_stray_count(),
+	    intercept_delegate_count());
+
+	return report.len;
+}
@@ -0,0 +1,599 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_sud.c - intercepting the syscalls left unpatched, using
+ * syscall user dispatch.
+ *
+ * Some syscall instructions have no instructions around them that could
+ * be overwritten with a jump, these are left intact by create_patch_wrappers.
+ * If there are any such syscalls, syscall user dispatch is turned on in each
+ * thread: any syscall issued outside of a single region of memory is not
+ * executed by the kernel, a SIGSYS signal is sent to the thread instead. The
+ * region is the text of libsyscall_intercept together with the asm wrappers,
+ * thus the syscalls issued from the wrappers, and by syscall_no_intercept
+ * are executed as usual.
+ *
+ * The signal handler looks up the syscall instruction among the ones left
+ * unpatched, and passes the syscall to intercept_routine, the same way as
+ * the asm wrappers do. Syscalls trapped elsewhere, e.g. in objects that are
+ * not patched, are just executed, as if they were not trapped, and are only
+ * counted. With INTERCEPT_TRAP_ALL set, syscall user dispatch is turned on
+ * even if all syscalls were patched, and the syscalls trapped elsewhere are
+ * passed to intercept_routine as well, catching syscalls issued from JIT
+ * compiled code, or from objects not patched. Syscalls from patched objects
+ * still take the fast path through the wrappers, no selector needs to be
+ * changed around them, since the wrappers are in the allowed region.
+ *
+ * Some syscalls can not be executed in a signal handler: a new thread on a
+ * new stack, or a vfork child would start executing in the signal handler,
+ * and rt_sigreturn would return from the signal handler. These are executed
+ * after returning from the handler, from the allowed region: at syscalls
+ * left unpatched, the handler returns to a copy of the syscall instruction
+ * among the wrappers, followed by a jump back (see create_syscall_stub).
+ * An rt_sigreturn is issued again from intercept_sigreturn, the stack
+ * pointer is the same as the one at the original syscall. Any other such
+ * syscall is executed by one of the stubs in util.S, which also traps
+ * syscalls again in the thread issuing it, then jumps back after the
+ * syscall instruction. There is a fixed number of these stubs, each one is
+ * assigned to a syscall instruction the first time it is needed. Once all
+ * of them are used, such syscalls are executed by returning to the syscall
+ * instruction, with the selector of the thread changed to allow syscalls,
+ * until the thread enters intercept_routine again.
+ *
+ * A thread created by a syscall left unpatched starts without syscall user
+ * dispatch, as it is only turned on in new threads in intercept_routine.
+ *
+ * The library keeps its SIGSYS handler installed: an rt_sigaction syscall
+ * setting a SIGSYS action only records it, and the handler passes any SIGSYS
+ * not sent by syscall user dispatch (e.g. sent by a seccomp filter) to the
+ * action recorded. SIGSYS is also removed from the signal masks set using
+ * rt_sigprocmask, and rt_sigaction, as a syscall trapped while SIGSYS is
+ * blocked would terminate the process. Syscalls issued by hooks, or in
+ * threads with interception turned off, are executed as they are.
+ */
+
+#include "intercept_sud.h"
+#include "intercept.h"
+#include "intercept_maps.h"
+#include "intercept_util.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/prctl.h>
+#include <syscall.h>
+
+#ifndef PR_SET_SYSCALL_USER_DISPATCH
+#define PR_SET_SYSCALL_USER_DISPATCH 59
+#define PR_SYS_DISPATCH_ON 1
+#define SYSCALL_DISPATCH_FILTER_ALLOW 0
+#define SYSCALL_DISPATCH_FILTER_BLOCK 1
+#endif
+
+#ifndef SYS_USER_DISPATCH
+#define SYS_USER_DISPATCH 2
+#endif
+
+#ifndef SA_RESTORER
+#define SA_RESTORER 0x04000000
+#endif
+
+bool intercept_sud_on;
+
+/* pass the syscalls trapped outside of unpatched syscalls to the hook too */
+static bool trap_all;
+
+/* syscalls trapped outside of unpatched syscalls */
+static size_t stray_count;
+
+/* the syscalls left unpatched in all objects, sorted by address */
+static struct patch_desc **sites;
+static size_t site_count;
+
+/* the region syscalls are never trapped from */
+static uintptr_t allowed_start;
+static size_t allowed_size;
+
+/*
+ * The selector read by the kernel at each syscall of the thread, syscalls
+ * are trapped while it is SYSCALL_DISPATCH_FILTER_BLOCK. Also set by the
+ * stubs in util.S.
+ */
+__thread volatile char intercept_sud_selector
+	__attribute__((tls_model("initial-exec")));
+
+/*
+ * The stubs in util.S used for clone, and vfork syscalls trapped outside of
+ * the syscalls left unpatched, see the explanation at the top of this file.
+ * A stub is assigned to each such syscall instruction trapped, until all of
+ * them are used.
+ */
+#define STRAY_STUB_COUNT 64
+#define STRAY_STUB_SIZE 32
+
+extern unsigned char intercept_sud_stray_stubs[];
+
+/* the address each stub jumps back to */
+const unsigned char *intercept_sud_stray_targets[STRAY_STUB_COUNT];
+
+/* the syscall instruction each stub is assigned to, filled in order */
+static const unsigned char *stray_sites[STRAY_STUB_COUNT];
+static int stray_lock;
+
+/* the sigaction struct expected by the rt_sigaction syscall */
+struct kernel_sigaction {
+	union {
+		void (*handler)(int);
+		void (*sigaction)(int, siginfo_t *, void *);
+	};
+	unsigned long flags;
+	void (*restorer)(void);
+	unsigned long mask;
+};
+
+/* the bit of SIGSYS in a signal mask */
+#define SIGSYS_BIT (1UL << (SIGSYS - 1))
+
+/*
+ * The SIGSYS action set by the application, which is never installed, see
+ * intercept_sud_syscall. There are two copies, the signal handler reads the
+ * one selected by app_action_current, while the other one is updated.
+ */
+static struct kernel_sigaction app_actions[2];
+static unsigned app_action_current;
+static int app_action_lock;
+
+/* in util.S, issues an rt_sigreturn syscall from the allowed region */
+extern void intercept_sigreturn(void);
+
+/*
+ * find_site - binary search for an unpatched syscall instruction
+ */
+static struct patch_desc *
+find_site(const unsigned char *syscall_addr)
+{
+	size_t low = 0;
+	size_t high = site_count;
+
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+
+		if (sites[mid]->syscall_addr < syscall_addr)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if (low < site_count && sites[low]->syscall_addr == syscall_addr)
+		return sites[low];
+
+	return nullptr;
+}
+
+/*
+ * can_run_in_handler - can the signal handler execute the syscall itself,
+ * see the explanation at the top of this file.
+ */
+static bool
+can_run_in_handler(const struct syscall_desc *desc)
+{
+	bool returns_here;
+
+	if (desc->nr == SYS_vfork || desc->nr == SYS_rt_sigreturn)
+		return false;
+
+	(void) is_fork_syscall(desc, &returns_here);
+
+	return returns_here;
+}
+
+/*
+ * update_saved_mask - the signal mask of the thread is restored from the
+ * signal frame when returning from the handler, thus a change made to it by
+ * an rt_sigprocmask syscall executed in the handler must be made to the
+ * mask saved in the frame as well.
+ */
+static void
+update_saved_mask(const struct syscall_desc *desc, void *ucontext)
+{
+	if (desc->nr != SYS_rt_sigprocmask)
+		return;
+
+	/* the kernel only uses the first 8 bytes of the sigset_t */
+	syscall_no_intercept(SYS_rt_sigprocmask, SIG_BLOCK, nullptr,
+	    &((ucontext_t *)ucontext)->uc_sigmask, 8);
+}
+
+/*
+ * chain_sigsys - pass a SIGSYS not sent by syscall user dispatch, e.g. one
+ * sent by a seccomp filter returning SECCOMP_RET_TRAP, to the handler set
+ * by the application. Without such a handler, the default action is taken,
+ * terminating the process, as the kernel would.
+ */
+static void
+chain_sigsys(int sig, siginfo_t *info, void *ucontext)
+{
+	unsigned current =
+	    __atomic_load_n(&app_action_current, __ATOMIC_ACQUIRE);
+	struct kernel_sigaction action = app_actions[current];
+
+	if (action.handler == SIG_DFL || action.handler == SIG_IGN) {
+		struct kernel_sigaction default_action = {
+			.handler = SIG_DFL
+		};
+
+		syscall_no_intercept(SYS_rt_sigaction, SIGSYS,
+		    &default_action, nullptr, sizeof(default_action.mask));
+		syscall_no_intercept(SYS_tgkill,
+		    syscall_no_intercept(SYS_getpid),
+		    syscall_no_intercept(SYS_gettid), SIGSYS);
+		return;
+	}
+
+	/* the old mask is restored from the frame by rt_sigreturn */
+	unsigned long mask = action.mask & ~SIGSYS_BIT;
+	syscall_no_intercept(SYS_rt_sigprocmask, SIG_BLOCK, &mask, nullptr,
+	    sizeof(mask));
+
+	if (action.flags & SA_SIGINFO)
+		action.sigaction(sig, info, ucontext);
+	else
+		action.handler(sig);
+}
+
+/*
+ * find_stray_stub - the stub assigned to a syscall instruction, a new one
+ * is assigned if there is none yet. Returns nullptr if all stubs are used.
+ */
+static void *
+find_stray_stub(const unsigned char *syscall_addr)
+{
+	unsigned i;
+
+	for (i = 0; i < STRAY_STUB_COUNT; ++i) {
+		const unsigned char *site =
+		    __atomic_load_n(stray_sites + i, __ATOMIC_ACQUIRE);
+
+		if (site == syscall_addr)
+			return intercept_sud_stray_stubs + i * STRAY_STUB_SIZE;
+		if (site == nullptr)
+			break;
+	}
+
+	if (i == STRAY_STUB_COUNT)
+		return nullptr;
+
+	while (__atomic_exchange_n(&stray_lock, 1, __ATOMIC_ACQUIRE) != 0)
+		__builtin_ia32_pause();
+
+	/* another thread might have assigned some since */
+	for (; i < STRAY_STUB_COUNT; ++i) {
+		if (stray_sites[i] == syscall_addr)
+			break;
+
+		if (stray_sites[i] == nullptr) {
+			intercept_sud_stray_targets[i] =
+			    syscall_addr + SYSCALL_INS_SIZE;
+			__atomic_store_n(stray_sites + i, syscall_addr,
+			    __ATOMIC_RELEASE);
+			break;
+		}
+	}
+
+	__atomic_store_n(&stray_lock, 0, __ATOMIC_RELEASE);
+
+	if (i == STRAY_STUB_COUNT)
+		return nullptr;
+
+	return intercept_sud_stray_stubs + i * STRAY_STUB_SIZE;
+}
+
+static void
+handle_sigsys(int sig, siginfo_t *info, void *ucontext)
+{
+	greg_t *regs = ((ucontext_t *)ucontext)->uc_mcontext.gregs;
+	unsigned char *syscall_addr =
+	    (unsigned char *)regs[REG_RIP] - SYSCALL_INS_SIZE;
+	struct syscall_desc desc = {
+		.nr = info->si_syscall,
+		.args = {
+			(long)regs[REG_RDI],
+			(long)regs[REG_RSI],
+			(long)regs[REG_RDX],
+			(long)regs[REG_R10],
+			(long)regs[REG_R8],
+			(long)regs[REG_R9]
+		}
+	};
+	struct patch_desc *patch = find_site(syscall_addr);
+	struct patch_desc stray = {0, };
+	void *stub;
+	long result;
+
+	if (info->si_code != SYS_USER_DISPATCH) {
+		chain_sigsys(sig, info, ucontext);
+		return;
+	}
+
+	if (patch != nullptr) {
+		__atomic_add_fetch(&patch->trapped_count, 1, __ATOMIC_RELAXED);
+	} else {
+		__atomic_add_fetch(&stray_count, 1, __ATOMIC_RELAXED);
+
+		if (trap_all) {
+			/* logged with the address in place of the offset */
+			stray.syscall_addr = syscall_addr;
+			stray.containing_lib_path = "[unpatched]";
+			stray.syscall_offset = (unsigned long)syscall_addr;
+			patch = &stray;
+		}
+	}
+
+	if (patch != nullptr) {
+		if (intercept_trapped_syscall(patch, &desc,
+		    (long)regs[REG_RSP], (long)regs[REG_RBP], &result)) {
+			regs[REG_RAX] = result;
+			update_saved_mask(&desc, ucontext);
+			return;
+		}
+	} else if (can_run_in_handler(&desc)) {
+		bool returns_here;
+
+		if (intercept_sud_is_filtered(desc.nr))
+			result = intercept_sud_syscall(&desc);
+		else
+			result = syscall_no_intercept(desc.nr,
+					desc.args[0],
+					desc.args[1],
+					desc.args[2],
+					desc.args[3],
+					desc.args[4],
+					desc.args[5]);
+
+		if (result == 0 && is_fork_syscall(&desc, &returns_here))
+			intercept_sud_enable_thread();
+
+		regs[REG_RAX] = result;
+		update_saved_mask(&desc, ucontext);
+		return;
+	}
+
+	/*
+	 * Let the kernel execute the syscall after returning from the
+	 * handler. The RAX register still holds the syscall number.
+	 */
+	if (patch != nullptr && patch->asm_wrapper != nullptr) {
+		regs[REG_RIP] = (greg_t)patch->asm_wrapper;
+	} else if (desc.nr == SYS_rt_sigreturn) {
+		regs[REG_RIP] = (greg_t)intercept_sigreturn;
+	} else if ((stub = find_stray_stub(syscall_addr)) != nullptr) {
+		regs[REG_RIP] = (greg_t)stub;
+	} else {
+		regs[REG_RIP] -= SYSCALL_INS_SIZE;
+		intercept_sud_selector = SYSCALL_DISPATCH_FILTER_ALLOW;
+	}
+}
+
+void
+intercept_sud_enable_thread(void)
+{
+	intercept_sud_selector = SYSCALL_DISPATCH_FILTER_BLOCK;
+
+	long result = syscall_no_intercept(SYS_prctl,
+	    PR_SET_SYSCALL_USER_DISPATCH, PR_SYS_DISPATCH_ON,
+	    allowed_start, allowed_size, &intercept_sud_selector);
+
+	xabort_on_syserror(result, "PR_SET_SYSCALL_USER_DISPATCH");
+}
+
+void
+intercept_sud_rearm(void)
+{
+	intercept_sud_selector = SYSCALL_DISPATCH_FILTER_BLOCK;
+}
+
+static void
+lock_app_action(void)
+{
+	while (__atomic_exchange_n(&app_action_lock, 1, __ATOMIC_ACQUIRE) != 0)
+		__builtin_ia32_pause();
+}
+
+static void
+unlock_app_action(void)
+{
+	__atomic_store_n(&app_action_lock, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * sud_rt_sigaction - SIGSYS actions are only recorded, and SIGSYS is
+ * removed from the masks of handlers of other signals, otherwise a syscall
+ * trapped in such a handler would terminate the process.
+ */
+static long
+sud_rt_sigaction(const struct syscall_desc *desc)
+{
+	const struct kernel_sigaction *act =
+	    (const struct kernel_sigaction *)desc->args[1];
+	struct kernel_sigaction *old_act =
+	    (struct kernel_sigaction *)desc->args[2];
+	struct kernel_sigaction copy;
+
+	if (desc->args[0] != SIGSYS) {
+		if (act != nullptr) {
+			copy = *act;
+			copy.mask &= ~SIGSYS_BIT;
+			act = &copy;
+		}
+
+		return syscall_no_intercept(SYS_rt_sigaction, desc->args[0],
+		    act, old_act, desc->args[3]);
+	}
+
+	if ((size_t)desc->args[3] != sizeof(copy.mask))
+		return -EINVAL;
+
+	lock_app_action();
+
+	unsigned current = app_action_current;
+
+	if (old_act != nullptr)
+		*old_act = app_actions[current];
+
+	if (act != nullptr) {
+		app_actions[current ^ 1] = *act;
+		__atomic_store_n(&app_action_current, current ^ 1,
+		    __ATOMIC_RELEASE);
+	}
+
+	unlock_app_action();
+
+	return 0;
+}
+
+/*
+ * sud_rt_sigprocmask - SIGSYS is never blocked: the kernel terminates the
+ * process if a syscall is trapped while it is blocked.
+ */
+static long
+sud_rt_sigprocmask(const struct syscall_desc *desc)
+{
+	const unsigned long *set = (const unsigned long *)desc->args[1];
+	unsigned long copy;
+
+	if (set != nullptr && desc->args[0] != SIG_UNBLOCK &&
+	    (size_t)desc->args[3] == sizeof(copy)) {
+		copy = *set & ~SIGSYS_BIT;
+		set = &copy;
+	}
+
+	return syscall_no_intercept(SYS_rt_sigprocmask, desc->args[0],
+	    set, desc->args[2], desc->args[3]);
+}
+
+long
+intercept_sud_syscall(const struct syscall_desc *desc)
+{
+	if (desc->nr == SYS_rt_sigaction)
+		return sud_rt_sigaction(desc);
+	else
+		return sud_rt_sigprocmask(desc);
+}
+
+/*
+ * add_site - insert a syscall into the sites array, keeping it sorted.
+ * There are only a few of these, usually none.
+ */
+static void
+add_site(struct patch_desc *patch)
+{
+	size_t i = site_count++;
+
+	while (i > 0 && sites[i - 1]->syscall_addr > patch->syscall_addr) {
+		sites[i] = sites[i - 1];
+		--i;
+	}
+
+	sites[i] = patch;
+}
+
+/*
+ * set_allowed_region - the text of libsyscall_intercept, and the asm
+ * wrappers, which are in the bss of the same object.
+ */
+static void
+set_allowed_region(const void *wrappers, size_t wrappers_size)
+{
+	const struct maps_entry *text =
+	    intercept_maps_lookup((uintptr_t)&syscall_no_intercept);
+
+	if (text == nullptr)
+		xabort("text of libsyscall_intercept not found");
+
+	uintptr_t start = text->start;
+	uintptr_t end = text->end;
+
+	if ((uintptr_t)wrappers < start)
+		start = (uintptr_t)wrappers;
+
+	if ((uintptr_t)wrappers + wrappers_size > end)
+		end = (uintptr_t)wrappers + wrappers_size;
+
+	allowed_start = start;
+	allowed_size = end - start;
+}
+
+size_t
+intercept_sud_stray_count(void)
+{
+	return __atomic_load_n(&stray_count, __ATOMIC_RELAXED);
+}
+
+void
+intercept_setup_sud(struct intercept_desc *objs, unsigned objs_count,
+			const void *wrappers, size_t wrappers_size,
+			const char *trap_all_env)
+{
+	size_t count = 0;
+
+	for (unsigned i = 0; i < objs_count; ++i)
+		count += objs[i].unpatched_count;
+
+	trap_all = (trap_all_env != nullptr);
+
+	if (count == 0 && !trap_all)
+		return;
+
+	if (count > 0)
+		sites = xmmap_anon(count * sizeof(sites[0]));
+	for (unsigned i = 0; i < objs_count; ++i) {
+		for (unsigned p = 0; p < objs[i].unpatched_count; ++p)
+			add_site(objs[i].unpatched + p);
+	}
+
+	set_allowed_region(wrappers, wrappers_size);
+
+	struct kernel_sigaction act = {
+		.sigaction = handle_sigsys,
+		.flags = SA_SIGINFO | SA_RESTORER | SA_NODEFER,
+		.restorer = intercept_sigreturn,
+		.mask = 0
+	};
+
+	/* the handler installed so far is kept, to pass other SIGSYS to it */
+	xabort_on_syserror(syscall_no_intercept(SYS_rt_sigaction, SIGSYS,
+	    &act, app_actions, sizeof(act.mask)), "rt_sigaction SIGSYS");
+
+	intercept_sud_enable_thread();
+	intercept_sud_on = true;
+}
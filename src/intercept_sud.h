@@ -0,0 +1,99 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_sud.h - intercepting the syscalls left unpatched, using
+ * syscall user dispatch.
+ */
+
+#ifndef INTERCEPT_SUD_H
+#define INTERCEPT_SUD_H
+
+#include <stddef.h>
+#include <syscall.h>
+
+struct intercept_desc;
+struct syscall_desc;
+
+extern bool intercept_sud_on;
+
+/*
+ * intercept_setup_sud - turn on syscall user dispatch in the calling
+ * thread, if any of the objects has syscalls left unpatched, or the
+ * INTERCEPT_TRAP_ALL environment variable is set. Syscalls issued from
+ * the text of libsyscall_intercept, and from the asm wrappers at
+ * [wrappers, wrappers + wrappers_size) are not trapped.
+ */
+void intercept_setup_sud(struct intercept_desc *objs, unsigned objs_count,
+			const void *wrappers, size_t wrappers_size,
+			const char *trap_all_env);
+
+/*
+ * intercept_sud_stray_count - the number of syscalls trapped so far outside
+ * of the syscalls left unpatched, i.e. the syscalls not issued through
+ * libsyscall_intercept's patches.
+ */
+size_t intercept_sud_stray_count(void);
+
+/*
+ * intercept_sud_enable_thread - turn on syscall user dispatch in a new
+ * thread, or child process, as it is not inherited from the parent.
+ */
+void intercept_sud_enable_thread(void);
+
+/*
+ * intercept_sud_rearm - trap syscalls again in the calling thread, after
+ * the last syscall trapped was let through to be executed by the kernel.
+ */
+void intercept_sud_rearm(void);
+
+/*
+ * intercept_sud_is_filtered - syscalls that could take SIGSYS away from
+ * the library, must be executed using intercept_sud_syscall, while syscall
+ * user dispatch is on.
+ */
+static inline bool
+intercept_sud_is_filtered(long nr)
+{
+	return nr == SYS_rt_sigaction || nr == SYS_rt_sigprocmask;
+}
+
+/*
+ * intercept_sud_syscall - execute rt_sigaction, or rt_sigprocmask, keeping
+ * the SIGSYS handler of the library installed, and SIGSYS unblocked. A
+ * handler set for SIGSYS is only recorded, and called for SIGSYS signals
+ * not sent by syscall user dispatch, e.g. sent by a seccomp filter.
+ */
+long
+intercept_sud_syscall(const struct syscall_desc *desc);
+
+#endif
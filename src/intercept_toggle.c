@@ -0,0 +1,1039 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_toggle.c - undoing the patches at runtime, and redoing them,
+ * see syscall_intercept_disable and syscall_intercept_enable, or undoing
+ * single patches the hook is not interested in.
+ *
+ * The bytes overwritten at each patch are saved before the patches are
+ * activated, and the patched bytes are saved after. Such a text_edit covers
+ * the instructions replaced by a jump: [dst_jmp_patch, return_address), or
+ * just the syscall instruction replaced by a short jump to a nop. The nops
+ * used as trampolines are left as they are, they are skipped by their own
+ * short jump, and a thread might still be on its way to one of them.
+ *
+ * The text is written while other threads might be executing it, thus it
+ * is done in steps, with each step made visible to the instruction fetch
+ * of all threads by a membarrier syscall (an interrupt on each CPU running
+ * a thread of the process) before the next step:
+ *
+ *  1) An int3 is written over the first byte of each edit.
+ *  2) The rest of the bytes are written.
+ *  3) The first byte is written.
+ *
+ * A thread reaching an edit in the mean time executes the int3, and the
+ * SIGTRAP handler continues its execution in the asm wrapper of the patch,
+ * at the copy of the instruction the thread was at. This is correct both
+ * before, and after the edit. When patching, there is one more problem:
+ * besides its first byte, a thread might be at the start of any other
+ * instruction overwritten, e.g. after returning from the syscall, or after
+ * being preempted. These instructions are overwritten with int3 as well in
+ * step 2, and the patched bytes are only written in another step. The
+ * first five bytes of a patch hold the jump, the interior instructions
+ * there (if any) would not trap, but would execute garbage. Before writing
+ * these, each thread of the process is interrupted with a SIGRTMAX signal,
+ * and the handler moves the thread to the asm wrapper, if it is found at
+ * such an instruction. A blocked syscall is interrupted by the signal as
+ * well. A real-time signal is used, as a SIGTRAP sent while a SIGTRAP
+ * caused by an int3 is pending would be merged with it, leaving no way to
+ * tell where the thread was. If any thread does not handle the signal in
+ * time, e.g. it blocks SIGRTMAX as the helper thread of glibc's
+ * SIGEV_THREAD timers does, the original bytes are written back at the
+ * patches with such interior instructions, instead of the jump, and these
+ * are patched at the next call of syscall_intercept_enable.
+ *
+ * Signals not sent by the library, e.g. a SIGTRAP of a breakpoint, or a
+ * SIGRTMAX used by the program, are passed to the handlers the program
+ * had installed before.
+ *
+ * A thread interrupted at an interior instruction by a signal handler of
+ * the program, still running while the patches are written, is not found,
+ * as only the innermost context of a thread is seen by the handler.
+ *
+ * A single patch is undone the same way, when the hook keeps returning
+ * INTERCEPT_HOOK_NEVER_AGAIN for its syscall, see intercept_never_again.
+ * Its edit is retired, and is not patched again.
+ */
+
+#include "intercept_toggle.h"
+#include "intercept.h"
+#include "intercept_sud.h"
+#include "intercept_util.h"
+#include "libsyscall_intercept_hook_point.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/membarrier.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <syscall.h>
+
+#ifndef SA_RESTORER
+#define SA_RESTORER 0x04000000
+#endif
+
+/* up to three instructions of at most 15 bytes, and the syscall */
+#define MAX_EDIT_SIZE 48
+
+/* the first instruction, prev_ins, the syscall, and following_ins */
+#define MAX_EDIT_ENTRIES 4
+
+/* how long to wait for the threads to handle the signal sent to them */
+#define INTERRUPT_TIMEOUT_NS 500000000ULL
+
+/* the most threads interrupted */
+#define MAX_THREADS 0x10000
+
+enum edit_state {
+	EDIT_ORIGINAL,
+	EDIT_TRAPPING,
+	EDIT_PATCHED,
+
+	/* original bytes, not patched again by syscall_intercept_enable */
+	EDIT_RETIRED
+};
+
+struct text_edit {
+	struct patch_desc *patch;
+	unsigned char *address;
+	unsigned char size;
+	unsigned char state;
+
+	/*
+	 * The offsets of the original instructions in the edit, and where
+	 * a thread found at one of them continues in the asm wrapper.
+	 */
+	unsigned char entry_count;
+	unsigned char entry_offset[MAX_EDIT_ENTRIES];
+	unsigned char *entry_target[MAX_EDIT_ENTRIES];
+
+	unsigned char original[MAX_EDIT_SIZE];
+	unsigned char patched[MAX_EDIT_SIZE];
+};
+
+/* the sigaction struct expected by the rt_sigaction syscall */
+struct kernel_sigaction {
+	union {
+		void (*handler)(int);
+		void (*sigaction)(int, siginfo_t *, void *);
+	};
+	unsigned long flags;
+	void (*restorer)(void);
+	unsigned long mask;
+};
+
+/* the layout of the entries read by getdents64 */
+struct kernel_dirent64 {
+	uint64_t ino;
+	int64_t off;
+	unsigned short reclen;
+	unsigned char type;
+	char name[];
+};
+
+/* in util.S */
+extern void intercept_sigreturn(void);
+
+static struct intercept_desc *toggled_objs;
+static unsigned toggled_objs_count;
+
+/* set while a thread is toggling the patches */
+static int busy;
+
+static bool handlers_installed;
+static int membarrier_cmd;
+
+/*
+ * The actions of the program for SIGTRAP and SIGRTMAX, replaced by the
+ * handlers of the library, see intercept_toggle_rt_sigaction. Two copies
+ * of each, as in intercept_sud.c: the signal handlers use the one selected
+ * by current, while the other one is updated.
+ */
+struct app_action {
+	struct kernel_sigaction actions[2];
+	unsigned current;
+};
+
+static struct app_action app_sigtrap_action;
+static struct app_action app_interrupt_action;
+static int app_action_lock;
+
+/*
+ * Identify the signals sent by interrupt_threads, and count the
+ * threads that handled them.
+ */
+static pid_t interrupt_pid;
+static int interrupt_round;
+static size_t interrupt_acks;
+
+static void
+add_entry(struct text_edit *edit, const unsigned char *ins,
+		unsigned char *target)
+{
+	edit->entry_offset[edit->entry_count] =
+	    (unsigned char)(ins - edit->address);
+	edit->entry_target[edit->entry_count] = target;
+	++edit->entry_count;
+}
+
+/*
+ * init_edit - describe the bytes written at a patch, and the instructions
+ * originally there.
+ */
+static void
+init_edit(struct text_edit *edit, struct patch_desc *patch)
+{
+	if (patch->uses_nop_trampoline) {
+		edit->address = patch->syscall_addr;
+		edit->size = SYSCALL_INS_SIZE;
+		add_entry(edit, patch->syscall_addr, patch->wrapper_syscall);
+	} else {
+		edit->address = patch->dst_jmp_patch;
+		edit->size = (unsigned char)
+		    (patch->return_address - patch->dst_jmp_patch);
+		add_entry(edit, patch->dst_jmp_patch, patch->asm_wrapper);
+		if (patch->uses_prev_ins_2)
+			add_entry(edit, patch->dst_jmp_patch +
+			    patch->preceding_ins_2.length,
+			    patch->wrapper_prev_ins);
+		if (patch->uses_prev_ins)
+			add_entry(edit, patch->syscall_addr,
+			    patch->wrapper_syscall);
+		if (patch->uses_next_ins)
+			add_entry(edit, patch->syscall_addr + SYSCALL_INS_SIZE,
+			    patch->wrapper_next_ins);
+	}
+
+	memcpy(edit->original, edit->address, edit->size);
+	edit->state = EDIT_ORIGINAL;
+	edit->patch = patch;
+}
+
+void
+intercept_toggle_save(struct intercept_desc *desc)
+{
+	if (desc->count == 0)
+		return;
+
+	desc->edits = xmmap_anon(desc->count * sizeof(desc->edits[0]));
+
+	for (unsigned i = 0; i < desc->count; ++i)
+		init_edit(desc->edits + i, desc->items + i);
+}
+
+void
+intercept_setup_toggle(struct intercept_desc *objs, unsigned objs_count)
+{
+	for (unsigned i = 0; i < objs_count; ++i) {
+		struct intercept_desc *desc = objs + i;
+
+		if (desc->edits == nullptr)
+			continue;
+
+		if (desc->is_text_shared) {
+			xmunmap(desc->edits,
+			    desc->count * sizeof(desc->edits[0]));
+			desc->edits = nullptr;
+			continue;
+		}
+
+		unsigned char *first_page =
+		    round_down_address(desc->text_start);
+
+		desc->edit_page_map =
+		    xmmap_anon(text_page_count(desc) / 8 + 1);
+
+		for (unsigned e = 0; e < desc->count; ++e) {
+			struct text_edit *edit = desc->edits + e;
+
+			memcpy(edit->patched, edit->address, edit->size);
+			edit->state = EDIT_PATCHED;
+			mark_written(desc->edit_page_map, first_page,
+			    edit->address, edit->size);
+		}
+	}
+
+	toggled_objs = objs;
+	toggled_objs_count = objs_count;
+}
+
+/*
+ * find_edit - binary search for the edit covering an address, the edits
+ * are in the same order as the patches, sorted by address.
+ */
+static struct text_edit *
+find_edit(const struct intercept_desc *desc, const unsigned char *addr)
+{
+	unsigned low = 0;
+	unsigned high = desc->count;
+
+	while (low < high) {
+		unsigned mid = low + (high - low) / 2;
+
+		if (desc->edits[mid].address + desc->edits[mid].size <= addr)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if (low < desc->count && desc->edits[low].address <= addr)
+		return desc->edits + low;
+
+	return nullptr;
+}
+
+/*
+ * find_entry - where in an asm wrapper to continue the execution of a
+ * thread found at addr, or nullptr if addr is not the address of one of
+ * the original instructions of an edit.
+ */
+static unsigned char *
+find_entry(const unsigned char *addr)
+{
+	for (unsigned i = 0; i < toggled_objs_count; ++i) {
+		const struct intercept_desc *desc = toggled_objs + i;
+
+		if (desc->edits == nullptr || addr < desc->text_start ||
+		    addr > desc->text_end)
+			continue;
+
+		struct text_edit *edit = find_edit(desc, addr);
+		if (edit == nullptr)
+			return nullptr;
+
+		for (unsigned e = 0; e < edit->entry_count; ++e) {
+			if (edit->address + edit->entry_offset[e] == addr)
+				return edit->entry_target[e];
+		}
+
+		return nullptr;
+	}
+
+	return nullptr;
+}
+
+/*
+ * chain_signal - pass a signal not sent by the library to the handler the
+ * program had installed before. Without such a handler, the default action
+ * is taken, as the kernel would: a SIGTRAP caused by an int3 can not be
+ * ignored.
+ */
+static void
+chain_signal(const struct app_action *app, int sig, siginfo_t *info,
+		void *ucontext)
+{
+	struct kernel_sigaction action =
+	    app->actions[__atomic_load_n(&app->current, __ATOMIC_ACQUIRE)];
+
+	if (action.handler == SIG_IGN && info->si_code != SI_KERNEL)
+		return;
+
+	if (action.handler == SIG_DFL || action.handler == SIG_IGN) {
+		struct kernel_sigaction default_action = {
+			.handler = SIG_DFL
+		};
+
+		syscall_no_intercept(SYS_rt_sigaction, sig,
+		    &default_action, nullptr, sizeof(default_action.mask));
+		syscall_no_intercept(SYS_tgkill,
+		    syscall_no_intercept(SYS_getpid),
+		    syscall_no_intercept(SYS_gettid), sig);
+		return;
+	}
+
+	/* the old mask is restored from the frame by rt_sigreturn */
+	unsigned long mask = action.mask;
+	if (!(action.flags & SA_NODEFER))
+		mask |= 1UL << (sig - 1);
+	syscall_no_intercept(SYS_rt_sigprocmask, SIG_BLOCK, &mask, nullptr,
+	    sizeof(mask));
+
+	if (action.flags & SA_SIGINFO)
+		action.sigaction(sig, info, ucontext);
+	else
+		action.handler(sig);
+}
+
+/*
+ * handle_interrupt - the handler of the signal sent by interrupt_threads,
+ * possibly in an earlier round. Other SIGRTMAX signals are passed to the
+ * handler of the program, after moving the thread the same way.
+ */
+static void
+handle_interrupt(int sig, siginfo_t *info, void *ucontext)
+{
+	greg_t *regs = ((ucontext_t *)ucontext)->uc_mcontext.gregs;
+	unsigned char *target = find_entry((unsigned char *)regs[REG_RIP]);
+	int round = __atomic_load_n(&interrupt_round, __ATOMIC_ACQUIRE);
+
+	if (target != nullptr)
+		regs[REG_RIP] = (greg_t)target;
+
+	if (info->si_code != SI_QUEUE || info->si_pid != interrupt_pid ||
+	    info->si_value.sival_int <= 0 ||
+	    info->si_value.sival_int > round) {
+		chain_signal(&app_interrupt_action, sig, info, ucontext);
+		return;
+	}
+
+	if (info->si_value.sival_int == round)
+		__atomic_add_fetch(&interrupt_acks, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * handle_sigtrap - move a thread executing an int3 written over an edit to
+ * the asm wrapper, pass any other SIGTRAP to the handler of the program,
+ * e.g. one caused by a breakpoint of a debugger running in the process.
+ */
+static void
+handle_sigtrap(int sig, siginfo_t *info, void *ucontext)
+{
+	greg_t *regs = ((ucontext_t *)ucontext)->uc_mcontext.gregs;
+	unsigned char *rip = (unsigned char *)regs[REG_RIP];
+
+	/* an int3 written over an instruction, RIP points past the int3 */
+	unsigned char *target = find_entry(rip - 1);
+	if (info->si_code != SI_KERNEL || target == nullptr) {
+		chain_signal(&app_sigtrap_action, sig, info, ucontext);
+		return;
+	}
+
+	regs[REG_RIP] = (greg_t)target;
+}
+
+static void
+lock_app_action(void)
+{
+	while (__atomic_exchange_n(&app_action_lock, 1, __ATOMIC_ACQUIRE) != 0)
+		__builtin_ia32_pause();
+}
+
+static void
+unlock_app_action(void)
+{
+	__atomic_store_n(&app_action_lock, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * swap_app_action - record a new action of the program for a signal, if
+ * act is not nullptr, and return the previous one in old_act, if that is
+ * not nullptr.
+ */
+static void
+swap_app_action(struct app_action *app, const struct kernel_sigaction *act,
+		struct kernel_sigaction *old_act)
+{
+	lock_app_action();
+
+	unsigned current = app->current;
+
+	if (old_act != nullptr)
+		*old_act = app->actions[current];
+
+	if (act != nullptr) {
+		app->actions[current ^ 1] = *act;
+		__atomic_store_n(&app->current, current ^ 1, __ATOMIC_RELEASE);
+	}
+
+	unlock_app_action();
+}
+
+/*
+ * install_handler - install a handler of the library, the action found
+ * installed instead is recorded as the one of the program. This happens
+ * the first time, and again if the program did replace the handler in
+ * a way not seen by intercept_toggle_rt_sigaction, e.g. while the
+ * patches were disabled.
+ */
+static int
+install_handler(int sig, void (*handler)(int, siginfo_t *, void *),
+		struct app_action *app)
+{
+	struct kernel_sigaction act = {
+		.sigaction = handler,
+		.flags = SA_SIGINFO | SA_RESTORER | SA_RESTART | SA_NODEFER,
+		.restorer = intercept_sigreturn,
+		.mask = 0
+	};
+	struct kernel_sigaction prev;
+
+	int error = syscall_error_code(syscall_no_intercept(SYS_rt_sigaction,
+	    sig, &act, &prev, sizeof(act.mask)));
+
+	if (error == 0 && prev.sigaction != handler)
+		swap_app_action(app, &prev, nullptr);
+
+	return error;
+}
+
+/*
+ * setup_toggling - install the signal handlers, or install them again if
+ * the program replaced them, and register for the membarrier command used.
+ * The expedited membarrier commands only interrupt the CPUs running threads
+ * of the process.
+ */
+static int
+setup_toggling(void)
+{
+	if (membarrier_cmd == 0) {
+		if (syscall_no_intercept(SYS_membarrier,
+		    MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_SYNC_CORE,
+		    0, 0) == 0) {
+			membarrier_cmd =
+			    MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE;
+		} else if (syscall_no_intercept(SYS_membarrier,
+		    MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0) {
+			/* returning from the interrupt serializes as well */
+			membarrier_cmd = MEMBARRIER_CMD_PRIVATE_EXPEDITED;
+		} else {
+			return ENOSYS;
+		}
+	}
+
+	int error = install_handler(SIGTRAP, handle_sigtrap,
+	    &app_sigtrap_action);
+	if (error == 0)
+		error = install_handler(SIGRTMAX, handle_interrupt,
+		    &app_interrupt_action);
+	if (error != 0)
+		return error;
+
+	__atomic_store_n(&handlers_installed, true, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/*
+ * sync_cores - make the writes to the text visible to the instruction
+ * fetch of all threads.
+ */
+static void
+sync_cores(void)
+{
+	xabort_on_syserror(syscall_no_intercept(SYS_membarrier,
+	    membarrier_cmd, 0, 0), "membarrier");
+}
+
+/*
+ * protect_text - change the protection of the pages holding edits, the
+ * same pages activate_patches made writable, not the whole text.
+ */
+static void
+protect_text(int prot, const char *msg)
+{
+	for (unsigned i = 0; i < toggled_objs_count; ++i) {
+		const struct intercept_desc *desc = toggled_objs + i;
+
+		if (desc->edits == nullptr)
+			continue;
+
+		mprotect_pages(desc->edit_page_map, text_page_count(desc),
+		    round_down_address(desc->text_start), prot, msg);
+	}
+}
+
+/*
+ * has_interior_entry - is there an original instruction starting in the
+ * jump written at the start of the edit, other than the first one.
+ */
+static bool
+has_interior_entry(const struct text_edit *edit)
+{
+	for (unsigned e = 0; e < edit->entry_count; ++e) {
+		if (edit->entry_offset[e] > 0 &&
+		    edit->entry_offset[e] < JUMP_INS_SIZE)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * for_each_edit - call func with each edit in a given state, returns the
+ * number of edits visited.
+ */
+static size_t
+for_each_edit(enum edit_state state,
+		void (*func)(struct text_edit *, void *), void *arg)
+{
+	size_t count = 0;
+
+	for (unsigned i = 0; i < toggled_objs_count; ++i) {
+		struct intercept_desc *desc = toggled_objs + i;
+
+		if (desc->edits == nullptr)
+			continue;
+
+		for (unsigned e = 0; e < desc->count; ++e) {
+			if (desc->edits[e].state != state)
+				continue;
+
+			if (func != nullptr)
+				func(desc->edits + e, arg);
+			++count;
+		}
+	}
+
+	return count;
+}
+
+static void
+write_int3(struct text_edit *edit, void *arg)
+{
+	(void) arg;
+	edit->address[0] = INT3_OPCODE;
+}
+
+static void
+fill_int3(struct text_edit *edit, void *arg)
+{
+	(void) arg;
+	memset(edit->address + 1, INT3_OPCODE, edit->size - 1u);
+	edit->state = EDIT_TRAPPING;
+}
+
+static void
+count_interior(struct text_edit *edit, void *arg)
+{
+	size_t *count = arg;
+
+	if (has_interior_entry(edit))
+		*count += 1;
+}
+
+/* the second step, arg points to a bool: are interior entries safe */
+static void
+write_patched_tail(struct text_edit *edit, void *arg)
+{
+	const bool *interior_safe = arg;
+
+	if (has_interior_entry(edit) && !(*interior_safe))
+		return;
+
+	memcpy(edit->address + 1, edit->patched + 1, edit->size - 1u);
+	edit->state = EDIT_PATCHED;
+}
+
+static void
+write_patched_head(struct text_edit *edit, void *arg)
+{
+	(void) arg;
+	edit->address[0] = edit->patched[0];
+}
+
+static void
+write_original_tail(struct text_edit *edit, void *arg)
+{
+	(void) arg;
+	memcpy(edit->address + 1, edit->original + 1, edit->size - 1u);
+}
+
+static void
+write_original_head(struct text_edit *edit, void *arg)
+{
+	(void) arg;
+	edit->address[0] = edit->original[0];
+	edit->state = EDIT_ORIGINAL;
+}
+
+/* an edit with its original bytes, at a retired syscall stays so */
+static void
+retire_edit(struct text_edit *edit, void *arg)
+{
+	(void) arg;
+
+	if (!__atomic_load_n(&edit->patch->is_retired, __ATOMIC_ACQUIRE))
+		return;
+
+	edit->state = EDIT_RETIRED;
+	edit->patch->is_restored = true;
+}
+
+/*
+ * read_threads - list the ids of the threads of the process, into tids,
+ * returns the number of threads found, or -1 on error.
+ */
+static long
+read_threads(long *tids, size_t max_count)
+{
+	char buf[0x1000];
+	size_t count = 0;
+	long fd = syscall_no_intercept(SYS_open, "/proc/self/task",
+	    O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	if (fd < 0)
+		return -1;
+
+	for (;;) {
+		long len = syscall_no_intercept(SYS_getdents64, fd,
+		    buf, sizeof(buf));
+
+		if (len <= 0) {
+			syscall_no_intercept(SYS_close, fd);
+			return (len < 0) ? -1 : (long)count;
+		}
+
+		for (long pos = 0; pos < len; ) {
+			const struct kernel_dirent64 *ent =
+			    (const struct kernel_dirent64 *)(buf + pos);
+			long tid = 0;
+
+			pos += ent->reclen;
+
+			for (const char *c = ent->name; *c != '\0'; ++c) {
+				if (*c < '0' || *c > '9') {
+					tid = 0;
+					break;
+				}
+				tid = tid * 10 + (*c - '0');
+			}
+
+			if (tid == 0)
+				continue;
+
+			if (count == max_count) {
+				syscall_no_intercept(SYS_close, fd);
+				return -1;
+			}
+
+			tids[count++] = tid;
+		}
+	}
+}
+
+static bool
+contains(const long *tids, size_t count, long tid)
+{
+	for (size_t i = 0; i < count; ++i) {
+		if (tids[i] == tid)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * interrupt_threads - send a SIGRTMAX to each other thread, and wait for
+ * them to handle it. Threads created meanwhile are interrupted as well,
+ * until no new thread is found. Returns true if all threads handled the
+ * signal.
+ */
+static bool
+interrupt_threads(void)
+{
+	size_t tids_size = 2 * MAX_THREADS * sizeof(long);
+	long *tids = xmmap_anon(tids_size);
+	long *sent = tids + MAX_THREADS;
+	size_t sent_count = 0;
+	long self = syscall_no_intercept(SYS_gettid);
+	bool all_handled = true;
+	siginfo_t info;
+
+	interrupt_pid = (pid_t)syscall_no_intercept(SYS_getpid);
+	__atomic_store_n(&interrupt_acks, 0, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&interrupt_round, 1, __ATOMIC_RELEASE);
+
+	memset(&info, 0, sizeof(info));
+	info.si_signo = SIGRTMAX;
+	info.si_code = SI_QUEUE;
+	info.si_pid = interrupt_pid;
+	info.si_value.sival_int = interrupt_round;
+
+	for (;;) {
+		long count = read_threads(tids, MAX_THREADS);
+		bool found_new = false;
+
+		if (count < 0) {
+			all_handled = false;
+			break;
+		}
+
+		for (long i = 0; i < count; ++i) {
+			if (tids[i] == self ||
+			    contains(sent, sent_count, tids[i]))
+				continue;
+
+			if (sent_count == MAX_THREADS) {
+				all_handled = false;
+				break;
+			}
+
+			/* the thread might have exited since */
+			if (syscall_no_intercept(SYS_rt_tgsigqueueinfo,
+			    interrupt_pid, tids[i], SIGRTMAX, &info) != 0)
+				continue;
+
+			sent[sent_count++] = tids[i];
+			found_new = true;
+		}
+
+		if (!found_new || !all_handled)
+			break;
+
+		unsigned long long deadline =
+		    clock_ns_no_intercept() + INTERRUPT_TIMEOUT_NS;
+
+		while (__atomic_load_n(&interrupt_acks, __ATOMIC_ACQUIRE) <
+		    sent_count) {
+			if (clock_ns_no_intercept() > deadline)
+				break;
+			syscall_no_intercept(SYS_sched_yield);
+		}
+	}
+
+	if (__atomic_load_n(&interrupt_acks, __ATOMIC_ACQUIRE) < sent_count)
+		all_handled = false;
+
+	xmunmap(tids, tids_size);
+
+	return all_handled;
+}
+
+/*
+ * syscall_intercept_disable - part of the public API, see the
+ * libsyscall_intercept_hook_point.h header file.
+ */
+__attribute__((visibility("default"))) int
+syscall_intercept_disable(void)
+{
+	if (__atomic_exchange_n(&busy, 1, __ATOMIC_ACQUIRE) != 0)
+		return EBUSY;
+
+	int error = setup_toggling();
+	if (error != 0) {
+		__atomic_store_n(&busy, 0, __ATOMIC_RELEASE);
+		return error;
+	}
+
+	protect_text(PROT_READ | PROT_WRITE | PROT_EXEC,
+	    "mprotect PROT_READ | PROT_WRITE | PROT_EXEC");
+
+	/*
+	 * No thread can be inside the jump written over an edit, nor at an
+	 * int3 after it, only at its first byte.
+	 */
+	for_each_edit(EDIT_PATCHED, write_int3, nullptr);
+	sync_cores();
+	for_each_edit(EDIT_PATCHED, write_original_tail, nullptr);
+	for_each_edit(EDIT_TRAPPING, write_original_tail, nullptr);
+	sync_cores();
+	for_each_edit(EDIT_PATCHED, write_original_head, nullptr);
+	for_each_edit(EDIT_TRAPPING, write_original_head, nullptr);
+	sync_cores();
+	for_each_edit(EDIT_ORIGINAL, retire_edit, nullptr);
+
+	protect_text(PROT_READ | PROT_EXEC, "mprotect PROT_READ | PROT_EXEC");
+
+	__atomic_store_n(&busy, 0, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/*
+ * syscall_intercept_enable - part of the public API, see the
+ * libsyscall_intercept_hook_point.h header file.
+ */
+__attribute__((visibility("default"))) int
+syscall_intercept_enable(void)
+{
+	if (__atomic_exchange_n(&busy, 1, __ATOMIC_ACQUIRE) != 0)
+		return EBUSY;
+
+	int error = setup_toggling();
+	if (error != 0) {
+		__atomic_store_n(&busy, 0, __ATOMIC_RELEASE);
+		return error;
+	}
+
+	protect_text(PROT_READ | PROT_WRITE | PROT_EXEC,
+	    "mprotect PROT_READ | PROT_WRITE | PROT_EXEC");
+
+	for_each_edit(EDIT_ORIGINAL, retire_edit, nullptr);
+	for_each_edit(EDIT_ORIGINAL, write_int3, nullptr);
+	sync_cores();
+	for_each_edit(EDIT_ORIGINAL, fill_int3, nullptr);
+	sync_cores();
+
+	size_t interior_count = 0;
+	for_each_edit(EDIT_TRAPPING, count_interior, &interior_count);
+
+	bool interior_safe = (interior_count == 0) || interrupt_threads();
+
+	/*
+	 * The edits left trapping have interior entries, some thread might
+	 * still be stopped at: their original bytes are written back.
+	 */
+	for_each_edit(EDIT_TRAPPING, write_patched_tail, &interior_safe);
+	for_each_edit(EDIT_TRAPPING, write_original_tail, nullptr);
+	sync_cores();
+	for_each_edit(EDIT_PATCHED, write_patched_head, nullptr);
+	for_each_edit(EDIT_TRAPPING, write_original_head, nullptr);
+	sync_cores();
+
+	protect_text(PROT_READ | PROT_EXEC, "mprotect PROT_READ | PROT_EXEC");
+
+	__atomic_store_n(&busy, 0, __ATOMIC_RELEASE);
+
+	return interior_safe ? 0 : EAGAIN;
+}
+
+/*
+ * intercept_toggle_rt_sigaction - the actions of SIGTRAP and SIGRTMAX are
+ * only recorded, the handlers of the library stay installed, and pass
+ * the signals not sent by the library to these actions.
+ */
+long
+intercept_toggle_rt_sigaction(const struct syscall_desc *desc)
+{
+	const struct kernel_sigaction *act =
+	    (const struct kernel_sigaction *)desc->args[1];
+	struct kernel_sigaction *old_act =
+	    (struct kernel_sigaction *)desc->args[2];
+	struct kernel_sigaction copy;
+
+	if ((size_t)desc->args[3] != sizeof(copy.mask))
+		return -EINVAL;
+
+	if (act != nullptr) {
+		copy = *act;
+		/* as sud_rt_sigaction does for the other signals */
+		if (intercept_sud_on)
+			copy.mask &= ~(1UL << (SIGSYS - 1));
+		act = &copy;
+	}
+
+	swap_app_action(desc->args[0] == SIGTRAP ?
+	    &app_sigtrap_action : &app_interrupt_action, act, old_act);
+
+	return 0;
+}
+
+bool
+intercept_toggle_is_sigaction(const struct syscall_desc *desc)
+{
+	return desc->nr == SYS_rt_sigaction &&
+	    (desc->args[0] == SIGTRAP || desc->args[0] == SIGRTMAX) &&
+	    __atomic_load_n(&handlers_installed, __ATOMIC_ACQUIRE);
+}
+
+static size_t never_again_after = 1;
+
+void
+intercept_setup_never_again(const char *after)
+{
+	if (after != nullptr)
+		never_again_after = strtoul(after, nullptr, 0);
+}
+
+/*
+ * find_patch_edit - the edit of a patch, or nullptr if the text of its
+ * object can not be written, or it is a syscall left unpatched.
+ */
+static struct text_edit *
+find_patch_edit(const struct patch_desc *patch)
+{
+	for (unsigned i = 0; i < toggled_objs_count; ++i) {
+		const struct intercept_desc *desc = toggled_objs + i;
+
+		if (desc->edits != nullptr && patch >= desc->items &&
+		    patch < desc->items + desc->count)
+			return desc->edits + (patch - desc->items);
+	}
+
+	return nullptr;
+}
+
+static void
+protect_edit(const struct text_edit *edit, int prot, const char *msg)
+{
+	unsigned char *first_page = round_down_address(edit->address);
+	unsigned char *last_page =
+	    round_down_address(edit->address + edit->size - 1);
+
+	mprotect_no_intercept(first_page,
+	    (size_t)(last_page - first_page) + PAGE_SIZE, prot, msg);
+}
+
+/*
+ * restore_site - write the original bytes of a single edit, the same way
+ * syscall_intercept_disable does. If another thread is toggling the
+ * patches at the moment, the patch is left as it is, it is restored by
+ * the next call to syscall_intercept_disable.
+ */
+static void
+restore_site(struct text_edit *edit)
+{
+	if (__atomic_exchange_n(&busy, 1, __ATOMIC_ACQUIRE) != 0)
+		return;
+
+	if (edit->state != EDIT_ORIGINAL && setup_toggling() == 0) {
+		protect_edit(edit, PROT_READ | PROT_WRITE | PROT_EXEC,
+		    "mprotect PROT_READ | PROT_WRITE | PROT_EXEC");
+
+		if (edit->state == EDIT_PATCHED) {
+			write_int3(edit, nullptr);
+			sync_cores();
+		}
+		write_original_tail(edit, nullptr);
+		sync_cores();
+		write_original_head(edit, nullptr);
+		sync_cores();
+
+		protect_edit(edit, PROT_READ | PROT_EXEC,
+		    "mprotect PROT_READ | PROT_EXEC");
+	}
+
+	if (edit->state == EDIT_ORIGINAL)
+		retire_edit(edit, nullptr);
+
+	__atomic_store_n(&busy, 0, __ATOMIC_RELEASE);
+}
+
+void
+intercept_never_again(struct patch_desc *patch)
+{
+	if (__atomic_add_fetch(&patch->never_again_count, 1,
+	    __ATOMIC_RELAXED) < never_again_after)
+		return;
+
+	/* only the first thread getting here restores the original bytes */
+	if (__atomic_exchange_n(&patch->is_retired, true, __ATOMIC_ACQ_REL))
+		return;
+
+	struct text_edit *edit = find_patch_edit(patch);
+	if (edit != nullptr)
+		restore_site(edit);
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_toggle.h - undoing the patches at runtime, and redoing them,
+ * see syscall_intercept_disable and syscall_intercept_enable, or undoing
+ * single patches the hook is not interested in.
+ */
+
+#ifndef INTERCEPT_TOGGLE_H
+#define INTERCEPT_TOGGLE_H
+
+#include <stdbool.h>
+
+struct intercept_desc;
+struct patch_desc;
+struct syscall_desc;
+
+/*
+ * intercept_toggle_save - save the original bytes at the patches of an
+ * object, must be called before its patches are activated.
+ */
+void intercept_toggle_save(struct intercept_desc *desc);
+
+/*
+ * intercept_setup_toggle - save the patched bytes of the objects whose
+ * original bytes were saved, once the patches are activated. Objects
+ * whose text is mapped from a shared image can not be toggled, these are
+ * left patched.
+ */
+void intercept_setup_toggle(struct intercept_desc *objs, unsigned objs_count);
+
+/*
+ * intercept_setup_never_again - the number of INTERCEPT_HOOK_NEVER_AGAIN
+ * verdicts after which a syscall instruction is retired, from the
+ * INTERCEPT_NEVER_AGAIN_AFTER environment variable, 1 by default.
+ */
+void intercept_setup_never_again(const char *after);
+
+/*
+ * intercept_never_again - count an INTERCEPT_HOOK_NEVER_AGAIN verdict of
+ * the hook at a syscall instruction. Once there are enough of them, the
+ * syscall instruction is retired: the hook is not called for it anymore,
+ * and the original instructions are restored, if the text of the object
+ * can be written.
+ */
+void intercept_never_again(struct patch_desc *patch);
+
+/*
+ * intercept_toggle_is_sigaction - is the syscall an rt_sigaction call for
+ * SIGTRAP or SIGRTMAX, once the handlers of the library are installed for
+ * these signals. Such syscalls must be executed using
+ * intercept_toggle_rt_sigaction, which records the actions of the
+ * program, to be taken when the library is not the sender of the signal.
+ */
+bool intercept_toggle_is_sigaction(const struct syscall_desc *desc);
+
+long
+intercept_toggle_rt_sigaction(const struct syscall_desc *desc);
+
+#endif
@@ -0,0 +1,437 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_trace.c - syscalls as complete ("ph":"X") trace events, in the
+ * Trace Event JSON format, which can be loaded into Perfetto or
+ * chrome://tracing next to traces of the application itself, e.g.:
+ *
+ * [
+ * {"name":"write","cat":"syscall","ph":"X","ts":1043.245,"dur":4.107,
+ *  "pid":42,"tid":42,"args":{"site":"/lib/libc.so.6(__write+0x14)",
+ *  "arg0":"1","arg1":"\"hello\\n\"","arg2":"6","result":"6"}},
+ * ...
+ * {"name":"trace_end","ph":"i","s":"p","ts":1051.003,"pid":42,"tid":42}
+ * ]
+ *
+ * Each event is printed into a per process buffer, which is written to
+ * the output file when it is full, before the process forks or calls execve,
+ * and when the process exits. The timestamps are CLOCK_MONOTONIC
+ * microseconds.
+ */
+
+#include "intercept_trace.h"
+#include "intercept.h"
+#include "intercept_util.h"
+#include "syscall_formats.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+
+/* The size of the buffer collecting events before writing them */
+#define TRACE_BUFFER_SIZE 0x10000
+
+/* The largest event printed */
+#define TRACE_EVENT_MAX 0x3000
+
+bool intercept_trace_on;
+
+static char trace_path[PATH_MAX];
+static long trace_fd = -1;
+
+/* The process that opened trace_fd, only this one closes the JSON array */
+static long trace_owner_pid;
+static long trace_pid;
+
+static char trace_buffer[TRACE_BUFFER_SIZE];
+static size_t trace_used;
+static int trace_lock;
+
+static __thread long trace_tid
+	__attribute__((tls_model("initial-exec")));
+
+/*
+ * Set while a thread holds trace_lock, events from signal handlers
+ * interrupting the thread at that time are dropped.
+ */
+static __thread bool in_trace
+	__attribute__((tls_model("initial-exec")));
+
+/* Set while a thread holds trace_lock across a fork */
+static __thread bool locked_for_fork
+	__attribute__((tls_model("initial-exec")));
+
+static bool
+lock_trace(void)
+{
+	if (in_trace)
+		return false;
+
+	in_trace = true;
+	while (__atomic_exchange_n(&trace_lock, 1, __ATOMIC_ACQUIRE) != 0)
+		__builtin_ia32_pause();
+
+	return true;
+}
+
+static void
+unlock_trace(void)
+{
+	__atomic_store_n(&trace_lock, 0, __ATOMIC_RELEASE);
+	in_trace = false;
+}
+
+static void
+flush_trace(void)
+{
+	if (trace_fd >= 0)
+		write_all_no_intercept(trace_fd, trace_buffer, trace_used);
+
+	trace_used = 0;
+}
+
+/*
+ * open_trace - create the output file, appending the pid to the path if
+ * it ends with '-'.
+ */
+static void
+open_trace(void)
+{
+	char full_path[sizeof(trace_path) + 0x20];
+	size_t len = strlen(trace_path);
+
+	strcpy(full_path, trace_path);
+	trace_pid = syscall_no_intercept(SYS_getpid);
+
+	if (trace_path[len - 1] == '-') {
+		char *c = full_path + len;
+		char digits[0x20];
+		int n = 0;
+		unsigned long pid = (unsigned long)trace_pid;
+
+		do {
+			digits[n++] = (char)('0' + pid % 10);
+			pid /= 10;
+		} while (pid != 0);
+
+		while (n > 0)
+			*c++ = digits[--n];
+		*c = '\0';
+	}
+
+	trace_fd = syscall_no_intercept(SYS_open, full_path,
+			O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0600);
+
+	xabort_on_syserror(trace_fd, "opening trace");
+
+	trace_owner_pid = trace_pid;
+	write_all_no_intercept(trace_fd, "[\n", 2);
+}
+
+/*
+ * intercept_setup_trace
+ * Enable tracing if a path is specified for the output.
+ */
+void
+intercept_setup_trace(const char *path)
+{
+	if (path == nullptr || path[0] == '\0')
+		return;
+
+	if (strlen(path) >= sizeof(trace_path))
+		xabort("INTERCEPT_TRACE path too long");
+
+	strcpy(trace_path, path);
+	open_trace();
+	intercept_trace_on = true;
+}
+
+static char *
+print_str(char *dst, const char *src)
+{
+	while ((*dst = *src) != '\0') {
+		++dst;
+		++src;
+	}
+
+	return dst;
+}
+
+static char *
+print_udec(char *dst, unsigned long long n, unsigned width)
+{
+	char digits[0x20];
+	unsigned count = 0;
+
+	do {
+		digits[count++] = (char)('0' + n % 10);
+		n /= 10;
+	} while (n != 0);
+
+	while (count < width)
+		digits[count++] = '0';
+
+	while (count > 0)
+		*dst++ = digits[--count];
+
+	return dst;
+}
+
+/* print nanoseconds as microseconds, with three decimal digits */
+static char *
+print_us(char *dst, unsigned long long ns)
+{
+	dst = print_udec(dst, ns / 1000, 0);
+	*dst++ = '.';
+	return print_udec(dst, ns % 1000, 3);
+}
+
+/*
+ * print_json_str - a JSON string literal, cut short at dst_end.
+ * The syscall argument printers only emit printable characters, anything
+ * else is still escaped, to keep the output valid JSON.
+ */
+static char *
+print_json_str(char *dst, const char *src, const char *dst_end)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	*dst++ = '"';
+	for (; *src != '\0' && dst < dst_end - 8; ++src) {
+		unsigned char c = (unsigned char)*src;
+
+		if (c == '"' || c == '\\') {
+			*dst++ = '\\';
+			*dst++ = (char)c;
+		} else if (c < 0x20 || c >= 0x7f) {
+			dst = print_str(dst, "\\u00");
+			*dst++ = hex[c >> 4];
+			*dst++ = hex[c & 0xf];
+		} else {
+			*dst++ = (char)c;
+		}
+	}
+	*dst++ = '"';
+
+	return dst;
+}
+
+static char *
+print_common_fields(char *c, unsigned long long ts)
+{
+	if (trace_tid == 0)
+		trace_tid = syscall_no_intercept(SYS_gettid);
+
+	c = print_str(c, ",\"ts\":");
+	c = print_us(c, ts);
+	c = print_str(c, ",\"pid\":");
+	c = print_udec(c, (unsigned long)trace_pid, 0);
+	c = print_str(c, ",\"tid\":");
+	return print_udec(c, (unsigned long)trace_tid, 0);
+}
+
+static char *
+print_site(char *c, const struct patch_desc *patch, const char *end)
+{
+	char site[PATH_MAX + 0x200];
+	char *s = print_str(site, patch->containing_lib_path);
+
+	if (patch->symbol != nullptr) {
+		*s++ = '(';
+		s = print_str(s, patch->symbol);
+		*s++ = ')';
+		*s = '\0';
+	}
+
+	c = print_str(c, "\"site\":");
+	return print_json_str(c, site, end);
+}
+
+static char *
+print_event(char *c, const struct patch_desc *patch,
+		const struct syscall_desc *desc, unsigned long long start_ns,
+		enum intercept_log_result result_known, long result)
+{
+	/* room left for the keys, and the closing brackets */
+	const char *end = c + TRACE_EVENT_MAX - 0x100;
+	const struct syscall_format *format = get_syscall_format(desc);
+	bool noreturn = (format->return_type == rnoreturn);
+	char value[0x400];
+
+	c = print_str(c, "{\"name\":\"");
+	if (format->name != nullptr) {
+		c = print_str(c, format->name);
+	} else {
+		c = print_str(c, "syscall_");
+		c = print_udec(c, (unsigned)desc->nr, 0);
+	}
+	c = print_str(c, "\",\"cat\":\"syscall\"");
+
+	if (noreturn) {
+		/* an instant event, the syscall does not finish */
+		c = print_str(c, ",\"ph\":\"i\",\"s\":\"t\"");
+		c = print_common_fields(c, start_ns);
+	} else {
+		unsigned long long now = clock_ns_no_intercept();
+
+		c = print_str(c, ",\"ph\":\"X\"");
+		c = print_common_fields(c, start_ns);
+		c = print_str(c, ",\"dur\":");
+		c = print_us(c, now - start_ns);
+	}
+
+	c = print_str(c, ",\"args\":{");
+	c = print_site(c, patch, end - 0x1800);
+
+	for (int i = 0; format->args[i] != arg_none; ++i) {
+		c = print_str(c, ",\"arg");
+		*c++ = (char)('0' + i);
+		c = print_str(c, "\":");
+
+		*intercept_print_syscall_arg(value, desc, i,
+		    result_known, result) = '\0';
+		c = print_json_str(c, value, end);
+	}
+
+	if (result_known == KNOWN && !noreturn) {
+		c = print_str(c, ",\"result\":");
+		*intercept_print_syscall_result(value, desc, result) = '\0';
+		c = print_json_str(c, value, end);
+	}
+
+	return print_str(c, "}},\n");
+}
+
+/*
+ * A new process gets a copy of the trace buffer, thus the buffer is written
+ * out before forking. If the child returns to intercept_routine, the lock
+ * is held across the syscall, so the child does not inherit it in a locked
+ * state.
+ */
+unsigned long long
+intercept_trace_begin(const struct syscall_desc *desc)
+{
+	bool returns_here;
+
+	if (is_fork_syscall(desc, &returns_here)) {
+		if (lock_trace()) {
+			flush_trace();
+			if (returns_here)
+				locked_for_fork = true;
+			else
+				unlock_trace();
+		}
+	} else if (desc->nr == SYS_execve || desc->nr == SYS_execveat) {
+		if (lock_trace()) {
+			flush_trace();
+			unlock_trace();
+		}
+	}
+
+	return clock_ns_no_intercept();
+}
+
+/*
+ * after_fork - release the lock taken in intercept_trace_begin. In a new
+ * child process, the child either gets its own output file, if the path
+ * requested contains the pid, or keeps appending to the one inherited.
+ */
+static void
+after_fork(long result)
+{
+	locked_for_fork = false;
+
+	if (result == 0) {
+		trace_pid = syscall_no_intercept(SYS_getpid);
+		trace_tid = 0;
+		trace_used = 0;
+
+		if (trace_path[strlen(trace_path) - 1] == '-') {
+			syscall_no_intercept(SYS_close, trace_fd);
+			open_trace();
+		}
+	}
+
+	unlock_trace();
+}
+
+void
+intercept_trace_end(const struct patch_desc *patch,
+			const struct syscall_desc *desc,
+			unsigned long long start_ns,
+			enum intercept_log_result result_known,
+			long result)
+{
+	char event[TRACE_EVENT_MAX];
+
+	if (locked_for_fork)
+		after_fork(result);
+
+	char *end = print_event(event, patch, desc, start_ns,
+				result_known, result);
+	size_t len = (size_t)(end - event);
+
+	if (!lock_trace())
+		return;
+
+	if (trace_used + len > sizeof(trace_buffer))
+		flush_trace();
+
+	memcpy(trace_buffer + trace_used, event, len);
+	trace_used += len;
+
+	unlock_trace();
+}
+
+void
+intercept_trace_close(void)
+{
+	if (!lock_trace())
+		return;
+
+	flush_trace();
+
+	if (trace_fd >= 0 && trace_owner_pid == trace_pid) {
+		/* an object as the last element, as JSON has no trailing , */
+		char event[0x100];
+		char *c = print_str(event,
+		    "{\"name\":\"trace_end\",\"ph\":\"i\",\"s\":\"p\"");
+		c = print_common_fields(c, clock_ns_no_intercept());
+		c = print_str(c, "}\n]\n");
+		write_all_no_intercept(trace_fd, event, (size_t)(c - event));
+	}
+
+	unlock_trace();
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * intercept_trace.h - syscalls written as trace events, in the JSON format
+ * read by chrome://tracing and Perfetto.
+ */
+
+#ifndef INTERCEPT_TRACE_H
+#define INTERCEPT_TRACE_H
+
+#include "intercept_log.h"
+
+struct patch_desc;
+struct syscall_desc;
+
+/* Is tracing enabled? Checked before calling any other routine here. */
+extern bool intercept_trace_on;
+
+void intercept_setup_trace(const char *path);
+
+/*
+ * intercept_trace_begin - called right before a syscall is forwarded to the
+ * kernel, returns the timestamp of the start of the event. Buffered events
+ * are written out before syscalls creating a new process, or replacing the
+ * program of the current process.
+ */
+unsigned long long
+intercept_trace_begin(const struct syscall_desc *);
+
+/*
+ * intercept_trace_end - record a complete event for a syscall, started at the
+ * time returned by intercept_trace_begin.
+ */
+void intercept_trace_end(const struct patch_desc *,
+			const struct syscall_desc *,
+			unsigned long long start_ns,
+			enum intercept_log_result result_known,
+			long result);
+
+/*
+ * intercept_trace_close - write out buffered events, and terminate the JSON
+ * array, when the process is about to exit.
+ */
+void intercept_trace_close(void);
+
+#endif
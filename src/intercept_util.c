@@ -36,6 +36,7 @@
 #include "libsyscall_intercept_hook_point.h"
 
 #include <assert.h>
+#include <elf.h>
 #include <errno.h>
 #include <inttypes.h>
 #include <ctype.h>
@@ -49,6 +50,8 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <sched.h>
+#include <signal.h>
+#include <time.h>
 #include <linux/limits.h>
 
 void
@@ -111,6 +114,43 @@ xread(long fd, void *buffer, size_t size)
 		xabort_errno(syscall_error_code(result), __func__);
 }
 
+/* The stack size of threads started by start_thread_no_intercept */
+#define INTERNAL_THREAD_STACK_SIZE 0x40000
+
+void
+start_thread_no_intercept(void (*func)(void *), void *arg)
+{
+	unsigned long all_signals = ~0UL;
+	unsigned long old_mask;
+	char *stack = xmmap_anon(INTERNAL_THREAD_STACK_SIZE);
+
+	/* the new thread inherits this mask, no signal is ever handled there */
+	syscall_no_intercept(SYS_rt_sigprocmask, SIG_SETMASK,
+			&all_signals, &old_mask, sizeof(old_mask));
+
+	long tid = clone_thread_no_intercept(CLONE_VM | CLONE_FS |
+			CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD |
+			CLONE_SYSVSEM,
+			stack + INTERNAL_THREAD_STACK_SIZE, func, arg);
+
+	syscall_no_intercept(SYS_rt_sigprocmask, SIG_SETMASK,
+			&old_mask, nullptr, sizeof(old_mask));
+
+	xabort_on_syserror(tid, __func__);
+}
+
+void
+write_all_no_intercept(long fd, const char *buffer, size_t len)
+{
+	while (len > 0) {
+		long written = syscall_no_intercept(SYS_write, fd, buffer, len);
+		if (written <= 0)
+			return;
+		buffer += written;
+		len -= (size_t)written;
+	}
+}
+
 /* BEGIN CSTYLED */
 static const char *const error_strings[] = {
 #ifdef EPERM
@@ -522,3 +562,70 @@ strerror_no_intercept(long errnum)
 
 	return error_strings[errnum];
 }
+
+typedef int (*clock_gettime_func)(clockid_t, struct timespec *);
+
+static clock_gettime_func vdso_clock_gettime;
+
+/*
+ * setup_clock_no_intercept
+ * The vDSO is a complete ELF image in memory, including its section headers,
+ * so the dynamic symbol table can be found the same way as in a file.
+ */
+void
+setup_clock_no_intercept(const void *vdso_addr)
+{
+	const unsigned char *image = vdso_addr;
+	const Elf64_Ehdr *ehdr = vdso_addr;
+
+	if (ehdr == nullptr || memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0)
+		return;
+
+	/* the difference between symbol values, and addresses in memory */
+	uintptr_t bias = (uintptr_t)image;
+	const Elf64_Phdr *phdrs = (const Elf64_Phdr *)(image + ehdr->e_phoff);
+	for (Elf64_Half i = 0; i < ehdr->e_phnum; ++i) {
+		if (phdrs[i].p_type == PT_LOAD) {
+			bias += phdrs[i].p_offset - phdrs[i].p_vaddr;
+			break;
+		}
+	}
+
+	const Elf64_Shdr *shdrs = (const Elf64_Shdr *)(image + ehdr->e_shoff);
+	for (Elf64_Half i = 0; i < ehdr->e_shnum; ++i) {
+		if (shdrs[i].sh_type != SHT_DYNSYM)
+			continue;
+
+		const Elf64_Sym *syms =
+		    (const Elf64_Sym *)(image + shdrs[i].sh_offset);
+		size_t count = shdrs[i].sh_size / sizeof(syms[0]);
+		const char *strtab = (const char *)image +
+		    shdrs[shdrs[i].sh_link].sh_offset;
+
+		for (size_t s = 0; s < count; ++s) {
+			if (ELF64_ST_TYPE(syms[s].st_info) != STT_FUNC ||
+			    syms[s].st_shndx == SHN_UNDEF)
+				continue;
+
+			if (strcmp(strtab + syms[s].st_name,
+			    "__vdso_clock_gettime") == 0) {
+				vdso_clock_gettime = (clock_gettime_func)
+				    (bias + syms[s].st_value);
+				return;
+			}
+		}
+	}
+}
+
+unsigned long long
+clock_ns_no_intercept(void)
+{
+	struct timespec ts;
+
+	if (vdso_clock_gettime == nullptr ||
+	    vdso_clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		syscall_no_intercept(SYS_clock_gettime, CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long)ts.tv_sec * 1000000000ULL +
+	    (unsigned long long)ts.tv_nsec;
+}
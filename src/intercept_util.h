@@ -84,6 +84,27 @@ long xlseek(long fd, unsigned long off, int whence);
  */
 void xread(long fd, void *buffer, size_t size);
 
+/*
+ * clone_thread_no_intercept - raw clone syscall, the new thread runs
+ * func(arg) on the stack specified. Implemented in util.S.
+ */
+long clone_thread_no_intercept(unsigned long flags, void *stack_top,
+				void (*func)(void *), void *arg);
+
+/*
+ * start_thread_no_intercept - start a thread for internal use, not known
+ * to libc, with all signals blocked. The thread shares the TLS area of
+ * the calling thread, thus it must not use any thread local variable,
+ * nor call into libc. Aborts the process on failure.
+ */
+void start_thread_no_intercept(void (*func)(void *), void *arg);
+
+/*
+ * write_all_no_intercept - write a whole buffer to a file, retrying after
+ * short writes. Gives up silently on errors.
+ */
+void write_all_no_intercept(long fd, const char *buffer, size_t len);
+
 /*
  * strerror_no_intercept - returns a pointer to a C string associated with
  * an errno value.
@@ -91,4 +112,18 @@ void xread(long fd, void *buffer, size_t size);
  */
 const char *strerror_no_intercept(long errnum);
 
+/*
+ * setup_clock_no_intercept - look up __vdso_clock_gettime in the vDSO
+ * image mapped at vdso_addr. Without it (vdso_addr is nullptr, or the
+ * symbol is not found) clock_ns_no_intercept falls back to issuing the
+ * clock_gettime syscall.
+ */
+void setup_clock_no_intercept(const void *vdso_addr);
+
+/*
+ * clock_ns_no_intercept - the CLOCK_MONOTONIC time in nanoseconds.
+ * Does not go through libc, MT-safe, signal-safe.
+ */
+unsigned long long clock_ns_no_intercept(void);
+
 #endif
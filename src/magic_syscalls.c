@@ -32,6 +32,7 @@
 
 #ifndef SYSCALL_INTERCEPT_WITHOUT_MAGIC_SYSCALLS
 
+#include <errno.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -39,6 +40,7 @@
 #include "intercept.h"
 #include "intercept_util.h"
 #include "intercept_log.h"
+#include "intercept_control.h"
 
 /*
  * handle_magic_syscalls - this routine performs two tasks:
@@ -58,6 +60,17 @@ handle_magic_syscalls(struct syscall_desc *desc, long *result)
 
 	const char *message = (void *)(uintptr_t)desc->args[1];
 	size_t len = (size_t)desc->args[2];
+	size_t prefix_len = sizeof(control_message) - 1;
+
+	if (len >= prefix_len &&
+	    memcmp(message, control_message, prefix_len) == 0) {
+		if (intercept_control_run(message + prefix_len,
+		    len - prefix_len) == 0)
+			*result = (long)len;
+		else
+			*result = -EINVAL;
+		return 0;
+	}
 
 	if (strncmp(message, start_log_message, len) == 0) {
 		const char *path = (const void *)(uintptr_t)desc->args[3];
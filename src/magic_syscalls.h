@@ -39,13 +39,18 @@
  * If the need arises, this can be disabled by defining the
  * SYSCALL_INTERCEPT_WITHOUT_MAGIC_SYSCALLS macro during compilation.
  *
- * At the moment there are only two 'magic' syscalls which trigger
+ * At the moment there are three 'magic' syscalls which trigger
  * this feature:
  *
  * write(123, start_log_message, sizeof(start_log_message))
  * write(123, stop_log_message, sizeof(stop_log_message))
+ * write(123, "SYSCALL_INTERCEPT_CONTROL\n" commands, len)
  *
- * These two syscalls are not handled as regular syscalls i.e.:
+ * The last one carries commands, in the format described in
+ * intercept_control.c, and returns the length written, or -EINVAL if some
+ * commands were not understood.
+ *
+ * These syscalls are not handled as regular syscalls i.e.:
  * they are not forwarded to the kernel, neither to a hook routine.
  *
  * Notice: the arguments of the syscall must match exactly. Thus, if
@@ -61,6 +66,7 @@
 #ifndef SYSCALL_INTERCEPT_WITHOUT_MAGIC_SYSCALLS
 
 
+#include <string.h>
 #include <syscall.h>
 #include <unistd.h>
 
@@ -70,6 +76,7 @@ enum { SYSCALL_INT_MAGIC_WRITE_FD = 123 };
 
 static const char start_log_message[] = "SYSCALL_INTERCEPT_TEST_START_LOG";
 static const char stop_log_message[] = "SYSCALL_INTERCEPT_TEST_STOP_LOG";
+static const char control_message[] = "SYSCALL_INTERCEPT_CONTROL\n";
 
 static inline void
 magic_syscall_start_log(const char *path, const char *trunc)
@@ -86,6 +93,19 @@ magic_syscall_stop_log(void)
 	    stop_log_message, sizeof(stop_log_message));
 }
 
+static inline long
+magic_syscall_control(const char *commands)
+{
+	char buf[0x400];
+	size_t len = sizeof(control_message) - 1;
+
+	memcpy(buf, control_message, len);
+	while (*commands != '\0' && len < sizeof(buf))
+		buf[len++] = *commands++;
+
+	return syscall(SYS_write, SYSCALL_INT_MAGIC_WRITE_FD, buf, len);
+}
+
 int handle_magic_syscalls(struct syscall_desc *desc, long *result);
 
 
@@ -103,6 +123,14 @@ magic_syscall_stop_log(void)
 {
 }
 
+static inline long
+magic_syscall_control(const char *commands)
+{
+	(void) commands;
+
+	return -1;
+}
+
 static inline int
 handle_magic_syscalls(struct syscall_desc *desc, long *result);
 {
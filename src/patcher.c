@@ -77,12 +77,10 @@
 #include <syscall.h>
 #include <sys/mman.h>
 #include <string.h>
+#include <stdlib.h>
 
 #include <stdio.h>
 
-/* The size of a trampoline jump, jmp instruction + pointer */
-enum { TRAMPOLINE_SIZE = 6 + 8 };
-
 static void create_wrapper(struct patch_desc *patch, unsigned char **dst);
 
 /*
@@ -167,23 +165,18 @@ check_trampoline_usage(const struct intercept_desc *desc)
 
 	size_t used = (size_t)(desc->next_trampoline - desc->trampoline_table);
 
-	if (used + TRAMPOLINE_SIZE >= desc->trampoline_table_size)
+	if (used + TRAMPOLINE_SIZE > desc->trampoline_table_size)
 		xabort("trampoline space not enough");
 }
 
 /*
- * is_nop_in_range - checks if NOP is sufficiently close to address, to be
- * reachable by a jmp having a 8 bit displacement.
+ * is_in_short_jump_range - checks if a jump destination is sufficiently
+ * close to a syscall instruction, to be reachable by a jmp having a 8 bit
+ * displacement, placed in the place of the syscall.
  */
 static bool
-is_nop_in_range(unsigned char *address, const struct range *nop)
+is_in_short_jump_range(unsigned char *address, const unsigned char *dst)
 {
-	/*
-	 * Planning to put a 5 byte jump starting at the third byte
-	 * of the nop instruction. The syscall should jump to this
-	 * trampoline jump.
-	 */
-	unsigned char *dst = nop->address + 2;
 	/*
 	 * Planning to put a two byte jump in the place of the syscall
 	 * instruction, that is going to jump relative to the value of
@@ -207,52 +200,254 @@ is_nop_in_range(unsigned char *address, const struct range *nop)
 }
 
 /*
- * assign_nop_trampoline
- * Looks for a NOP instruction close to a syscall instruction to be patched.
- * The struct patch_desc argument specifies where the particular syscall
- * instruction resides, and the struct intercept_desc argument of course
- * already contains information about NOPs, collected by the find_syscalls
- * routine.
+ * nop_slot_count - the number of 5 byte trampoline jumps that fit in a nop
+ * instruction, after the two bytes used for jumping over them.
+ * A nop of at least 12 bytes can host more than one.
+ */
+static unsigned
+nop_slot_count(const struct range *nop)
+{
+	return (unsigned)((nop->size - 2) / JUMP_INS_SIZE);
+}
+
+/*
+ * assign_nop_trampolines
+ * Looks for NOP instructions close to the syscall instructions to be
+ * patched, using the NOPs collected by the find_syscalls routine. Each
+ * NOP provides one or more slots for a 5 byte jump (see nop_slot_count),
+ * and each syscall can use any slot reachable with a short jump.
  *
- * This routine essentially initializes the uses_nop_trampoline and
- * the nop_trampoline fields of a struct patch_desc.
+ * The slots are assigned to syscalls as a matching problem: the slots are
+ * visited in address order, and each slot is assigned to the lowest
+ * syscall not assigned yet, that can reach it. Since each syscall can
+ * reach a window of the same size around it, a syscall that can not
+ * reach a slot, can not reach any slot after it either. Assigning the
+ * lowest one maximizes the number of syscalls patched using a NOP.
+ *
+ * This routine essentially initializes the uses_nop_trampoline,
+ * nop_trampoline, and dst_jmp_patch fields of each struct patch_desc.
+ * The patches are expected to be sorted by address, just like the NOPs.
  */
 static void
-assign_nop_trampoline(struct intercept_desc *desc,
-		struct patch_desc *patch,
-		size_t *next_nop_i)
+assign_nop_trampolines(struct intercept_desc *desc)
 {
-	struct range *nop = desc->nop_table + *next_nop_i;
+	unsigned patch_i = 0;
+
+	for (unsigned i = 0; i < desc->count; ++i)
+		desc->items[i].uses_nop_trampoline = false;
 
-	if (*next_nop_i >= desc->nop_count) {
-		patch->uses_nop_trampoline = false;
-		return; /* no more nops available */
+	for (size_t nop_i = 0; nop_i < desc->nop_count; ++nop_i) {
+		const struct range *nop = desc->nop_table + nop_i;
+
+		for (unsigned slot = 0; slot < nop_slot_count(nop); ++slot) {
+			/*
+			 * The first two bytes of the nop are used for
+			 * something else, see the explanation
+			 * at is_overwritable_nop in intercept_desc.c
+			 */
+			unsigned char *dst =
+			    nop->address + 2 + slot * JUMP_INS_SIZE;
+
+			/* skip the syscalls too far behind, for good */
+			while (patch_i < desc->count &&
+			    desc->items[patch_i].syscall_addr < dst &&
+			    !is_in_short_jump_range(
+			    desc->items[patch_i].syscall_addr, dst))
+				++patch_i;
+
+			if (patch_i == desc->count)
+				return; /* no more syscalls */
+
+			struct patch_desc *patch = desc->items + patch_i;
+
+			/* is the next syscall too far ahead? */
+			if (!is_in_short_jump_range(patch->syscall_addr, dst))
+				continue;
+
+			patch->uses_nop_trampoline = true;
+			patch->nop_trampoline = *nop;
+			patch->dst_jmp_patch = dst;
+			++patch_i;
+		}
 	}
+}
 
-	/*
-	 * Consider a nop instruction, to use as trampoline, but only
-	 * if a two byte jump in the place of the syscall can jump
-	 * to the proposed trampoline. Check if the nop is:
-	 *  1) at an address too low
-	 *  2) close enough for a two byte jump
-	 *  3) at an address too high
-	 */
+static bool
+is_legacy_prefix(unsigned char byte)
+{
+	switch (byte) {
+		case 0x26: case 0x2e: case 0x36: case 0x3e:
+		case 0x64: case 0x65: case 0x66: case 0x67:
+		case 0xf0: case 0xf2: case 0xf3:
+			return true;
+		default:
+			return false;
+	}
+}
 
-	if (is_nop_in_range(patch->syscall_addr, nop)) {
-		patch->uses_nop_trampoline = true;
-		patch->nop_trampoline = *nop;
-		++(*next_nop_i);
-		return; /* found a nop in range to use as trampoline */
+/*
+ * has_byte_reg_operand - checks if the reg field of the ModRM byte of an
+ * opcode selects an 8 bit register, e.g. mov %ah, (mem) is 88 /r.
+ * The opcode map is 0 for one byte opcodes, 1 for opcodes after 0x0f,
+ * and 2 for opcodes after 0x0f 0x38, or 0x0f 0x3a.
+ */
+static bool
+has_byte_reg_operand(unsigned char opcode, int map)
+{
+	if (map == 2)
+		return false;
+
+	if (map == 1)
+		return opcode == 0xb0 || opcode == 0xc0; /* cmpxchg, xadd */
+
+	switch (opcode) {
+		case 0x00: case 0x02: case 0x08: case 0x0a:
+		case 0x10: case 0x12: case 0x18: case 0x1a:
+		case 0x20: case 0x22: case 0x28: case 0x2a:
+		case 0x30: case 0x32: case 0x38: case 0x3a:
+		case 0x84: case 0x86: case 0x88: case 0x8a:
+			return true;
+		default:
+			return false;
 	}
+}
+
+/*
+ * find_rip_operand - find the ModRM byte of an instruction with a RIP
+ * relative memory operand, and the REX prefix if there is one.
+ * Returns false for encodings not handled by relocate_rip_operand: VEX,
+ * EVEX, and XOP encoded instructions, and 32 bit addressing.
+ * Also returns false for instructions using AH, CH, DH, or BH without
+ * a REX prefix: with the REX prefix added by relocate_rip_operand, the
+ * same encoding refers to SPL, BPL, SIL, or DIL.
+ */
+bool
+find_rip_operand(const struct intercept_disasm_result *ins,
+		struct rip_operand *op)
+{
+	const unsigned char *code = ins->address;
+	unsigned i = 0;
+
+	if (!ins->has_ip_relative_opr || ins->is_jump)
+		return false;
+
+	while (i < ins->length && is_legacy_prefix(code[i])) {
+		if (code[i] == 0x67)
+			return false; /* address size override */
+		++i;
+	}
+
+	if (i >= ins->length)
+		return false;
 
-	if (nop->address > patch->syscall_addr) {
-		patch->uses_nop_trampoline = false;
-		return; /* nop is too far ahead */
+	op->rex = i;
+	op->has_rex = (code[i] & 0xf0) == 0x40;
+	if (op->has_rex)
+		++i;
+
+	if (i + 1 >= ins->length)
+		return false;
+
+	int map = 0;
+
+	switch (code[i]) {
+		case 0xc4: case 0xc5: case 0x62: case 0x8f:
+			return false;
+		case 0x0f:
+			++i;
+			map = 1;
+			if (code[i] == 0x38 || code[i] == 0x3a) {
+				++i;
+				map = 2;
+			}
+			break;
+		default:
+			break;
 	}
 
-	/* nop is too far behind, try the next nop */
-	++(*next_nop_i);
-	assign_nop_trampoline(desc, patch, next_nop_i);
+	op->modrm = i + 1;
+
+	/* ModRM with mod == 00 and rm == 101, and a 32 bit displacement */
+	if (op->modrm + 5 > ins->length || (code[op->modrm] & 0xc7) != 0x05)
+		return false;
+
+	if (!op->has_rex && has_byte_reg_operand(code[i], map) &&
+	    ((code[op->modrm] >> 3) & 7) >= 4)
+		return false;
+
+	int32_t disp;
+	memcpy(&disp, code + op->modrm + 1, sizeof(disp));
+	return disp == ins->rip_disp;
+}
+
+/*
+ * uses_r11 - checks if the reg field of the ModRM byte refers to R11,
+ * i.e. REX.R is set, and reg is 011. For some opcodes this is not a
+ * register operand, but an opcode extension, never mind.
+ */
+static bool
+uses_r11(const struct intercept_disasm_result *ins,
+		const struct rip_operand *op)
+{
+	const unsigned char *code = ins->address;
+
+	return op->has_rex && (code[op->rex] & 4) != 0 &&
+	    ((code[op->modrm] >> 3) & 7) == 3;
+}
+
+/*
+ * jcc_condition - returns the condition code of a conditional jump, i.e.
+ * the low four bits of its opcode, or -1 if the instruction is not one.
+ */
+int
+jcc_condition(const struct intercept_disasm_result *ins)
+{
+	const unsigned char *code = ins->address;
+	unsigned i = 0;
+
+	if (!ins->is_cond_jump)
+		return -1;
+
+	/* branch hints, and the bnd prefix */
+	while (i < ins->length &&
+	    (code[i] == 0x2e || code[i] == 0x3e || code[i] == 0xf2))
+		++i;
+
+	if (i + 2 == ins->length && (code[i] & 0xf0) == 0x70)
+		return code[i] & 0xf;
+
+	if (i + 6 == ins->length && code[i] == 0x0f &&
+	    (code[i + 1] & 0xf0) == 0x80)
+		return code[i + 1] & 0xf;
+
+	return -1;
+}
+
+/*
+ * is_relocatable
+ * checks if an instruction can be executed at some other address, as
+ * done by relocate_instruction. Conditional jumps, and instructions
+ * with a RIP relative memory operand are rewritten, other instructions
+ * depending on the value of the RIP register can not be relocated.
+ */
+static bool
+is_relocatable(const struct intercept_disasm_result *ins)
+{
+	struct rip_operand op;
+
+	if (ins->is_cond_jump)
+		return jcc_condition(ins) >= 0;
+
+	if (ins->is_call || ins->is_rel_jump || ins->is_jump)
+		return false;
+
+	if (ins->is_lea_rip)
+		return true;
+
+	if (ins->has_ip_relative_opr)
+		return find_rip_operand(ins, &op) && !uses_r11(ins, &op);
+
+	return true;
 }
 
 /*
@@ -266,11 +461,8 @@ is_copiable_before_syscall(struct intercept_disasm_result ins)
 	if (!ins.is_set)
 		return false;
 
-	return !(ins.has_ip_relative_opr ||
-	    ins.is_call ||
-	    ins.is_rel_jump ||
-	    ins.is_jump ||
-	    ins.is_ret ||
+	return is_relocatable(&ins) &&
+	    !(ins.is_ret ||
 	    ins.is_endbr ||
 	    ins.is_syscall);
 }
@@ -288,11 +480,8 @@ is_copiable_after_syscall(struct intercept_disasm_result ins)
 	if (!ins.is_set)
 		return false;
 
-	return !(ins.has_ip_relative_opr ||
-	    ins.is_call ||
-	    ins.is_rel_jump ||
-	    ins.is_jump ||
-	    ins.is_endbr ||
+	return is_relocatable(&ins) &&
+	    !(ins.is_endbr ||
 	    ins.is_syscall);
 }
 
@@ -329,6 +518,61 @@ check_surrounding_instructions(struct intercept_desc *desc,
 	    !has_jump(desc, patch->syscall_addr + SYSCALL_INS_SIZE));
 }
 
+/*
+ * set_aside_unpatched - move the syscalls without enough space around them
+ * for a jump from the items array to the unpatched array, keeping the
+ * order of both. These are left intact in the text, and are intercepted
+ * by trapping them instead, see intercept_sud.c
+ */
+static void
+set_aside_unpatched(struct intercept_desc *desc)
+{
+	unsigned unpatched_count = 0;
+
+	for (unsigned i = 0; i < desc->count; ++i) {
+		if (desc->items[i].is_unpatched)
+			++unpatched_count;
+	}
+
+	if (unpatched_count == 0)
+		return;
+
+	desc->unpatched = xmmap_anon(unpatched_count *
+	    sizeof(desc->unpatched[0]));
+
+	unsigned count = 0;
+	for (unsigned i = 0; i < desc->count; ++i) {
+		if (desc->items[i].is_unpatched)
+			desc->unpatched[desc->unpatched_count++] =
+			    desc->items[i];
+		else
+			desc->items[count++] = desc->items[i];
+	}
+
+	desc->count = count;
+}
+
+/*
+ * create_syscall_stub - create a copy of a syscall instruction left
+ * unpatched, followed by a jump back to the instruction after it. The
+ * asm_wrapper field of the patch points to the copy. Syscalls trapped at
+ * the original instruction, which can not be executed in a signal handler
+ * (e.g. vfork), are executed by the copy instead, see intercept_sud.c
+ */
+static void
+create_syscall_stub(struct patch_desc *patch, unsigned char **dst)
+{
+	unsigned char *code = *dst;
+
+	patch->asm_wrapper = code;
+	patch->return_address = patch->syscall_addr + SYSCALL_INS_SIZE;
+
+	*code++ = 0x0f; /* syscall */
+	*code++ = 0x05;
+
+	*dst = create_absolute_jump(code, patch->return_address);
+}
+
 /*
  * create_patch_wrappers - create the custom assembly wrappers
  * around each syscall to be intercepted. Well, actually, the
@@ -347,15 +591,21 @@ check_surrounding_instructions(struct intercept_desc *desc,
 void
 create_patch_wrappers(struct intercept_desc *desc, unsigned char **dst)
 {
-	size_t next_nop_i = 0;
+	if (desc->is_prepatched) {
+		/* everything is known already, except the wrappers */
+		for (unsigned patch_i = 0; patch_i < desc->count; ++patch_i)
+			create_wrapper(desc->items + patch_i, dst);
+		return;
+	}
+
+	assign_nop_trampolines(desc);
 
 	for (unsigned patch_i = 0; patch_i < desc->count; ++patch_i) {
 		struct patch_desc *patch = desc->items + patch_i;
+		patch->is_unpatched = false;
 		debug_dump("patching %s:0x%lx\n", desc->path,
 				patch->syscall_addr - desc->base_addr);
 
-		assign_nop_trampoline(desc, patch, &next_nop_i);
-
 		if (patch->uses_nop_trampoline) {
 			/*
 			 * The preferred option it to use a 5 byte relative
@@ -364,17 +614,12 @@ create_patch_wrappers(struct intercept_desc *desc, unsigned char **dst)
 			 * jump is enough for jumping to it, thus no
 			 * instructions other than the syscall
 			 * itself need to be overwritten.
+			 * The dst_jmp_patch field already points to the
+			 * slot in the nop assigned to this syscall.
 			 */
 			patch->uses_prev_ins = false;
 			patch->uses_prev_ins_2 = false;
 			patch->uses_next_ins = false;
-			patch->dst_jmp_patch =
-			    patch->nop_trampoline.address + 2;
-			/*
-			 * The first two bytes of the nop are used for
-			 * something else, see the explanation
-			 * at is_overwritable_nop in intercept_desc.c
-			 */
 
 			/*
 			 * Return to libc:
@@ -475,20 +720,27 @@ create_patch_wrappers(struct intercept_desc *desc, unsigned char **dst)
 				char buffer[0x1000];
 
 				int l = snprintf(buffer, sizeof(buffer),
-					"unintercepted syscall at: %s 0x%lx\n",
+					"unpatched syscall at: %s(%s) 0x%lx\n",
 					desc->path,
+					patch->symbol ? patch->symbol : "",
 					patch->syscall_offset);
 
 				intercept_log(buffer, (size_t)l);
-				xabort("not enough space for patching"
-				    " around syscal");
+				patch->is_unpatched = true;
+				continue;
 			}
 		}
 
 		mark_jump(desc, patch->return_address);
-
-		create_wrapper(patch, dst);
 	}
+
+	set_aside_unpatched(desc);
+
+	for (unsigned patch_i = 0; patch_i < desc->count; ++patch_i)
+		create_wrapper(desc->items + patch_i, dst);
+
+	for (unsigned i = 0; i < desc->unpatched_count; ++i)
+		create_syscall_stub(desc->unpatched + i, dst);
 }
 
 /*
@@ -498,11 +750,16 @@ extern unsigned char intercept_asm_wrapper_tmpl[];
 extern unsigned char intercept_asm_wrapper_tmpl_end;
 extern unsigned char intercept_asm_wrapper_patch_desc_addr;
 extern unsigned char intercept_asm_wrapper_wrapper_level1_addr;
+extern unsigned char intercept_asm_wrapper_thread_off_addr;
 extern unsigned char intercept_wrapper;
 
 size_t asm_wrapper_tmpl_size;
 static ptrdiff_t o_patch_desc_addr;
 static ptrdiff_t o_wrapper_level1_addr;
+static ptrdiff_t o_thread_off_addr;
+
+/* the offset of intercept_thread_off from the thread pointer */
+static uintptr_t thread_off_offset;
 
 bool intercept_routine_must_save_ymm;
 
@@ -529,6 +786,9 @@ init_patcher(void)
 	o_patch_desc_addr = &intercept_asm_wrapper_patch_desc_addr - begin;
 	o_wrapper_level1_addr =
 		&intercept_asm_wrapper_wrapper_level1_addr - begin;
+	o_thread_off_addr = &intercept_asm_wrapper_thread_off_addr - begin;
+	thread_off_offset =
+	    (uintptr_t)&intercept_thread_off - thread_pointer();
 
 	/*
 	 * has_ymm_registers -- checks if AVX instructions are supported,
@@ -537,10 +797,14 @@ init_patcher(void)
 	 * this function is implemented in util.s
 	 *
 	 * XXX check for ZMM registers, and save/restore them!
+	 *
+	 * INTERCEPT_NO_YMM_SAVE is only meant for measuring the cost of
+	 * saving YMM registers, hooks using AVX are not safe with it.
 	 */
 	extern bool has_ymm_registers(void);
 
-	intercept_routine_must_save_ymm = has_ymm_registers();
+	intercept_routine_must_save_ymm = has_ymm_registers() &&
+	    getenv("INTERCEPT_NO_YMM_SAVE") == nullptr;
 }
 
 /*
@@ -581,15 +845,71 @@ create_movabs_r11(unsigned char *code, uint64_t value)
 	return create_movabs(code, value, 11);
 }
 
+/*
+ * The jumps of conditional jump instructions relocated into a wrapper.
+ * The 32 bit displacement of each one is filled once the wrapper is
+ * complete, to point to an absolute jump to the original destination,
+ * appended to the wrapper.
+ */
+struct wrapper_branches {
+	unsigned count;
+	unsigned char *disp[3];
+	const unsigned char *dst[3];
+};
+
+/*
+ * relocate_rip_operand
+ * Places an instruction with a RIP relative memory operand at dst, as
+ * two instructions: a movabs instruction loading the address referenced
+ * into the R11 register, and the original instruction with the memory
+ * operand changed to (%r11). The syscall instruction clobbers R11, thus
+ * it can be used in the instructions around it.
+ */
+static unsigned char *
+relocate_rip_operand(unsigned char *dst,
+			const struct intercept_disasm_result *ins)
+{
+	const unsigned char *code = ins->address;
+	struct rip_operand op;
+
+	if (!find_rip_operand(ins, &op))
+		xabort("relocate_rip_operand");
+
+	dst = create_movabs_r11(dst, (uint64_t)ins->rip_ref_addr);
+
+	/* legacy prefixes */
+	memcpy(dst, code, op.rex);
+	dst += op.rex;
+
+	/* the REX prefix, with REX.B set, as R11 is encoded as 1011 */
+	*dst++ = (op.has_rex ? code[op.rex] : 0x40) | 1;
+
+	/* opcode */
+	unsigned opcode = op.has_rex ? op.rex + 1 : op.rex;
+	memcpy(dst, code + opcode, op.modrm - opcode);
+	dst += op.modrm - opcode;
+
+	/* ModRM: mod == 00, rm == 011, without displacement */
+	*dst++ = (code[op.modrm] & 0x38) | 0x03;
+
+	/* immediate operand, if any */
+	unsigned rest = op.modrm + 5;
+	memcpy(dst, code + rest, ins->length - rest);
+
+	return dst + (ins->length - rest);
+}
+
 /*
  * relocate_instruction
  * Places an instruction equivalent to `ins` to the memory location at `dst`.
- * Only handles instructions that can be copied verbatim, and some LEA
- * instructions.
+ * Handles instructions that can be copied verbatim, LEA instructions,
+ * other instructions with RIP relative memory operands, and conditional
+ * jumps.
  */
 static unsigned char *
 relocate_instruction(unsigned char *dst,
-			const struct intercept_disasm_result *ins)
+			const struct intercept_disasm_result *ins,
+			struct wrapper_branches *branches)
 {
 	if (ins->is_lea_rip) {
 		/*
@@ -600,12 +920,45 @@ relocate_instruction(unsigned char *dst,
 		 */
 		return create_movabs(dst, (uint64_t)ins->rip_ref_addr,
 				ins->arg_register_bits);
+	} else if (ins->is_cond_jump) {
+		/*
+		 * A jcc with a 32 bit displacement, its destination
+		 * is filled by create_branch_targets.
+		 */
+		*dst++ = 0x0f;
+		*dst++ = (unsigned char)(0x80 | jcc_condition(ins));
+		branches->disp[branches->count] = dst;
+		branches->dst[branches->count] = ins->rip_ref_addr;
+		++branches->count;
+		return dst + 4;
+	} else if (ins->has_ip_relative_opr) {
+		return relocate_rip_operand(dst, ins);
 	} else {
 		memcpy(dst, ins->address, ins->length);
 		return dst + ins->length;
 	}
 }
 
+/*
+ * create_branch_targets
+ * Appends an absolute jump for each conditional jump relocated into a
+ * wrapper, to the original destination of the jump.
+ */
+static unsigned char *
+create_branch_targets(unsigned char *dst,
+			const struct wrapper_branches *branches)
+{
+	for (unsigned i = 0; i < branches->count; ++i) {
+		int32_t disp = (int32_t)(dst - (branches->disp[i] + 4));
+
+		memcpy(branches->disp[i], &disp, sizeof(disp));
+		dst = create_absolute_jump(dst,
+		    (void *)branches->dst[i]);
+	}
+
+	return dst;
+}
+
 /*
  * create_wrapper
  * Generates an assembly wrapper. Copies the template written in
@@ -618,6 +971,8 @@ relocate_instruction(unsigned char *dst,
 static void
 create_wrapper(struct patch_desc *patch, unsigned char **dst)
 {
+	struct wrapper_branches branches = {.count = 0, };
+
 	/* Create a new copy of the template */
 	patch->asm_wrapper = *dst;
 
@@ -625,21 +980,29 @@ create_wrapper(struct patch_desc *patch, unsigned char **dst)
 	if (patch->uses_prev_ins) {
 		if (patch->uses_prev_ins_2)
 			*dst = relocate_instruction(*dst,
-					&patch->preceding_ins_2);
-		*dst = relocate_instruction(*dst, &patch->preceding_ins);
+					&patch->preceding_ins_2, &branches);
+		patch->wrapper_prev_ins = *dst;
+		*dst = relocate_instruction(*dst, &patch->preceding_ins,
+				&branches);
 	}
 
+	patch->wrapper_syscall = *dst;
 	memcpy(*dst, intercept_asm_wrapper_tmpl, asm_wrapper_tmpl_size);
+	create_movabs_r11(*dst + o_thread_off_addr, thread_off_offset);
 	create_movabs_r11(*dst + o_patch_desc_addr, (uintptr_t)patch);
 	create_movabs_r11(*dst + o_wrapper_level1_addr,
 				(uintptr_t)&intercept_wrapper);
 	*dst += asm_wrapper_tmpl_size;
 
 	/* Copy the following instruction */
+	patch->wrapper_next_ins = *dst;
 	if (patch->uses_next_ins)
-		*dst = relocate_instruction(*dst, &patch->following_ins);
+		*dst = relocate_instruction(*dst, &patch->following_ins,
+				&branches);
 
 	*dst = create_absolute_jump(*dst, patch->return_address);
+
+	*dst = create_branch_targets(*dst, &branches);
 }
 
 /*
@@ -669,6 +1032,175 @@ after_nop(const struct range *nop)
 	return nop->address + nop->size;
 }
 
+/*
+ * fill_trampoline_table - create the trampoline jumps of all patches, the
+ * same ones activate_patches would create, without touching the text.
+ * Used when the text is replaced by an already patched copy.
+ */
+void
+fill_trampoline_table(struct intercept_desc *desc)
+{
+	for (unsigned i = 0; i < desc->count; ++i) {
+		check_trampoline_usage(desc);
+		desc->next_trampoline = create_absolute_jump(
+		    desc->next_trampoline, desc->items[i].asm_wrapper);
+	}
+}
+
+/*
+ * expect_jump - write a jump (a 5 byte jmp, or a 2 byte short jmp) into a
+ * copy of the text, the jump being at the address from in the original
+ * text. The copy starts shift bytes after the original.
+ */
+static void
+expect_jump(unsigned char opcode, size_t size, const unsigned char *from,
+		const void *to, ptrdiff_t shift)
+{
+	unsigned char *dst = (unsigned char *)from + shift;
+	int32_t delta = (int32_t)((const unsigned char *)to - (from + size));
+
+	dst[0] = opcode;
+	if (size == JUMP_INS_SIZE)
+		memcpy(dst + 1, &delta, sizeof(delta));
+	else
+		dst[1] = (unsigned char)((char)delta);
+}
+
+/*
+ * is_patched_text - checks if image is a copy of the text of the object
+ * (starting at the page containing text_start, size bytes long) as patched
+ * by activate_patches. The bytes written for each patch must be the ones
+ * activate_patches writes, each patch jumping to its own trampoline jump,
+ * and all other bytes must be the same as the text in memory.
+ */
+bool
+is_patched_text(const struct intercept_desc *desc, const unsigned char *image,
+		size_t size)
+{
+	unsigned char *first_page = round_down_address(desc->text_start);
+
+	if (!desc->uses_trampoline_table)
+		return false;
+
+	unsigned char *expected = xmmap_anon(size);
+	ptrdiff_t shift = expected - first_page;
+
+	memcpy(expected, first_page, size);
+
+	for (unsigned i = 0; i < desc->count; ++i) {
+		const struct patch_desc *patch = desc->items + i;
+		unsigned char *trampoline =
+		    desc->trampoline_table + (size_t)i * TRAMPOLINE_SIZE;
+
+		expect_jump(JMP_OPCODE, JUMP_INS_SIZE, patch->dst_jmp_patch,
+		    trampoline, shift);
+
+		if (patch->uses_nop_trampoline) {
+			expect_jump(SHORT_JMP_OPCODE, SYSCALL_INS_SIZE,
+			    patch->syscall_addr, patch->dst_jmp_patch, shift);
+			expect_jump(SHORT_JMP_OPCODE, SYSCALL_INS_SIZE,
+			    patch->nop_trampoline.address,
+			    after_nop(&patch->nop_trampoline), shift);
+		} else {
+			memset(patch->dst_jmp_patch + JUMP_INS_SIZE + shift,
+			    INT3_OPCODE, (size_t)(patch->return_address -
+			    (patch->dst_jmp_patch + JUMP_INS_SIZE)));
+		}
+	}
+
+	bool equal = memcmp(expected, image, size) == 0;
+
+	xmunmap(expected, size);
+
+	return equal;
+}
+
+/*
+ * text_page_count - the number of pages the text of an object spans, i.e.
+ * the number of bits in a page map of the text.
+ */
+size_t
+text_page_count(const struct intercept_desc *desc)
+{
+	unsigned char *first_page = round_down_address(desc->text_start);
+
+	return (size_t)(desc->text_end - first_page) / PAGE_SIZE + 1;
+}
+
+/*
+ * mark_written - set the bits corresponding to the pages of the text
+ * overwritten at [addr, addr + len) in a page map.
+ */
+void
+mark_written(unsigned char *page_map, const unsigned char *first_page,
+		const unsigned char *addr, size_t len)
+{
+	size_t first = (size_t)(addr - first_page) / PAGE_SIZE;
+	size_t last = (size_t)(addr + len - 1 - first_page) / PAGE_SIZE;
+
+	for (size_t page = first; page <= last; ++page)
+		page_map[page / 8] |= (unsigned char)(1 << (page % 8));
+}
+
+/*
+ * mark_patch_pages - set the bits corresponding to the pages of the text
+ * written by activate_patches for a patch: the jump, and the int3 bytes
+ * after it, or the syscall instruction, and the nop used as trampoline.
+ */
+static void
+mark_patch_pages(unsigned char *page_map, const unsigned char *first_page,
+		const struct patch_desc *patch)
+{
+	if (patch->uses_nop_trampoline) {
+		mark_written(page_map, first_page,
+		    patch->syscall_addr, SYSCALL_INS_SIZE);
+		mark_written(page_map, first_page,
+		    patch->nop_trampoline.address,
+		    patch->nop_trampoline.size);
+	} else {
+		mark_written(page_map, first_page, patch->dst_jmp_patch,
+		    (size_t)(patch->return_address - patch->dst_jmp_patch));
+	}
+}
+
+static bool
+is_page_marked(const unsigned char *page_map, size_t page)
+{
+	return (page_map[page / 8] & (1 << (page % 8))) != 0;
+}
+
+/*
+ * mprotect_pages - change the protection of the pages marked in a page
+ * map, with one mprotect call for each run of consecutive pages. Returns
+ * the number of calls made.
+ */
+size_t
+mprotect_pages(const unsigned char *page_map, size_t page_count,
+		unsigned char *first_page, int prot, const char *msg)
+{
+	size_t calls = 0;
+	size_t page = 0;
+
+	while (page < page_count) {
+		if (!is_page_marked(page_map, page)) {
+			++page;
+			continue;
+		}
+
+		size_t end = page + 1;
+		while (end < page_count && is_page_marked(page_map, end))
+			++end;
+
+		mprotect_no_intercept(first_page + page * PAGE_SIZE,
+		    (end - page) * PAGE_SIZE, prot, msg);
+		++calls;
+
+		page = end;
+	}
+
+	return calls;
+}
+
 /*
  * activate_patches()
  * Loop over all the patches, and and overwrite each syscall.
@@ -677,17 +1209,19 @@ void
 activate_patches(struct intercept_desc *desc)
 {
 	unsigned char *first_page;
-	size_t size;
 
 	if (desc->count == 0)
 		return;
 
 	first_page = round_down_address(desc->text_start);
-	size = (size_t)(desc->text_end - first_page);
 
-	mprotect_no_intercept(first_page, size,
-	    PROT_READ | PROT_WRITE | PROT_EXEC,
-	    "mprotect PROT_READ | PROT_WRITE | PROT_EXEC");
+	/*
+	 * One bit for each page of the text, set for pages written.
+	 * Only these pages are made writable, not the whole text.
+	 */
+	size_t page_count = text_page_count(desc);
+	size_t page_map_size = page_count / 8 + 1;
+	unsigned char *page_map = xmmap_anon(page_map_size);
 
 	for (unsigned i = 0; i < desc->count; ++i) {
 		const struct patch_desc *patch = desc->items + i;
@@ -696,6 +1230,16 @@ activate_patches(struct intercept_desc *desc)
 		    patch->dst_jmp_patch > desc->text_end)
 			xabort("dst_jmp_patch outside text");
 
+		mark_patch_pages(page_map, first_page, patch);
+	}
+
+	desc->mprotect_calls = mprotect_pages(page_map, page_count,
+	    first_page, PROT_READ | PROT_WRITE | PROT_EXEC,
+	    "mprotect PROT_READ | PROT_WRITE | PROT_EXEC");
+
+	for (unsigned i = 0; i < desc->count; ++i) {
+		const struct patch_desc *patch = desc->items + i;
+
 		/*
 		 * The dst_jmp_patch pointer contains the address where
 		 * the actual jump instruction escaping the patched text
@@ -761,7 +1305,14 @@ activate_patches(struct intercept_desc *desc)
 		}
 	}
 
-	mprotect_no_intercept(first_page, size,
-	    PROT_READ | PROT_EXEC,
+	desc->mprotect_calls += mprotect_pages(page_map, page_count,
+	    first_page, PROT_READ | PROT_EXEC,
 	    "mprotect PROT_READ | PROT_EXEC");
+
+	desc->dirty_text_pages = 0;
+	for (size_t i = 0; i < page_map_size; ++i)
+		desc->dirty_text_pages +=
+		    (size_t)__builtin_popcount(page_map[i]);
+
+	xmunmap(page_map, page_map_size);
 }
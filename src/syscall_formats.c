@@ -152,6 +152,7 @@ static const struct syscall_format formats[] = {
 	SARGS(geteuid, rdec, arg_none),
 	SARGS(getegid, rdec, arg_none),
 	SARGS(setpgid, rdec, arg_none),
+	SARGS(getppid, rdec, arg_none),
 	SARGS(getpgrp, rdec, arg_none),
 	SARGS(setsid, rdec, arg_none),
 	SARGS(setreuid, rdec, arg_, arg_),
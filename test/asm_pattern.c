@@ -191,7 +191,7 @@ main(int argc, char **argv)
 	 * done in the routine called intercept in the intercept.c source
 	 * file.
 	 */
-	struct intercept_desc patches;
+	struct intercept_desc patches = {0, };
 	static unsigned char builtin_wrapper_space[0x10000];
 	unsigned char *asm_wrapper_address = builtin_wrapper_space;
 	init_patcher();
@@ -0,0 +1,95 @@
+#
+# Copyright 2026, Gabor Buella
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in
+#       the documentation and/or other materials provided with the
+#       distribution.
+#
+#     * Neither the name of the copyright holder nor the names of its
+#       contributors may be used to endorse or promote products derived
+#       from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+# A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+# OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+
+# Rewrites libc using AOT_TOOL into the aot_lib directory, then runs
+# PLAIN_PROG, a program not using syscall_intercept, with the rewritten libc
+# (the stubs in libc execute the syscalls), and TEST_PROG with the rewritten
+# libc, first without LD_PRELOAD expecting its usual output, then with
+# INTERCEPT_LOG set, expecting syscalls of libc in the log, and the stats
+# line of libc showing no text pages written at runtime.
+
+get_filename_component(lib_dir aot_lib ABSOLUTE)
+set(log_file ${lib_dir}/.log.aot)
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E make_directory ${lib_dir})
+execute_process(COMMAND ${CMAKE_COMMAND} -E remove -f ${log_file})
+
+execute_process(COMMAND ${AOT_TOOL} libc.so.6 ${lib_dir}/libc.so.6
+	RESULT_VARIABLE HAD_ERROR)
+if(HAD_ERROR)
+	message(FATAL_ERROR "Error rewriting libc: ${HAD_ERROR}")
+endif()
+
+set(ENV{LD_LIBRARY_PATH} ${lib_dir})
+
+execute_process(COMMAND ${PLAIN_PROG} RESULT_VARIABLE HAD_ERROR)
+if(HAD_ERROR)
+	message(FATAL_ERROR "Error without syscall_intercept: ${HAD_ERROR}")
+endif()
+
+execute_process(COMMAND ${TEST_PROG}
+	RESULT_VARIABLE HAD_ERROR
+	OUTPUT_VARIABLE output)
+if(HAD_ERROR)
+	message(FATAL_ERROR "Error without LD_PRELOAD: ${HAD_ERROR}")
+endif()
+if(NOT output MATCHES "hooked - allowed")
+	message(FATAL_ERROR "Unexpected output without LD_PRELOAD: ${output}")
+endif()
+
+set(ENV{INTERCEPT_LOG} ${log_file})
+if(TEST_EXTRA_PRELOAD)
+	set(ENV{LD_PRELOAD} ${TEST_EXTRA_PRELOAD})
+endif()
+
+execute_process(COMMAND ${TEST_PROG} RESULT_VARIABLE HAD_ERROR)
+
+unset(ENV{LD_PRELOAD})
+unset(ENV{INTERCEPT_LOG})
+unset(ENV{LD_LIBRARY_PATH})
+
+if(HAD_ERROR)
+	message(FATAL_ERROR "Error: ${HAD_ERROR}")
+endif()
+
+file(READ ${log_file} output)
+
+if(NOT output MATCHES "libc[^ ]*\\([A-Za-z0-9_]+\\+0x[0-9a-f]+\\) 0x[0-9a-f]+ -- write\\(")
+	message(FATAL_ERROR "${log_file} contains no syscalls from libc")
+endif()
+
+# Runtime patching logs symbolized syscalls of libc as well, the stats line
+# tells the prepatched text apart: it is not written, not even mprotect-ed.
+if(NOT output MATCHES "intercept_stats object [^ ]*libc[^ ]* patches [1-9][0-9]* nop_patches [0-9]+ unpatched [0-9]+ retired [0-9]+ text_pages [1-9][0-9]* dirty_text_pages 0 mprotect_calls 0 ")
+	message(FATAL_ERROR "${log_file}: libc was patched at runtime")
+endif()
@@ -0,0 +1,101 @@
+#
+# Copyright 2026, Gabor Buella
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in
+#       the documentation and/or other materials provided with the
+#       distribution.
+#
+#     * Neither the name of the copyright holder nor the names of its
+#       contributors may be used to endorse or promote products derived
+#       from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+# A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+# OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+
+# Runs TEST_PROG with syscall_intercept preloaded, and the environment
+# variables in TEST_ENV (space separated NAME=VALUE items) set. The file
+# OUTPUT_FILE written by the library is then checked to contain a match
+# for the OUTPUT_REGEX regular expression. If OUTPUT_JSON is set, the file
+# must also contain a valid JSON array. If OUTPUT_HEX is set, the regular
+# expression is matched against the contents of the file in hexadecimal.
+# If OUTPUT_MAX_SIZE is set, the file must have been rotated, i.e.
+# OUTPUT_FILE.1 must exist, and OUTPUT_FILE must not be larger than
+# OUTPUT_MAX_SIZE bytes.
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E remove -f ${OUTPUT_FILE}
+	${OUTPUT_FILE}.1)
+
+separate_arguments(TEST_ENV UNIX_COMMAND "${TEST_ENV}")
+foreach(item ${TEST_ENV})
+	string(FIND "${item}" "=" eq)
+	string(SUBSTRING "${item}" 0 ${eq} name)
+	math(EXPR eq "${eq} + 1")
+	string(SUBSTRING "${item}" ${eq} -1 value)
+	set(ENV{${name}} "${value}")
+endforeach()
+
+if(LIB_FILE)
+if(TEST_EXTRA_PRELOAD)
+	set(ENV{LD_PRELOAD} ${TEST_EXTRA_PRELOAD}:${LIB_FILE})
+else()
+	set(ENV{LD_PRELOAD} ${LIB_FILE})
+endif()
+endif()
+
+execute_process(COMMAND ${TEST_PROG} ${TEST_PROG_ARGS} RESULT_VARIABLE HAD_ERROR)
+
+unset(ENV{LD_PRELOAD})
+
+if(HAD_ERROR)
+	message(FATAL_ERROR "Error: ${HAD_ERROR}")
+endif()
+
+if(NOT EXISTS ${OUTPUT_FILE})
+	message(FATAL_ERROR "${OUTPUT_FILE} was not created")
+endif()
+
+if(OUTPUT_HEX)
+	file(READ ${OUTPUT_FILE} output HEX)
+else()
+	file(READ ${OUTPUT_FILE} output)
+endif()
+
+if(NOT output MATCHES "${OUTPUT_REGEX}")
+	message(FATAL_ERROR "${OUTPUT_FILE} does not match: ${OUTPUT_REGEX}")
+endif()
+
+if(OUTPUT_JSON)
+	string(JSON count ERROR_VARIABLE json_error LENGTH "${output}")
+	if(json_error)
+		message(FATAL_ERROR "${OUTPUT_FILE} is not valid JSON: ${json_error}")
+	endif()
+endif()
+
+if(OUTPUT_MAX_SIZE)
+	if(NOT EXISTS ${OUTPUT_FILE}.1)
+		message(FATAL_ERROR "${OUTPUT_FILE} was not rotated")
+	endif()
+	file(SIZE ${OUTPUT_FILE} size)
+	if(size GREATER OUTPUT_MAX_SIZE)
+		message(FATAL_ERROR "${OUTPUT_FILE} is ${size} bytes long")
+	endif()
+endif()
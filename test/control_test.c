@@ -0,0 +1,156 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * control_test.c - commands sent using a magic syscall, and written to the
+ * control file named by INTERCEPT_CONTROL, turning the hook off and on, and
+ * writing the stats to a log started by a command.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libsyscall_intercept_hook_point.h"
+#include "magic_syscalls.h"
+
+static long hooked;
+
+static int
+hook(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+	(void) result;
+
+	if (syscall_number == SYS_getppid)
+		++hooked;
+
+	return 1;
+}
+
+static bool
+is_hooked(void)
+{
+	long before = hooked;
+
+	getppid();
+
+	return hooked != before;
+}
+
+static void
+write_control_file(const char *commands)
+{
+	FILE *f = fopen(getenv("INTERCEPT_CONTROL"), "w");
+
+	if (f == nullptr || fputs(commands, f) < 0 || fclose(f) != 0) {
+		perror("INTERCEPT_CONTROL");
+		exit(1);
+	}
+}
+
+/*
+ * wait_for_hook - the commands in the control file are executed some time
+ * after it is written, wait up to five seconds for the expected state.
+ */
+static void
+wait_for_hook(bool expected)
+{
+	struct timespec delay = { .tv_nsec = 10000000 };
+
+	for (int i = 0; i < 500; ++i) {
+		if (is_hooked() == expected)
+			return;
+		nanosleep(&delay, nullptr);
+	}
+
+	fprintf(stderr, "hook still %s\n", expected ? "off" : "on");
+	exit(1);
+}
+
+int
+main()
+{
+	intercept_hook_point = hook;
+
+	if (!is_hooked()) {
+		fputs("not hooked\n", stderr);
+		return 1;
+	}
+
+	if (magic_syscall_control("hook off\n") <= 0 || is_hooked()) {
+		fputs("hook off failed\n", stderr);
+		return 1;
+	}
+
+	if (magic_syscall_control("hook on\n") <= 0 || !is_hooked()) {
+		fputs("hook on failed\n", stderr);
+		return 1;
+	}
+
+	if (magic_syscall_control("hook maybe\n") != -1 || errno != EINVAL) {
+		fputs("unknown command accepted\n", stderr);
+		return 1;
+	}
+
+	/* a log file that can not be opened is reported, not fatal */
+	if (magic_syscall_control("log /nonexistent/log\n") != -1 ||
+	    errno != EINVAL) {
+		fputs("failed log command accepted\n", stderr);
+		return 1;
+	}
+
+	write_control_file("# via the control file\n"
+	    "hook off\n"
+	    "log .log.control\n"
+	    "stats\n");
+	wait_for_hook(false);
+
+	write_control_file("hook on\nlog off\n");
+	wait_for_hook(true);
+
+	puts("control ok");
+
+	return 0;
+}
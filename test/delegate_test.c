@@ -0,0 +1,175 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * delegate_test.c - syscalls delegated to the worker thread (see
+ * INTERCEPT_DELEGATE) from several threads return the right results, and
+ * are executed by the worker, as counted in syscall_intercept_stats.
+ * Nothing is delegated on a single CPU, the test is skipped then.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include "libsyscall_intercept_hook_point.h"
+
+#define THREADS 4
+
+static pid_t ppid;
+static long wrong;
+static volatile sig_atomic_t sigpipe_count;
+
+static void
+handle_sigpipe(int sig)
+{
+	(void) sig;
+	++sigpipe_count;
+}
+
+static void *
+thread_func(void *arg)
+{
+	(void) arg;
+
+	for (int i = 0; i < 10000; ++i) {
+		if (getppid() != ppid)
+			__atomic_fetch_add(&wrong, 1, __ATOMIC_RELAXED);
+	}
+
+	return nullptr;
+}
+
+static unsigned long
+delegated_syscalls(void)
+{
+	static char stats[0x10000];
+	const char *key = " delegated ";
+
+	syscall_intercept_stats(stats, sizeof(stats));
+
+	const char *value = strstr(stats, key);
+	if (value == nullptr)
+		return 0;
+
+	return strtoul(value + strlen(key), nullptr, 10);
+}
+
+int
+main()
+{
+	pthread_t threads[THREADS];
+	cpu_set_t cpus;
+
+	if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0 &&
+	    CPU_COUNT(&cpus) < 2) {
+		puts("delegate skipped, a single CPU");
+		return 0;
+	}
+
+	ppid = (pid_t)syscall_no_intercept(SYS_getppid);
+
+	for (int i = 0; i < THREADS; ++i) {
+		if (pthread_create(threads + i, nullptr,
+		    thread_func, nullptr) != 0) {
+			fputs("pthread_create\n", stderr);
+			return 1;
+		}
+	}
+
+	for (int i = 0; i < THREADS; ++i)
+		pthread_join(threads[i], nullptr);
+
+	if (wrong != 0) {
+		fprintf(stderr, "%ld wrong results\n", wrong);
+		return 1;
+	}
+
+	if (delegated_syscalls() < THREADS * 10000) {
+		fputs("syscalls not delegated\n", stderr);
+		return 1;
+	}
+
+	/* only writes to a pipe in non-blocking mode are delegated */
+	int fds[2];
+	unsigned long before = delegated_syscalls();
+
+	if (pipe2(fds, O_NONBLOCK) != 0 || write(fds[1], "x", 1) != 1)
+		return 1;
+
+	if (delegated_syscalls() != before + 1) {
+		fputs("non-blocking write not delegated\n", stderr);
+		return 1;
+	}
+
+	if (fcntl(fds[1], F_SETFL, 0) != 0)
+		return 1;
+
+	for (int i = 0; i < 2; ++i) {
+		if (write(fds[1], "x", 1) != 1)
+			return 1;
+	}
+
+	if (delegated_syscalls() != before + 1) {
+		fputs("blocking write delegated\n", stderr);
+		return 1;
+	}
+
+	/* the SIGPIPE of a delegated write reaches this thread */
+	signal(SIGPIPE, handle_sigpipe);
+	before = delegated_syscalls();
+
+	if (pipe2(fds, O_NONBLOCK) != 0 || close(fds[0]) != 0 ||
+	    write(fds[1], "x", 1) != -1)
+		return 1;
+
+	if (delegated_syscalls() != before + 1 || sigpipe_count != 1) {
+		fputs("SIGPIPE lost\n", stderr);
+		return 1;
+	}
+
+	/*
+	 * Written to the log as a write syscall. Unless stdout is in
+	 * non-blocking mode, the worker hands it back, and it is executed
+	 * by this thread.
+	 */
+	if (write(1, "delegate ok\n", 12) != 12)
+		return 1;
+
+	return 0;
+}
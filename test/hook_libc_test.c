@@ -0,0 +1,116 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * hook_libc_test.c - the hook calls libc functions issuing syscalls, which
+ * are not passed to the hook again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include "libsyscall_intercept_hook_point.h"
+
+static int depth;
+static int max_depth;
+static long hooked_getppid;
+static long hooked_write;
+
+static int
+hook(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+	(void) result;
+
+	if (++depth > max_depth)
+		max_depth = depth;
+
+	if (syscall_number == SYS_write)
+		++hooked_write;
+
+	if (syscall_number == SYS_getppid) {
+		++hooked_getppid;
+
+		char *buf = malloc(0x100);
+		FILE *f = fopen("/dev/null", "w");
+
+		if (buf == nullptr || f == nullptr)
+			abort();
+
+		snprintf(buf, 0x100, "getppid %ld\n", hooked_getppid);
+		fputs(buf, f);
+		fflush(f);
+		fclose(f);
+		free(buf);
+	}
+
+	--depth;
+
+	return 1;
+}
+
+int
+main()
+{
+	intercept_hook_point = hook;
+
+	for (int i = 0; i < 10; ++i) {
+		if (getppid() != (pid_t)syscall_no_intercept(SYS_getppid)) {
+			fputs("wrong result\n", stderr);
+			return 1;
+		}
+	}
+
+	intercept_hook_point = nullptr;
+
+	if (hooked_getppid != 10 || hooked_write != 0 || max_depth != 1) {
+		fprintf(stderr, "getppid %ld write %ld depth %d\n",
+		    hooked_getppid, hooked_write, max_depth);
+		return 1;
+	}
+
+	puts("hook libc ok");
+
+	return 0;
+}
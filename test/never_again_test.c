@@ -0,0 +1,101 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * never_again_test.c - a syscall instruction is retired, once the hook
+ * returns INTERCEPT_HOOK_NEVER_AGAIN for it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include "libsyscall_intercept_hook_point.h"
+
+static long hooked;
+
+static int
+hook(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+	(void) result;
+
+	if (syscall_number != SYS_getppid)
+		return 1;
+
+	++hooked;
+
+	return INTERCEPT_HOOK_NEVER_AGAIN;
+}
+
+int
+main()
+{
+	static char stats[0x10000];
+
+	intercept_hook_point = hook;
+
+	/* retired after the first verdict, by default */
+	for (int i = 0; i < 10; ++i) {
+		if (getppid() != (pid_t)syscall_no_intercept(SYS_getppid)) {
+			fputs("wrong result\n", stderr);
+			return 1;
+		}
+	}
+
+	if (hooked != 1) {
+		fprintf(stderr, "hooked %ld times\n", hooked);
+		return 1;
+	}
+
+	syscall_intercept_stats(stats, sizeof(stats));
+	if (strstr(stats, "getppid") == nullptr ||
+	    strstr(stats, "restored 1") == nullptr) {
+		fputs(stats, stderr);
+		return 1;
+	}
+
+	puts("never again ok");
+
+	return 0;
+}
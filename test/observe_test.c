@@ -0,0 +1,97 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * observe_test.c - syscalls recorded in observer mode are delivered by
+ * syscall_intercept_drain_events.
+ */
+
+#include <stdio.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include "libsyscall_intercept_hook_point.h"
+
+static long events;
+static long wrong;
+
+static void
+observer(const struct syscall_intercept_event *event, void *arg)
+{
+	if (event->syscall_number != SYS_getppid)
+		return;
+
+	++events;
+
+	if (event->result != *(long *)arg ||
+	    event->tid != (int)syscall_no_intercept(SYS_gettid) ||
+	    event->site == nullptr ||
+	    event->end_ns < event->start_ns)
+		++wrong;
+}
+
+int
+main()
+{
+	long ppid = syscall_no_intercept(SYS_getppid);
+
+	if (syscall_intercept_observe(1) != 0) {
+		fputs("observer mode was on\n", stderr);
+		return 1;
+	}
+
+	for (int i = 0; i < 100; ++i)
+		getppid();
+
+	syscall_intercept_observe(0);
+	getppid();
+
+	syscall_intercept_drain_events(observer, &ppid);
+
+	if (events != 100 || wrong != 0 ||
+	    syscall_intercept_events_dropped() != 0) {
+		fprintf(stderr, "events %ld wrong %ld dropped %lu\n",
+		    events, wrong, syscall_intercept_events_dropped());
+		return 1;
+	}
+
+	/* delivered only once */
+	syscall_intercept_drain_events(observer, &ppid);
+	if (events != 100) {
+		fputs("events delivered again\n", stderr);
+		return 1;
+	}
+
+	puts("observe ok");
+
+	return 0;
+}
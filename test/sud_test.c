@@ -0,0 +1,142 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * sud_test.c -- calls a syscall left unpatched in libunpatchable_syscall,
+ * which is passed to the hook using syscall user dispatch, see
+ * intercept_sud.c
+ *
+ * With the "stray" argument, the object is expected not to be patched at
+ * all, with INTERCEPT_TRAP_ALL set. A vfork is issued from it as well,
+ * after which its syscalls must still be trapped, and the number of stray
+ * syscalls in the stats must not be zero.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+#include "libsyscall_intercept_hook_point.h"
+
+#define CALLS 3
+
+long unpatchable_getppid(void);
+long unpatchable_vfork(void);
+
+static int getppid_calls;
+
+static int
+hook(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+	(void) result;
+
+	if (syscall_number == SYS_getppid)
+		++getppid_calls;
+
+	return 1;
+}
+
+/*
+ * vfork_and_wait - the parent waits using syscall_no_intercept, thus it
+ * does not enter libsyscall_intercept, which would trap syscalls again
+ * in any case.
+ */
+static bool
+vfork_and_wait(void)
+{
+	long pid = unpatchable_vfork();
+
+	if (pid == 0)
+		syscall_no_intercept(SYS_exit_group, 0);
+
+	if (pid < 0)
+		return false;
+
+	return syscall_no_intercept(SYS_wait4, pid, nullptr, 0, nullptr)
+	    == pid;
+}
+
+static unsigned long
+stray_syscalls(void)
+{
+	static char stats[0x10000];
+	const char *key = "stray_syscalls ";
+
+	syscall_intercept_stats(stats, sizeof(stats));
+
+	const char *value = strstr(stats, key);
+	if (value == nullptr)
+		return 0;
+
+	return strtoul(value + strlen(key), nullptr, 10);
+}
+
+int
+main(int argc, char **argv)
+{
+	long ppid = syscall_no_intercept(SYS_getppid);
+	bool stray = argc > 1 && strcmp(argv[1], "stray") == 0;
+	int expected_calls = CALLS;
+
+	intercept_hook_point = hook;
+
+	for (int i = 0; i < CALLS; ++i) {
+		if (unpatchable_getppid() != ppid)
+			return EXIT_FAILURE;
+	}
+
+	if (stray) {
+		if (!vfork_and_wait() || unpatchable_getppid() != ppid)
+			return EXIT_FAILURE;
+		++expected_calls;
+	}
+
+	intercept_hook_point = nullptr;
+
+	if (getppid_calls != expected_calls)
+		return EXIT_FAILURE;
+
+	if (stray && stray_syscalls() == 0)
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
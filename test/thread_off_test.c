@@ -0,0 +1,151 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * thread_off_test.c - syscalls of a thread are not passed to the hook while
+ * interception is turned off in it, and threads created by it inherit the
+ * setting only when asked to.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include "libsyscall_intercept_hook_point.h"
+
+static long hooked;
+
+static int
+hook(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+	(void) result;
+
+	if (syscall_number == SYS_getppid)
+		++hooked;
+
+	return 1;
+}
+
+/*
+ * count_hooked - the number of getppid syscalls passed to the hook, out of
+ * ten issued by the calling thread
+ */
+static long
+count_hooked(void)
+{
+	long before = hooked;
+
+	for (int i = 0; i < 10; ++i) {
+		if (getppid() != (pid_t)syscall_no_intercept(SYS_getppid)) {
+			fputs("wrong result\n", stderr);
+			exit(1);
+		}
+	}
+
+	return hooked - before;
+}
+
+static void *
+thread_func(void *arg)
+{
+	*(long *)arg = count_hooked();
+
+	return nullptr;
+}
+
+static long
+count_hooked_in_thread(void)
+{
+	pthread_t thread;
+	long count;
+
+	if (pthread_create(&thread, nullptr, thread_func, &count) != 0 ||
+	    pthread_join(thread, nullptr) != 0) {
+		fputs("pthread\n", stderr);
+		exit(1);
+	}
+
+	return count;
+}
+
+static void
+expect(const char *what, long count, long expected)
+{
+	if (count != expected) {
+		fprintf(stderr, "%s: hooked %ld times\n", what, count);
+		exit(1);
+	}
+}
+
+int
+main()
+{
+	intercept_hook_point = hook;
+
+	expect("on", count_hooked(), 10);
+
+	if (syscall_intercept_thread_set(0, 1) != 1) {
+		fputs("was off\n", stderr);
+		return 1;
+	}
+
+	expect("off", count_hooked(), 0);
+	expect("inherited", count_hooked_in_thread(), 0);
+
+	if (syscall_intercept_thread_set(0, 0) != 0) {
+		fputs("was on\n", stderr);
+		return 1;
+	}
+
+	expect("not inherited", count_hooked_in_thread(), 10);
+	expect("still off", count_hooked(), 0);
+
+	syscall_intercept_thread_set(1, 0);
+
+	expect("on again", count_hooked(), 10);
+
+	puts("thread off ok");
+
+	return 0;
+}
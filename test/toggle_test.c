@@ -0,0 +1,170 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * toggle_test.c - undoing and redoing the patches with
+ * syscall_intercept_disable and syscall_intercept_enable, while another
+ * thread keeps issuing syscalls.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include "libsyscall_intercept_hook_point.h"
+
+static long hooked;
+static volatile bool stop;
+static volatile sig_atomic_t program_signals;
+
+static int
+hook(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+	(void) result;
+
+	if (syscall_number == SYS_getppid)
+		__atomic_add_fetch(&hooked, 1, __ATOMIC_RELAXED);
+
+	return 1;
+}
+
+static long
+hooked_count(void)
+{
+	return __atomic_load_n(&hooked, __ATOMIC_RELAXED);
+}
+
+static void *
+loop(void *arg)
+{
+	(void) arg;
+
+	while (!stop)
+		(void) getppid();
+
+	return nullptr;
+}
+
+static void
+program_handler(int sig)
+{
+	(void) sig;
+	++program_signals;
+}
+
+static void
+other_handler(int sig)
+{
+	(void) sig;
+	program_signals += 10;
+}
+
+static void
+check(bool condition, const char *msg)
+{
+	if (!condition) {
+		fprintf(stderr, "%s\n", msg);
+		exit(1);
+	}
+}
+
+int
+main()
+{
+	pthread_t thread;
+
+	intercept_hook_point = hook;
+
+	/* replaced by the handlers of the library, which chain to these */
+	signal(SIGTRAP, program_handler);
+	signal(SIGRTMAX, program_handler);
+
+	(void) getppid();
+	check(hooked_count() == 1, "not intercepted");
+
+	check(syscall_intercept_disable() == 0, "disable failed");
+	(void) getppid();
+	check(hooked_count() == 1, "intercepted while disabled");
+
+	check(syscall_intercept_enable() == 0, "enable failed");
+	(void) getppid();
+	check(hooked_count() == 2, "not intercepted after enable");
+
+	check(pthread_create(&thread, nullptr, loop, nullptr) == 0,
+	    "pthread_create");
+
+	for (int i = 0; i < 100; ++i) {
+		check(syscall_intercept_disable() == 0, "disable failed");
+		usleep(100);
+		check(syscall_intercept_enable() == 0, "enable failed");
+		usleep(100);
+	}
+
+	stop = true;
+	pthread_join(thread, nullptr);
+
+	long count = hooked_count();
+	(void) getppid();
+	check(hooked_count() == count + 1, "not intercepted at the end");
+
+	raise(SIGTRAP);
+	raise(SIGRTMAX);
+	check(program_signals == 2, "signals not passed to the program");
+
+	/* only recorded, the handler of the library stays installed */
+	check(signal(SIGTRAP, other_handler) == program_handler,
+	    "old SIGTRAP action not returned");
+	check(syscall_intercept_disable() == 0, "disable failed");
+	check(syscall_intercept_enable() == 0, "enable failed");
+	(void) getppid();
+	check(hooked_count() == count + 2, "not intercepted after sigaction");
+
+	raise(SIGTRAP);
+	check(program_signals == 12, "new SIGTRAP handler not called");
+
+	puts("toggle ok");
+
+	return 0;
+}
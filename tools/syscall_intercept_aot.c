@@ -0,0 +1,501 @@
+/*
+ * Copyright 2026, Gabor Buella
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * syscall_intercept_aot.c - patches a shared object ahead of time.
+ *
+ * Usage: syscall_intercept_aot input.so output.so
+ *
+ * The input can also be the name of an object already loaded into this
+ * program, e.g. libc.so.6.
+ *
+ * The object is loaded into memory (without running any of its code), and
+ * the same routines find the syscalls, and patch them, as the ones used
+ * by libsyscall_intercept at startup. The patched text, and a new segment
+ * described in src/intercept_aot.h are written to the output file. When
+ * the output is loaded into a process along with libsyscall_intercept,
+ * the library only needs to generate the wrappers. Without
+ * libsyscall_intercept, the syscalls are executed by stubs in the new
+ * segment.
+ *
+ * The output must not be stripped, the new segment is not part of any
+ * section.
+ */
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <err.h>
+#include <fcntl.h>
+#include <link.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "intercept.h"
+#include "intercept_aot.h"
+
+/* address space reserved after the object for the new segment */
+#define SEGMENT_RESERVE ((size_t)0x4000000)
+
+/* the longest stub: three relocated instructions, syscall, and jmp */
+#define STUB_MAX_SIZE (3 * 15 + SYSCALL_INS_SIZE + JUMP_INS_SIZE)
+
+static size_t
+round_up(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+/*
+ * resolve_path - the path of an object loaded into this program, if the
+ * argument is not a path.
+ */
+static const char *
+resolve_path(const char *name)
+{
+	struct link_map *map;
+
+	if (strchr(name, '/') != nullptr)
+		return name;
+
+	void *handle = dlopen(name, RTLD_LAZY | RTLD_NOLOAD);
+	if (handle == nullptr ||
+	    dlinfo(handle, RTLD_DI_LINKMAP, &map) != 0 ||
+	    map->l_name == nullptr || map->l_name[0] == '\0')
+		errx(EXIT_FAILURE, "%s is not loaded, specify a path", name);
+
+	return map->l_name;
+}
+
+static unsigned char *
+read_file(const char *path, size_t *size)
+{
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0 || fstat(fd, &st) != 0)
+		err(EXIT_FAILURE, "%s", path);
+
+	*size = (size_t)st.st_size;
+	unsigned char *data = malloc(*size);
+	if (data == nullptr)
+		err(EXIT_FAILURE, "malloc");
+
+	size_t done = 0;
+	while (done < *size) {
+		ssize_t r = read(fd, data + done, *size - done);
+		if (r <= 0)
+			err(EXIT_FAILURE, "%s", path);
+		done += (size_t)r;
+	}
+
+	close(fd);
+
+	return data;
+}
+
+static void
+check_elf(const unsigned char *file, size_t size, const char *path)
+{
+	const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *)file;
+
+	if (size < sizeof(*ehdr) ||
+	    memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+	    ehdr->e_ident[EI_CLASS] != ELFCLASS64 ||
+	    ehdr->e_machine != EM_X86_64)
+		errx(EXIT_FAILURE, "%s: not an x86_64 ELF object", path);
+
+	if (ehdr->e_type != ET_DYN)
+		errx(EXIT_FAILURE, "%s: not a shared object", path);
+
+	if (ehdr->e_phentsize != sizeof(Elf64_Phdr) ||
+	    ehdr->e_phoff + ehdr->e_phnum * sizeof(Elf64_Phdr) > size)
+		errx(EXIT_FAILURE, "%s: invalid program headers", path);
+}
+
+/*
+ * load_image - place the contents of the loadable segments into memory
+ * the way the dynamic linker would, followed by SEGMENT_RESERVE bytes
+ * for the new segment, at *segment_vaddr.
+ */
+static unsigned char *
+load_image(const unsigned char *file, size_t size, const char *path,
+		size_t *segment_vaddr)
+{
+	const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *)file;
+	const Elf64_Phdr *phdrs = (const Elf64_Phdr *)(file + ehdr->e_phoff);
+	size_t end = 0;
+
+	for (Elf64_Half i = 0; i < ehdr->e_phnum; ++i) {
+		if (phdrs[i].p_type != PT_LOAD)
+			continue;
+
+		if (phdrs[i].p_offset + phdrs[i].p_filesz > size ||
+		    phdrs[i].p_filesz > phdrs[i].p_memsz)
+			errx(EXIT_FAILURE, "%s: invalid segment", path);
+
+		if (phdrs[i].p_vaddr + phdrs[i].p_memsz > end)
+			end = phdrs[i].p_vaddr + phdrs[i].p_memsz;
+	}
+
+	*segment_vaddr = round_up(end, PAGE_SIZE);
+
+	unsigned char *image = mmap(nullptr, *segment_vaddr + SEGMENT_RESERVE,
+	    PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (image == MAP_FAILED)
+		err(EXIT_FAILURE, "mmap");
+
+	for (Elf64_Half i = 0; i < ehdr->e_phnum; ++i) {
+		if (phdrs[i].p_type == PT_LOAD)
+			memcpy(image + phdrs[i].p_vaddr,
+			    file + phdrs[i].p_offset, phdrs[i].p_filesz);
+	}
+
+	return image;
+}
+
+static void
+save_ins(struct aot_ins *dst, const struct intercept_disasm_result *ins,
+		const unsigned char *image, bool used)
+{
+	memset(dst, 0, sizeof(*dst));
+
+	if (!used)
+		return;
+
+	dst->length = (uint8_t)ins->length;
+	dst->is_lea_rip = ins->is_lea_rip;
+	dst->arg_register_bits = ins->arg_register_bits;
+	dst->has_ip_relative_opr = ins->has_ip_relative_opr;
+	dst->is_cond_jump = ins->is_cond_jump;
+	if (ins->has_ip_relative_opr) {
+		dst->rip_disp = ins->rip_disp;
+		dst->rip_ref_vaddr = (uint64_t)(ins->rip_ref_addr - image);
+	}
+	memcpy(dst->bytes, ins->address, ins->length);
+}
+
+/*
+ * emit_ins - copy an instruction overwritten in the text to a stub,
+ * adjusting the displacement of a rip relative memory operand. The
+ * stubs are close enough to the text for any displacement to fit in 32
+ * bits. Conditional jumps are emitted in their form with a 32 bit
+ * displacement.
+ */
+static unsigned char *
+emit_ins(unsigned char *dst, const struct intercept_disasm_result *ins)
+{
+	struct rip_operand op;
+	int32_t disp;
+
+	if (ins->is_cond_jump) {
+		*dst++ = 0x0f;
+		*dst++ = (unsigned char)(0x80 | jcc_condition(ins));
+		disp = (int32_t)(ins->rip_ref_addr - (dst + 4));
+		memcpy(dst, &disp, sizeof(disp));
+		return dst + 4;
+	}
+
+	memcpy(dst, ins->address, ins->length);
+
+	if (ins->has_ip_relative_opr) {
+		if (!find_rip_operand(ins, &op))
+			errx(EXIT_FAILURE, "unexpected rip relative operand");
+
+		disp = (int32_t)(ins->rip_ref_addr - (dst + ins->length));
+		memcpy(dst + op.modrm + 1, &disp, sizeof(disp));
+	}
+
+	return dst + ins->length;
+}
+
+/*
+ * create_stub - the code executed instead of the overwritten
+ * instructions, when the object is used without libsyscall_intercept.
+ */
+static unsigned char *
+create_stub(unsigned char *dst, const struct patch_desc *patch)
+{
+	if (patch->uses_prev_ins) {
+		if (patch->uses_prev_ins_2)
+			dst = emit_ins(dst, &patch->preceding_ins_2);
+		dst = emit_ins(dst, &patch->preceding_ins);
+	}
+
+	*dst++ = 0x0f; /* syscall */
+	*dst++ = 0x05;
+
+	if (patch->uses_next_ins)
+		dst = emit_ins(dst, &patch->following_ins);
+
+	create_jump(JMP_OPCODE, dst, patch->return_address);
+
+	return dst + JUMP_INS_SIZE;
+}
+
+static void
+write_file(const char *path, const unsigned char *data, size_t size)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+	if (fd < 0)
+		err(EXIT_FAILURE, "%s", path);
+
+	size_t done = 0;
+	while (done < size) {
+		ssize_t r = write(fd, data + done, size - done);
+		if (r <= 0)
+			err(EXIT_FAILURE, "%s", path);
+		done += (size_t)r;
+	}
+
+	if (close(fd) != 0)
+		err(EXIT_FAILURE, "%s", path);
+}
+
+int
+main(int argc, char **argv)
+{
+	size_t file_size;
+	size_t segment_vaddr;
+	struct intercept_desc desc;
+
+	if (argc != 3)
+		errx(EXIT_FAILURE, "usage: %s input.so output.so", argv[0]);
+
+	const char *input = resolve_path(argv[1]);
+	unsigned char *file = read_file(input, &file_size);
+
+	check_elf(file, file_size, input);
+
+	unsigned char *image = load_image(file, file_size, input,
+	    &segment_vaddr);
+	unsigned char *segment = image + segment_vaddr;
+
+	init_patcher();
+
+	memset(&desc, 0, sizeof(desc));
+	desc.base_addr = image;
+	desc.path = input;
+	find_syscalls(&desc);
+
+	if (desc.count == 0)
+		errx(EXIT_FAILURE, "%s: no syscalls found", input);
+
+	/* layout of the new segment */
+	size_t strings_size = 1;
+	for (unsigned i = 0; i < desc.count; ++i) {
+		if (desc.items[i].symbol != nullptr)
+			strings_size += strlen(desc.items[i].symbol) + 1;
+	}
+
+	const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *)file;
+	size_t phnum = ehdr->e_phnum + 1u;
+
+	struct aot_header *header = (struct aot_header *)segment;
+	header->trampolines = PAGE_SIZE;
+	header->trampolines_size = (desc.count + 1) * TRAMPOLINE_SIZE;
+	size_t stubs = round_up(header->trampolines +
+	    header->trampolines_size, PAGE_SIZE);
+	header->records = round_up(stubs + desc.count * STUB_MAX_SIZE, 8);
+	header->strings = header->records +
+	    desc.count * sizeof(struct aot_record);
+	size_t phdrs_offset = round_up(header->strings + strings_size, 8);
+	size_t segment_size = phdrs_offset + phnum * sizeof(Elf64_Phdr);
+
+	if (segment_size > SEGMENT_RESERVE)
+		errx(EXIT_FAILURE, "%s: too many syscalls", input);
+
+	memcpy(header->magic, AOT_MAGIC, sizeof(header->magic));
+	header->version = AOT_VERSION;
+	header->count = desc.count;
+	header->text_vaddr = (uint64_t)(desc.text_start - image);
+	header->text_size = (uint64_t)(desc.text_end - desc.text_start + 1);
+
+	desc.uses_trampoline_table = true;
+	desc.trampoline_table = segment + header->trampolines;
+	desc.trampoline_table_size = header->trampolines_size;
+	desc.next_trampoline = desc.trampoline_table;
+
+	/* the wrappers generated here are not used */
+	unsigned char *wrappers = mmap(nullptr,
+	    desc.count * (asm_wrapper_tmpl_size + 0x100),
+	    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (wrappers == MAP_FAILED)
+		err(EXIT_FAILURE, "mmap");
+
+	create_patch_wrappers(&desc, &wrappers);
+
+	/*
+	 * Prepatched objects are not disassembled at startup, thus syscalls
+	 * left unpatched would not be intercepted at all.
+	 */
+	if (desc.unpatched_count > 0)
+		errx(EXIT_FAILURE, "%s: %u syscalls can not be patched",
+		    input, desc.unpatched_count);
+
+	/* records, and stubs, while the original instructions are intact */
+	struct aot_record *records =
+	    (struct aot_record *)(segment + header->records);
+	char *strings = (char *)segment + header->strings;
+	size_t next_string = 1;
+	unsigned char *next_stub = segment + stubs;
+	unsigned char **stub_addrs = calloc(desc.count, sizeof(*stub_addrs));
+	if (stub_addrs == nullptr)
+		err(EXIT_FAILURE, "calloc");
+
+	for (unsigned i = 0; i < desc.count; ++i) {
+		const struct patch_desc *patch = desc.items + i;
+		struct aot_record *record = records + i;
+
+		record->syscall_vaddr = (uint64_t)(patch->syscall_addr - image);
+		record->syscall_offset = patch->syscall_offset;
+		record->dst_jmp_vaddr =
+		    (uint64_t)(patch->dst_jmp_patch - image);
+		record->return_vaddr =
+		    (uint64_t)(patch->return_address - image);
+		record->uses_prev_ins_2 = patch->uses_prev_ins_2;
+		record->uses_prev_ins = patch->uses_prev_ins;
+		record->uses_next_ins = patch->uses_next_ins;
+		record->uses_nop_trampoline = patch->uses_nop_trampoline;
+		save_ins(&record->preceding_ins_2, &patch->preceding_ins_2,
+		    image, patch->uses_prev_ins && patch->uses_prev_ins_2);
+		save_ins(&record->preceding_ins, &patch->preceding_ins,
+		    image, patch->uses_prev_ins);
+		save_ins(&record->following_ins, &patch->following_ins,
+		    image, patch->uses_next_ins);
+
+		if (patch->symbol != nullptr) {
+			record->symbol = (uint32_t)next_string;
+			strcpy(strings + next_string, patch->symbol);
+			next_string += strlen(patch->symbol) + 1;
+		}
+
+		stub_addrs[i] = next_stub;
+		next_stub = create_stub(next_stub, patch);
+	}
+
+	activate_patches(&desc);
+
+	/* the trampolines jump to the stubs, until overwritten at runtime */
+	for (unsigned i = 0; i < desc.count; ++i) {
+		unsigned char *entry = desc.trampoline_table +
+		    (size_t)i * TRAMPOLINE_SIZE;
+
+		create_jump(JMP_OPCODE, entry, stub_addrs[i]);
+		memset(entry + JUMP_INS_SIZE, INT3_OPCODE,
+		    TRAMPOLINE_SIZE - JUMP_INS_SIZE);
+	}
+
+	/* the program headers, with the new segment after the last one */
+	size_t segment_offset = round_up(file_size, PAGE_SIZE);
+	const Elf64_Phdr *old_phdrs =
+	    (const Elf64_Phdr *)(file + ehdr->e_phoff);
+	Elf64_Phdr *phdrs = (Elf64_Phdr *)(segment + phdrs_offset);
+	Elf64_Half last_load = 0;
+
+	for (Elf64_Half i = 0; i < ehdr->e_phnum; ++i) {
+		if (old_phdrs[i].p_type == PT_LOAD)
+			last_load = i;
+	}
+
+	for (Elf64_Half i = 0, o = 0; i < ehdr->e_phnum; ++i) {
+		phdrs[o] = old_phdrs[i];
+
+		if (phdrs[o].p_type == PT_PHDR) {
+			phdrs[o].p_offset = segment_offset + phdrs_offset;
+			phdrs[o].p_vaddr = segment_vaddr + phdrs_offset;
+			phdrs[o].p_paddr = phdrs[o].p_vaddr;
+			phdrs[o].p_filesz = phnum * sizeof(Elf64_Phdr);
+			phdrs[o].p_memsz = phdrs[o].p_filesz;
+		}
+
+		++o;
+
+		if (i == last_load) {
+			phdrs[o] = (Elf64_Phdr) {
+				.p_type = PT_LOAD,
+				.p_flags = PF_R | PF_X,
+				.p_offset = segment_offset,
+				.p_vaddr = segment_vaddr,
+				.p_paddr = segment_vaddr,
+				.p_filesz = segment_size,
+				.p_memsz = segment_size,
+				.p_align = PAGE_SIZE
+			};
+			++o;
+		}
+	}
+
+	/* the output: the original file, with the patched text */
+	size_t out_size = segment_offset + segment_size;
+	unsigned char *out = calloc(1, out_size);
+	if (out == nullptr)
+		err(EXIT_FAILURE, "calloc");
+
+	memcpy(out, file, file_size);
+
+	for (Elf64_Half i = 0; i < ehdr->e_phnum; ++i) {
+		if (old_phdrs[i].p_type == PT_LOAD &&
+		    (old_phdrs[i].p_flags & PF_X) != 0)
+			memcpy(out + old_phdrs[i].p_offset,
+			    image + old_phdrs[i].p_vaddr,
+			    old_phdrs[i].p_filesz);
+	}
+
+	memcpy(out + segment_offset, segment, segment_size);
+
+	Elf64_Ehdr *out_ehdr = (Elf64_Ehdr *)out;
+	out_ehdr->e_phoff = segment_offset + phdrs_offset;
+	out_ehdr->e_phnum = (Elf64_Half)phnum;
+
+	write_file(argv[2], out, out_size);
+
+	printf("%s: %u syscalls patched, written to %s\n", input, desc.count,
+	    argv[2]);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * syscall_hook_in_process_allowed - this symbol must be provided to
+ * be able to link with syscall_intercept's objects, see test/asm_pattern.c.
+ * Returning zero keeps the library constructor from patching this process.
+ */
+int
+syscall_hook_in_process_allowed(void)
+{
+	return 0;
+}